@@ -18,17 +18,33 @@
 #include <sys/socket.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <linux/filter.h>
 #include <netdb.h>
 #include <errno.h>
+#include <climits>
+#include <cstdlib>
+#include <cstddef>
+#include <linux/sctp.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <ctime>
 
 namespace kcmsg {
 
+static uint64_t now(void)
+{
+	timespec ts;
+	clock_gettime( CLOCK_MONOTONIC_COARSE, &ts );
+	return ( (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000 );
+}
+
 Connection::Connection(sa_family_t fam, int t, int p, int maxthreads, std::string loginstance)
 {
 	// assert a supported protocol
-	assert( ( fam == AF_INET ) || ( fam == AF_INET6 ) );
+	assert( ( fam == AF_INET ) || ( fam == AF_INET6 ) || ( fam == AF_LOCAL ) );
 	assert( ( t == SOCK_STREAM ) || ( t == SOCK_DGRAM ) || ( t == SOCK_SEQPACKET ) || ( t == SOCK_RAW ) );
-	assert( ( p == IPPROTO_TCP ) || ( p == IPPROTO_UDP ) || ( p == IPPROTO_SCTP ) );
+	assert( ( p == IPPROTO_TCP ) || ( p == IPPROTO_UDP ) || ( p == IPPROTO_SCTP ) ||
+			( ( fam == AF_LOCAL ) && ( p == 0 ) ) );
 
 	// initialize member variables
 	// setting all bytes in 'conn' member to 0 makes the default for a
@@ -41,6 +57,12 @@ Connection::Connection(sa_family_t fam, int t, int p, int maxthreads, std::strin
 
 	conn = {0};
 	listen_max = maxthreads;
+	max_threads = maxthreads;
+	streams = 0;
+	stream_map = STREAM_MAP_APPLICATION;
+	credit_flow = false;
+	credit = 0;
+	retransmit_check = 0;
 
 //	logger_ = log4cplus::Logger::getInstance( LOG4CPLUS_TEXT(loginstance) );
 
@@ -58,6 +80,11 @@ Connection::Connection(sa_family_t fam, int t, int p, int maxthreads, std::strin
 	case AF_INET6 :
 		conn.addr.length = 28;
 		break;
+	case AF_LOCAL :
+		// just the family: bind() then picks a unique abstract name, like port 0
+		conn.addr.length = sizeof(sa_family_t);
+		std::memcpy( conn.addr.addr, &fam, sizeof(fam) );
+		break;
 	default:
 		conn.addr.length = sizeof(uint8_t) + MAXADDRLEN;
 	}
@@ -73,85 +100,23 @@ Connection::~Connection() {
 
 int Connection::resolveHost(std::string host, std::string service)
 {
-	int res;
-	addrinfo hints, *result;
-	hints = {0};
-
-	// return hostname in cannonical form and only addresses meeting "hints"
-	hints.ai_flags = AI_CANONNAME | AI_ADDRCONFIG;
-	hints.ai_family = family;
-	hints.ai_socktype = protocol_type;
-	hints.ai_protocol = protocol;
-
-	if( (res = getaddrinfo(host.c_str(), service.c_str(), &hints, &result) ) != 0)
-	{
-		throw std::ios_base::failure("Unable to resolve host/service address");
-		return(res);
-	}
-
-	switch (family)
-	{
-	case AF_INET :
-		conn.addr.length = sizeof(sockaddr_in);
-		std::memcpy( conn.addr.addr, result->ai_addr, sizeof(sockaddr_in) );
-		break;
-	case AF_INET6 :
-		conn.addr.length = sizeof(sockaddr_in6);
-		std::memcpy( conn.addr.addr, result->ai_addr, sizeof(sockaddr_in6) );
-		break;
-	default:
-//		LOG4CPLUS_ERROR( logger_, LOG4CPLUS_TEXT( "Connection class instantiated with unsupported protocol family: \"" )
-//				<< family << "\"" );
-//		throw std::invalid_argument("Unsupported protocol family");
-		break;
-	}
-
-//	LOG4CPLUS_DEBUG( logger_, LOG4CPLUS_TEXT( "Resolved host: \"" ) << LOG4CPLUS_TEXT( host) << "\" and service: \""
-//			<< LOG4CPLUS_TEXT( service) << "\" to " << formatAddress() );
-
-	freeaddrinfo(result);
-	return (res);
+	return ( resolve( host.c_str(), service.c_str(), 0 ) );
 }
 
 int Connection::resolveHost(std::wstring host, std::wstring service)
 {
-	/*
-	int res;
-	addrinfo hints, *result;
-	hints = {0};
-
-	// return hostname in cannonical form and only addresses meeting "hints"
-	hints.ai_flags = AI_CANONNAME | AI_ADDRCONFIG;
-	hints.ai_family = family;
-	hints.ai_socktype = protocol_type;
-	hints.ai_protocol = protocol;
-    */
-
-
-	// convert to punycode
-
-	/*
-	if( (res = getaddrinfo(host.c_str(), service.c_str(), &hints, &result) ) != 0)
-		throw("Unable to resolve host/service address");
-
-	switch (family)
-	{
-	case AF_INET :
-		conn.addr.length = sizeof(sockaddr_in);
-		std::memcpy( conn.addr.addr, result->ai_addr, sizeof(sockaddr_in) );
-		break;
-	case AF_INET6 :
-		conn.addr.length = sizeof(sockaddr_in6);
-		std::memcpy( conn.addr.addr, result->ai_addr, sizeof(sockaddr_in6) );
-		break;
-	default:
-		throw("Unsupported protocol family");
-		break;
-	}
-
-	freeaddrinfo(result);
-	*/
-	return 0;
+	// to the locale's multibyte encoding, which AI_IDN expects for internationalized names
+	std::string h( host.size() * MB_LEN_MAX + 1, '\0' );
+	std::string s( service.size() * MB_LEN_MAX + 1, '\0' );
+
+	size_t hl = wcstombs( &h[0], host.c_str(), h.size() );
+	size_t sl = wcstombs( &s[0], service.c_str(), s.size() );
+	if ( ( hl == (size_t) -1 ) || ( sl == (size_t) -1 ) )
+		throw std::invalid_argument( "host or service not representable in the current locale" );
+
+	h.resize( hl );
+	s.resize( sl );
+	return ( resolve( h.c_str(), s.c_str(), AI_IDN ) );
 }
 
 void Connection::setAddress(std::string a)
@@ -202,6 +167,38 @@ void Connection::setAddress(uint32_t a)
 
 }
 
+void Connection::setAddress(const kcmsg::addr_storage &a)
+{
+	sa_family_t fam;
+	std::memcpy( &fam, a.addr, sizeof(fam) );
+
+	if ( ( fam != family ) || ( a.length > sizeof(conn.addr.addr) ) )
+		throw std::invalid_argument( "address does not match the Connection's family" );
+
+	conn.addr = a;
+}
+
+void Connection::setLocalPath(const std::string &path, bool abstract)
+{
+	if ( family != AF_LOCAL )
+		throw std::invalid_argument( "setLocalPath() on a Connection that is not AF_LOCAL" );
+
+	sockaddr_un un;
+	size_t room = sizeof(un.sun_path) - ( abstract ? 1 : 0 );
+	if ( path.empty() || ( path.size() >= room ) )
+		throw std::invalid_argument( "local socket path empty or too long" );
+
+	memset( &un, 0, sizeof(un) );
+	un.sun_family = AF_LOCAL;
+
+	// abstract names start with a NUL and are exactly as long as the length says
+	size_t start = abstract ? 1 : 0;
+	memcpy( un.sun_path + start, path.data(), path.size() );
+
+	conn.addr.length = offsetof( sockaddr_un, sun_path ) + start + path.size() + ( abstract ? 0 : 1 );
+	std::memcpy( conn.addr.addr, &un, conn.addr.length );
+}
+
 void Connection::setService(std::string p)
 {
 
@@ -217,6 +214,48 @@ void Connection::setListenerQueueSize(uint32_t s)
 	listen_max = s;
 }
 
+void Connection::setReusePort(bool on)
+{
+	int val = on ? 1 : 0;
+	if ( setsockopt( conn.fd, SOL_SOCKET, SO_REUSEPORT, &val, sizeof(val) ) < 0 )
+		throw std::ios_base::failure( "Unable to set SO_REUSEPORT" );
+}
+
+void Connection::setReusePortSteering(uint32_t shards)
+{
+	if ( shards == 0 )
+		throw std::invalid_argument( "no listeners to steer to" );
+
+	// A = cpu % shards; the kernel uses A as the index into the reuse group
+	sock_filter code[] = {
+		{ BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t) ( SKF_AD_OFF + SKF_AD_CPU ) },
+		{ BPF_ALU | BPF_MOD | BPF_K, 0, 0, shards },
+		{ BPF_RET | BPF_A, 0, 0, 0 },
+	};
+	sock_fprog prog = { sizeof(code) / sizeof(code[0]), code };
+
+	if ( setsockopt( conn.fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog) ) < 0 )
+		throw std::ios_base::failure( "Unable to attach reuseport steering program" );
+}
+
+void Connection::setProfile(const kcmsg::SocketProfile &p)
+{
+	profile = p;
+}
+
+const kcmsg::SocketProfile &Connection::getProfile(void)
+{
+	return ( profile );
+}
+
+int Connection::applyProfile(int fd)
+{
+	if ( profile.isDefault() )
+		return ( 0 );
+
+	return ( profile.apply( fd, protocol ) );
+}
+
 bool Connection::isValidateAddress(std::string a)
 {
 	return ( true );
@@ -237,6 +276,16 @@ int Connection::getDescriptor(void)
 	return this->conn.fd;
 }
 
+int Connection::getMaxThreads(void)
+{
+	return this->max_threads;
+}
+
+std::vector<connection_storage> &Connection::getClients(void)
+{
+	return this->clients;
+}
+
 bool Connection::Accept(void)
 {
 	connection_storage cliaddr = {0};
@@ -249,6 +298,9 @@ bool Connection::Accept(void)
 	case AF_INET6 :
 		cliaddr.addr.length = 28;
 		break;
+	case AF_LOCAL :
+		cliaddr.addr.length = sizeof(sockaddr_un);
+		break;
 	default:
 		cliaddr.addr.length = sizeof(uint8_t) + MAXADDRLEN;
 	}
@@ -257,9 +309,13 @@ bool Connection::Accept(void)
 
 	if ( ( cliaddr.fd = accept( conn.fd, ( sockaddr * ) &cliaddr.addr.addr, (unsigned int *) &cliaddr.addr.length ) ) < 0 )
 	{
-		return (errno);
+		return (false);
 	}
 
+	applyProfile( cliaddr.fd );
+
+	clients.push_back( cliaddr );
+
 //	LOG4CPLUS_DEBUG( logger_, LOG4CPLUS_TEXT( "Client accepted on the descriptor (" ) << std::to_string( cliaddr.fd ) << ").");
 
 	return (true);
@@ -268,6 +324,7 @@ bool Connection::Accept(void)
 void Connection::Bind(void)
 {
 //	int err;
+	applyProfile( conn.fd );	// buffer sizes must be set before listen() to size the window scale
 	if ( ( bind(conn.fd, (const struct sockaddr *) &conn.addr.addr, (socklen_t) conn.addr.length) ) < 0 )
 //	{
 //		err = errno;
@@ -283,18 +340,27 @@ void Connection::Bind(void)
 
 void Connection::Close(int sockfd)
 {
+	if ( zerocopy && ( sockfd == conn.fd ) )
+	{
+		zerocopy->drain();
+		zerocopy.reset();
+	}
 	close(sockfd);
 }
 
 void Connection::Connect(void)
 {
 //	int err;
-	if ( ( conn.fd = connect(conn.fd, (const struct sockaddr *) &conn.addr.addr, (socklen_t) conn.addr.length) ) < 0 )
+	applyProfile( conn.fd );	// buffer sizes must be set before the SYN to size the window scale
+	if ( connect(conn.fd, (const struct sockaddr *) &conn.addr.addr, (socklen_t) conn.addr.length) < 0 )
 //	{
 //		err = errno;
 //		LOG4CPLUS_ERROR( logger_, LOG4CPLUS_TEXT( "Connection connect failure. ") << LOG4CPLUS_TEXT( formatErrno( err ) ) );
 		throw std::ios_base::failure( "Unable to Connect()" );
 //	}
+
+	if ( streams )
+		negotiatedStreams();
 //	else
 //	{
 //		LOG4CPLUS_DEBUG( logger_, LOG4CPLUS_TEXT( "Connected socket (") << LOG4CPLUS_TEXT( std::to_string( conn.fd ) )
@@ -302,6 +368,173 @@ void Connection::Connect(void)
 //	}
 }
 
+void Connection::Connect(int timeout)
+{
+	applyProfile( conn.fd );
+
+	int flags = fcntl( conn.fd, F_GETFL );
+	fcntl( conn.fd, F_SETFL, flags | O_NONBLOCK );
+
+	int err = 0;
+	if ( connect( conn.fd, (const struct sockaddr *) &conn.addr.addr, (socklen_t) conn.addr.length ) < 0 )
+	{
+		err = errno;
+		if ( err == EINPROGRESS )
+		{
+			pollfd p = { conn.fd, POLLOUT, 0 };
+			uint64_t deadline = now() + timeout;
+			int n;
+			do
+			{
+				uint64_t t = now();
+				n = poll( &p, 1, ( t < deadline ) ? (int) ( deadline - t ) : 0 );
+			} while ( ( n < 0 ) && ( errno == EINTR ) );
+
+			err = ( n > 0 ) ? connectResult( conn.fd ) : ETIMEDOUT;
+		}
+	}
+
+	if ( err != 0 )
+	{
+		// a socket left mid-connect cannot try again; start over with a
+		// fresh one, as ConnectAny() does with the attempts that lose
+		close( conn.fd );
+		conn.fd = socket( family, protocol_type, protocol );
+		errno = err;
+		throw std::ios_base::failure( "Unable to Connect()" );
+	}
+	fcntl( conn.fd, F_SETFL, flags );
+
+	if ( streams )
+		negotiatedStreams();
+}
+
+void Connection::ConnectAny(const std::vector<addr_storage> &addrs, int timeout, int delay)
+{
+	if ( ( family == AF_LOCAL ) || ( protocol_type == SOCK_DGRAM ) )
+		throw std::logic_error( "ConnectAny() needs an IP stream Connection" );
+
+	delay = std::max( delay, CONNECTION_ATTEMPT_DELAY_MIN );
+
+	// alternate the families, keeping the resolver's order within each
+	std::vector<const addr_storage *> order;
+	std::vector<const addr_storage *> first, second;
+	sa_family_t preferred = 0;
+	for ( auto &a : addrs )
+	{
+		sa_family_t fam;
+		std::memcpy( &fam, a.addr, sizeof(fam) );
+		if ( ( fam != AF_INET ) && ( fam != AF_INET6 ) )
+			continue;
+		if ( preferred == 0 )
+			preferred = fam;
+		( ( fam == preferred ) ? first : second ).push_back( &a );
+	}
+	for ( size_t i = 0; ( i < first.size() ) || ( i < second.size() ); i++ )
+	{
+		if ( i < first.size() )
+			order.push_back( first[i] );
+		if ( i < second.size() )
+			order.push_back( second[i] );
+	}
+
+	std::vector<pollfd> racing;
+	std::vector<const addr_storage *> racing_addr;
+	size_t next = 0;
+	int winner = -1;
+	const addr_storage *won = nullptr;
+	int err = ETIMEDOUT;
+	uint64_t deadline = now() + timeout;
+	uint64_t next_start = 0;
+
+	while ( winner < 0 )
+	{
+		uint64_t t = now();
+		if ( t >= deadline )
+			break;
+
+		if ( ( next < order.size() ) && ( racing.empty() || ( t >= next_start ) ) )
+		{
+			int fd;
+			int res = startConnect( *order[next], fd );
+			next_start = t + delay;
+			if ( res == 0 )
+			{
+				winner = fd;
+				won = order[next];
+			}
+			else if ( res == EINPROGRESS )
+			{
+				racing.push_back( { fd, POLLOUT, 0 } );
+				racing_addr.push_back( order[next] );
+			}
+			else
+			{
+				err = res;
+				next_start = t;		// failed at once, e.g. no route: try the next now
+			}
+			next++;
+			continue;
+		}
+
+		if ( racing.empty() )
+			break;		// every address failed
+
+		uint64_t until = deadline;
+		if ( next < order.size() )
+			until = std::min( until, next_start );
+		int n = poll( racing.data(), racing.size(), (int) ( until - t ) );
+		if ( n <= 0 )
+			continue;
+
+		for ( size_t i = 0; i < racing.size(); )
+		{
+			if ( racing[i].revents == 0 )
+			{
+				i++;
+				continue;
+			}
+
+			int res = connectResult( racing[i].fd );
+			if ( ( res == 0 ) && ( winner < 0 ) )
+			{
+				winner = racing[i].fd;
+				won = racing_addr[i];
+			}
+			else
+			{
+				if ( res != 0 )
+					err = res;
+				close( racing[i].fd );
+				next_start = now();
+			}
+			racing.erase( racing.begin() + i );
+			racing_addr.erase( racing_addr.begin() + i );
+		}
+	}
+
+	for ( auto &p : racing )
+		close( p.fd );
+
+	if ( winner < 0 )
+	{
+		errno = err;
+		throw std::ios_base::failure( "Unable to Connect() to any address" );
+	}
+
+	// back to the blocking socket the rest of Connection expects
+	fcntl( winner, F_SETFL, fcntl( winner, F_GETFL ) & ~O_NONBLOCK );
+	close( conn.fd );
+	conn.fd = winner;
+	conn.addr = *won;
+	sa_family_t fam;
+	std::memcpy( &fam, won->addr, sizeof(fam) );
+	family = fam;
+
+	if ( streams )
+		negotiatedStreams();
+}
+
 void Connection::Listen(void)
 {
 //	int err;
@@ -358,48 +591,80 @@ size_t Connection::Readn(char *msg, size_t nbytes)
 
 size_t Connection::ReadMessage(kcmsg::Message *msg, size_t nbytes)
 {
-	// nbytes is the size of the buffer needed to read the message
-	// msgsize is the actual size of the message which is not known
-	//   until we read its length
-	size_t nleft, msgsize;
-	ssize_t nread;
-	char *ptr;
-
-	ptr = (char *) msg;
-	nleft = nbytes; // Max size of buffer (msg)
-	msgsize = 0;	// We do not know actual message size yet...
-
+	// nbytes is the largest frame the caller accepts; frames arrive whole
+	// from the receive buffer, so the length is known before the copy
+	const char *frame;
+	size_t length;
 
-	while( nleft > 0 )
+	try
 	{
-		if( ( nread = read( conn.fd, ptr, nleft ) ) < 0 )
+		do
 		{
-			if( errno == EINTR )
-			{
-				nread = 0;
-			} else
-			{
-				return (-1);
-			}
-		} else if( nread == 0 )
+			while( ( frame = inbound.next( length ) ) == nullptr )
 			{
-				break;
+				ssize_t nread = inbound.fill( conn.fd );
+
+				if( nread == 0 )
+				{
+					return ( 0 );
+				} else if( nread < 0 )
+				{
+					return (-1);
+				}
 			}
-		nleft -= nread;
-		ptr += nread;
+		} while ( takeFrame( frame, length ) );
+	}
+	catch ( std::domain_error &e )
+	{
+		errno = EPROTO;
+		return (-1);
+	}
+
+	sendAcks();
+
+	if( length > nbytes )
+	{
+		errno = EMSGSIZE;
+		return (-1);
+	}
+
+	msg->deserialize( frame, length );
+	return ( length );
+}
 
-		// set the actual length of the message
-		// if we do not know it yet and have read in enough bytes to obtain it
-		if ( ( msgsize == 0) && ( ( nbytes - nleft ) >= (sizeof(kcmsg::MessageHeader) + 2) ) )
+size_t Connection::ReadFrames(FrameCallback cb)
+{
+	const char *frame;
+	size_t length, count;
+	ssize_t nread;
+
+	if( ( nread = inbound.fill( conn.fd ) ) <= 0 )
+	{
+		if( nread == 0 )
+			errno = 0;	// orderly shutdown
+		return (-1);
+	}
+
+	count = 0;
+	try
+	{
+		while( ( frame = inbound.next( length ) ) != nullptr )
 		{
-			msg->readMessageLength();
-			msg->getMessageLength();
-			nleft -= ( nbytes - msgsize );
+			if ( takeFrame( frame, length ) )
+				continue;
+			cb( frame, length );
+			count++;
 		}
-
+	}
+	catch ( std::domain_error &e )
+	{
+		errno = EPROTO;
+		return (-1);
 	}
 
-	return ( nleft );
+	sendAcks();
+
+	return ( count );
 }
 
 size_t Connection::Writen(char *msg, size_t nbytes)
@@ -433,31 +698,474 @@ size_t Connection::Writen(char *msg, size_t nbytes)
 
 size_t Connection::WriteMessage(kcmsg::Message *msg)
 {
-	size_t nleft, retval;
-	ssize_t nwritten;
-	const char *ptr;
+	size_t retval = msg->getMessageLength();
 
-	ptr = (const char *) msg;
-	nleft = retval = msg->getMessageLength();
+	if ( !admit( msg ) )
+		return (-1);
 
-	while( nleft > 0 )
+	outbound.push( msg );
+	if ( Flush() == (size_t) -1 )
+		return (-1);
+
+	return ( retval );
+}
+
+bool Connection::QueueMessage(kcmsg::Message *msg)
+{
+	if ( !admit( msg ) )
+		return ( false );
+
+	outbound.push( msg );
+	return ( true );
+}
+
+size_t Connection::Flush(void)
+{
+	if ( retransmits && ( now() >= retransmit_check ) )
 	{
-		if( ( nwritten = write( conn.fd, ptr, nleft ) ) <= 0 )
+		queueOverdue();
+		retransmit_check = now() + CONNECTION_RETRANSMIT_CHECK;
+	}
+
+	return outbound.writeTo( conn.fd );
+}
+
+void Connection::setWatermarks(size_t highbytes, size_t lowbytes, size_t highframes, size_t lowframes)
+{
+	outbound.setWatermarks( highbytes, lowbytes, highframes, lowframes );
+}
+
+bool Connection::isWritable(void)
+{
+	return ( !outbound.overHighWatermark() && ( !credit_flow || ( credit.load() > 0 ) ) );
+}
+
+void Connection::setCreditFlow(bool on, uint32_t initial)
+{
+	credit_flow = on;
+	credit = initial;
+
+	// a grant of nothing asks the peer for credit
+	if ( on )
+		GrantCredit( 0 );
+}
+
+size_t Connection::getBuffered(void)
+{
+	return ( inbound.pending() );
+}
+
+uint32_t Connection::getCredit(void)
+{
+	return ( credit.load() );
+}
+
+size_t Connection::GrantCredit(uint32_t n)
+{
+	kcmsg::Message grant;
+	grant.setControl( true );
+	grant.setTransactionIdentifier( MSG_CONTROL_CREDIT );
+	grant.setPriority( MSG_PRIORITY_URGENT );
+	grant.putInt( (int32_t) n );
+	return WriteMessage( &grant );
+}
+
+bool Connection::AwaitCredit(int timeout, FrameCallback cb)
+{
+	uint64_t deadline = now() + timeout;
+	const char *frame;
+	size_t length;
+
+	// frames read ahead by an earlier call may already hold the grant
+	try
+	{
+		while ( ( credit.load() == 0 ) && ( ( frame = inbound.next( length ) ) != nullptr ) )
 		{
-			if( nwritten < 0 && errno == EINTR )
-			{
-				nwritten = 0;
-			} else
+			if ( !takeFrame( frame, length ) )
+				cb( frame, length );
+		}
+		sendAcks();
+	}
+	catch ( std::domain_error &e )
+	{
+		errno = EPROTO;
+		return ( false );
+	}
+
+	while ( credit.load() == 0 )
+	{
+		uint64_t t = now();
+		if ( t >= deadline )
+		{
+			errno = ETIMEDOUT;
+			return ( false );
+		}
+
+		pollfd p = { conn.fd, POLLIN, 0 };
+		int n = poll( &p, 1, (int) ( deadline - t ) );
+		if ( ( n < 0 ) && ( errno != EINTR ) )
+			return ( false );
+		if ( ( n > 0 ) && ( ReadFrames( cb ) == (size_t) -1 ) )
+			return ( false );
+	}
+
+	return ( true );
+}
+
+void Connection::setOnceAndOnlyOnce(bool on, size_t capacity)
+{
+	if ( !on )
+	{
+		retransmits.reset();
+		dedup.reset();
+		pending_ack.reset();
+		return;
+	}
+
+	retransmits.reset( new kcmsg::RetransmitQueue( capacity, RETRANSMIT_TIMEOUT, RETRANSMIT_ATTEMPTS ) );
+	dedup.reset( new kcmsg::DeduplicationWindow( CONNECTION_DEDUP_CAPACITY, DEFAULT_DEDUP_WINDOW ) );
+	retransmit_check = 0;
+}
+
+size_t Connection::Retransmit(void)
+{
+	if ( !retransmits )
+		return ( 0 );
+
+	size_t n = queueOverdue();
+	retransmit_check = now() + CONNECTION_RETRANSMIT_CHECK;
+	if ( outbound.writeTo( conn.fd ) == (size_t) -1 )
+		return (-1);
+
+	return ( n );
+}
+
+void Connection::setZeroCopy(bool on, size_t threshold)
+{
+	if ( protocol_type != SOCK_STREAM )
+		throw std::logic_error( "setZeroCopy() needs a stream Connection" );
+
+	if ( !on )
+	{
+		if ( zerocopy )
+			zerocopy->drain();
+		zerocopy.reset();
+		return;
+	}
+
+	if ( !zerocopy )
+		zerocopy.reset( new kcmsg::ZeroCopySender( conn.fd, threshold ) );
+	zerocopy->setThreshold( threshold );
+}
+
+kcmsg::ZeroCopySender *Connection::getZeroCopy(void)
+{
+	return ( zerocopy.get() );
+}
+
+std::vector<char> Connection::getFrameBuffer(size_t length)
+{
+	if ( zerocopy )
+		return zerocopy->getBuffer( length );
+	return ( std::vector<char>( length ) );
+}
+
+size_t Connection::WriteFrame(std::vector<char> &&frame)
+{
+	size_t length = frame.size();
+	uint32_t session, seq;
+
+	if ( ReceiveBuffer::frameLength( frame.data(), length ) != length )
+	{
+		errno = EINVAL;
+		return (-1);
+	}
+
+	if ( Message::controlCode( frame.data(), length ) == 0 )
+	{
+		if ( Message::sequenceOf( frame.data(), length, session, seq ) )
+		{
+			errno = EINVAL;
+			return (-1);
+		}
+		if ( outbound.overHighWatermark() )
+		{
+			errno = EWOULDBLOCK;
+			return (-1);
+		}
+		if ( !spendCredit() )
+			return (-1);
+	}
+
+	// only send past the queue once it is empty, to keep the order
+	if ( Flush() == (size_t) -1 )
+		return (-1);
+	if ( zerocopy && outbound.empty() )
+		return zerocopy->send( std::move( frame ) );
+
+	// frames from buffers are bulk data: they queue behind the urgent lanes
+	outbound.push( frame.data(), length, MSG_PRIORITY_NORMAL );
+	if ( Flush() == (size_t) -1 )
+		return (-1);
+	return ( length );
+}
+
+int Connection::SendBatch(kcmsg::Message **msgs, int count, const addr_storage *peers)
+{
+	if ( protocol_type != SOCK_DGRAM )
+		throw std::logic_error( "SendBatch() needs a datagram Connection" );
+
+	if ( !datagrams )
+		datagrams.reset( new kcmsg::DatagramBatch( conn.fd, family ) );
+
+	return datagrams->send( msgs, count, peers );
+}
+
+int Connection::RecvBatch(kcmsg::Message **msgs, int count, addr_storage *peers, int flags)
+{
+	if ( protocol_type != SOCK_DGRAM )
+		throw std::logic_error( "RecvBatch() needs a datagram Connection" );
+
+	if ( !datagrams )
+		datagrams.reset( new kcmsg::DatagramBatch( conn.fd, family ) );
+
+	return datagrams->recv( msgs, count, peers, flags );
+}
+
+ssize_t Connection::SendDescriptors(int sockfd, const int *fds, size_t nfds, const char *data, size_t length)
+{
+	if ( ( nfds == 0 ) || ( nfds > CONNECTION_MAX_FDS ) )
+	{
+		errno = EINVAL;
+		return (-1);
+	}
+
+	char dummy = 0;
+	iovec iov;
+	iov.iov_base = (void *) ( length ? data : &dummy );
+	iov.iov_len = length ? length : 1;
+
+	std::vector<char> control( CMSG_SPACE( nfds * sizeof(int) ), 0 );
+	msghdr msg = {0};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.data();
+	msg.msg_controllen = control.size();
+
+	cmsghdr *cm = CMSG_FIRSTHDR( &msg );
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN( nfds * sizeof(int) );
+	std::memcpy( CMSG_DATA( cm ), fds, nfds * sizeof(int) );
+
+	ssize_t n;
+	do
+	{
+		n = sendmsg( sockfd, &msg, MSG_NOSIGNAL );
+	} while ( ( n < 0 ) && ( errno == EINTR ) );
+
+	return ( n );
+}
+
+ssize_t Connection::RecvDescriptors(int sockfd, int *fds, size_t &nfds, char *data, size_t length)
+{
+	size_t room = std::min( nfds, CONNECTION_MAX_FDS );
+	nfds = 0;
+
+	char dummy;
+	iovec iov;
+	iov.iov_base = length ? data : &dummy;
+	iov.iov_len = length ? length : 1;
+
+	std::vector<char> control( CMSG_SPACE( std::max( room, (size_t) 1 ) * sizeof(int) ), 0 );
+	msghdr msg = {0};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.data();
+	msg.msg_controllen = control.size();
+
+	ssize_t n;
+	do
+	{
+		n = recvmsg( sockfd, &msg, MSG_CMSG_CLOEXEC );
+	} while ( ( n < 0 ) && ( errno == EINTR ) );
+
+	if ( n < 0 )
+		return (-1);
+
+	bool dropped = ( msg.msg_flags & MSG_CTRUNC ) != 0;
+	for ( cmsghdr *cm = CMSG_FIRSTHDR( &msg ); cm != nullptr; cm = CMSG_NXTHDR( &msg, cm ) )
+	{
+		if ( ( cm->cmsg_level != SOL_SOCKET ) || ( cm->cmsg_type != SCM_RIGHTS ) )
+			continue;
+
+		size_t count = ( cm->cmsg_len - CMSG_LEN( 0 ) ) / sizeof(int);
+		for ( size_t i = 0; i < count; i++ )
+		{
+			int fd;
+			std::memcpy( &fd, CMSG_DATA( cm ) + i * sizeof(int), sizeof(int) );
+			if ( nfds < room )
+				fds[nfds++] = fd;
+			else
 			{
-				return (-1);
+				close( fd );	// control space is rounded up, so more can arrive than asked for
+				dropped = true;
 			}
 		}
+	}
 
-		nleft -= nwritten;
-		ptr += nwritten;
+	if ( dropped )
+	{
+		errno = EMSGSIZE;
+		return (-1);
 	}
 
-	return ( retval );
+	return ( n );
+}
+
+void Connection::setStreams(uint16_t n, int map)
+{
+	if ( protocol != IPPROTO_SCTP )
+		throw std::logic_error( "SCTP streams on a Connection that is not SCTP" );
+
+	sctp_initmsg init = {0};
+	init.sinit_num_ostreams = n;
+	init.sinit_max_instreams = n;
+	if ( setsockopt( conn.fd, IPPROTO_SCTP, SCTP_INITMSG, &init, sizeof(init) ) < 0 )
+		throw std::ios_base::failure( "Unable to set SCTP streams" );
+
+	// stream and flags of every message arrive as an SCTP_RCVINFO control message
+	int on = 1;
+	if ( setsockopt( conn.fd, IPPROTO_SCTP, SCTP_RECVRCVINFO, &on, sizeof(on) ) < 0 )
+		throw std::ios_base::failure( "Unable to enable SCTP receive information" );
+
+	streams = n ? n : 1;
+	stream_map = map;
+}
+
+uint16_t Connection::streamFor(kcmsg::Message *msg)
+{
+	if ( streams <= 1 )
+		return ( 0 );
+
+	if ( stream_map == STREAM_MAP_PRIORITY )
+	{
+		// most urgent first, so the classes keep their streams as the count shrinks
+		static const uint16_t rank[] = { 2, 3, 1, 0 };	// NORMAL, BULK, HIGH, URGENT
+		return ( rank[msg->getPriority() & 3] % streams );
+	}
+
+	return ( msg->getTransactionApplication() % streams );
+}
+
+size_t Connection::SendMessage(kcmsg::Message *msg, const addr_storage *peer)
+{
+	const char *frame = msg->serialize();
+	size_t length = msg->getMessageLength();
+
+	iovec iov;
+	iov.iov_base = (void *) frame;
+	iov.iov_len = length;
+
+	char control[CMSG_SPACE( sizeof(sctp_sndinfo) )] = {0};
+	msghdr hdr = {0};
+	hdr.msg_iov = &iov;
+	hdr.msg_iovlen = 1;
+	hdr.msg_control = control;
+	hdr.msg_controllen = sizeof(control);
+	if ( peer )
+	{
+		hdr.msg_name = (void *) peer->addr;
+		hdr.msg_namelen = peer->length;
+	}
+
+	cmsghdr *cm = CMSG_FIRSTHDR( &hdr );
+	cm->cmsg_level = IPPROTO_SCTP;
+	cm->cmsg_type = SCTP_SNDINFO;
+	cm->cmsg_len = CMSG_LEN( sizeof(sctp_sndinfo) );
+
+	sctp_sndinfo info = {0};
+	info.snd_sid = streamFor( msg );
+	if ( msg->isControl() || msg->isQuickDeath() )
+		info.snd_flags = SCTP_UNORDERED;
+	info.snd_ppid = htonl( msg->getTransactionIdentifier() );
+	std::memcpy( CMSG_DATA( cm ), &info, sizeof(info) );
+
+	ssize_t n;
+	do
+	{
+		n = sendmsg( conn.fd, &hdr, MSG_NOSIGNAL );
+	} while ( ( n < 0 ) && ( errno == EINTR ) );
+
+	return ( ( n < 0 ) ? (size_t) -1 : (size_t) n );
+}
+
+size_t Connection::RecvMessage(kcmsg::Message *msg, uint16_t *stream, addr_storage *peer)
+{
+	std::vector<char> frame( MAX_MSG_DATA );
+	char control[CMSG_SPACE( sizeof(sctp_rcvinfo) )];
+	sockaddr_storage from;
+
+	for (;;)
+	{
+		iovec iov;
+		iov.iov_base = frame.data();
+		iov.iov_len = frame.size();
+
+		msghdr hdr = {0};
+		hdr.msg_iov = &iov;
+		hdr.msg_iovlen = 1;
+		hdr.msg_control = control;
+		hdr.msg_controllen = sizeof(control);
+		hdr.msg_name = &from;
+		hdr.msg_namelen = sizeof(from);
+
+		ssize_t n = recvmsg( conn.fd, &hdr, 0 );
+		if ( ( n < 0 ) && ( errno == EINTR ) )
+			continue;
+		if ( n <= 0 )
+			return ( ( n == 0 ) ? 0 : (size_t) -1 );
+
+		if ( hdr.msg_flags & MSG_NOTIFICATION )
+			continue;	// association events, not data
+
+		if ( !( hdr.msg_flags & MSG_EOR ) )
+		{
+			// larger than any frame: drain the rest of the record and report it
+			while ( ( n > 0 ) && !( hdr.msg_flags & MSG_EOR ) )
+				n = recvmsg( conn.fd, &hdr, 0 );
+			errno = EMSGSIZE;
+			return (-1);
+		}
+
+		for ( cmsghdr *cm = CMSG_FIRSTHDR( &hdr ); cm != nullptr; cm = CMSG_NXTHDR( &hdr, cm ) )
+		{
+			if ( ( cm->cmsg_level == IPPROTO_SCTP ) && ( cm->cmsg_type == SCTP_RCVINFO ) && stream )
+			{
+				sctp_rcvinfo info;
+				std::memcpy( &info, CMSG_DATA( cm ), sizeof(info) );
+				*stream = info.rcv_sid;
+			}
+		}
+
+		if ( peer )
+		{
+			peer->length = std::min( (size_t) hdr.msg_namelen, sizeof(peer->addr) );
+			std::memcpy( peer->addr, &from, peer->length );
+		}
+
+		try
+		{
+			msg->deserialize( frame.data(), n );
+		}
+		catch ( std::domain_error &e )
+		{
+			errno = EPROTO;
+			return (-1);
+		}
+
+		return ( n );
+	}
 }
 
 /* private methods */
@@ -495,6 +1203,18 @@ std::string Connection::formatAddress(void)
 		ret += std::to_string( p );
 		ret += ")";
 		break;
+	case AF_LOCAL :
+		sockaddr_un *un;
+		un = (sockaddr_un *) &conn.addr.addr;
+		ret = "AF_LOCAL: PATH(";
+		if ( conn.addr.length <= offsetof( sockaddr_un, sun_path ) )
+			ret += "unnamed";
+		else if ( un->sun_path[0] == '\0' )
+			ret += "@" + std::string( un->sun_path + 1, conn.addr.length - offsetof( sockaddr_un, sun_path ) - 1 );
+		else
+			ret += un->sun_path;
+		ret += ")";
+		break;
 	default :
 		ret = "Unsupported protocol family";
 		break;
@@ -770,4 +1490,215 @@ std::string Connection::formatErrno(int err)
 	return (ret);
 }
 
+int Connection::resolve(const char *host, const char *service, int flags)
+{
+	if ( family == AF_LOCAL )
+	{
+		// no name service for local sockets: the host is the path
+		if ( host[0] == '@' )
+			setLocalPath( host + 1, true );
+		else
+			setLocalPath( host );
+		return ( 0 );
+	}
+
+	int res;
+	addrinfo hints, *result;
+	hints = {0};
+
+	// return hostname in cannonical form and only addresses meeting "hints"
+	hints.ai_flags = AI_CANONNAME | AI_ADDRCONFIG | flags;
+	hints.ai_family = family;
+	hints.ai_socktype = protocol_type;
+	hints.ai_protocol = protocol;
+
+	if( (res = getaddrinfo(host, service, &hints, &result) ) != 0)
+	{
+		throw std::ios_base::failure("Unable to resolve host/service address");
+		return(res);
+	}
+
+	switch (family)
+	{
+	case AF_INET :
+		conn.addr.length = sizeof(sockaddr_in);
+		std::memcpy( conn.addr.addr, result->ai_addr, sizeof(sockaddr_in) );
+		break;
+	case AF_INET6 :
+		conn.addr.length = sizeof(sockaddr_in6);
+		std::memcpy( conn.addr.addr, result->ai_addr, sizeof(sockaddr_in6) );
+		break;
+	default:
+//		LOG4CPLUS_ERROR( logger_, LOG4CPLUS_TEXT( "Connection class instantiated with unsupported protocol family: \"" )
+//				<< family << "\"" );
+//		throw std::invalid_argument("Unsupported protocol family");
+		break;
+	}
+
+//	LOG4CPLUS_DEBUG( logger_, LOG4CPLUS_TEXT( "Resolved host: \"" ) << LOG4CPLUS_TEXT( host) << "\" and service: \""
+//			<< LOG4CPLUS_TEXT( service) << "\" to " << formatAddress() );
+
+	freeaddrinfo(result);
+	return (res);
+}
+
+bool Connection::admit(kcmsg::Message *msg)
+{
+	if ( msg->isControl() )
+		return ( true );
+
+	if ( outbound.overHighWatermark() )
+	{
+		errno = EWOULDBLOCK;
+		return ( false );
+	}
+
+	// unnumbered, every such message would share session and sequence 0
+	// and a deduplicating receiver would drop all but the first
+	bool once = msg->isOnceAndOnlyOnce();
+	if ( once && !retransmits )
+	{
+		errno = EINVAL;
+		return ( false );
+	}
+	if ( once && retransmits->isFull() )
+	{
+		errno = ENOBUFS;
+		return ( false );
+	}
+
+	if ( !spendCredit() )
+		return ( false );
+
+	// numbered only once it is certain to be queued
+	if ( once )
+		retransmits->track( msg );
+
+	return ( true );
+}
+
+bool Connection::spendCredit(void)
+{
+	if ( !credit_flow )
+		return ( true );
+
+	uint32_t c = credit.load();
+	do
+	{
+		if ( c == 0 )
+		{
+			errno = EWOULDBLOCK;
+			return ( false );
+		}
+	} while ( !credit.compare_exchange_weak( c, c - 1 ) );
+
+	return ( true );
+}
+
+bool Connection::takeFrame(const char *frame, size_t length)
+{
+	switch ( Message::controlCode( frame, length ) )
+	{
+	case MSG_CONTROL_CREDIT :
+		credit += Message::creditGrant( frame, length );
+		return ( true );
+	case MSG_CONTROL_ACK :
+		if ( !retransmits )
+			return ( false );
+		retransmits->acknowledge( frame, length );
+		return ( true );
+	case 0 :
+		break;
+	default:
+		return ( false );
+	}
+
+	uint16_t org;
+	uint32_t ident, session, seq;
+	if ( !dedup || !Message::sequenceOf( frame, length, session, seq ) ||
+			!Message::sourceOf( frame, length, org, ident ) )
+		return ( false );
+
+	// a resent copy means the earlier ack went missing: ack it again
+	if ( !pending_ack )
+		pending_ack.reset( new kcmsg::Message() );
+	else if ( pending_ack->isControl() && ( ( pending_ack->getTargetOrganization() != org ) ||
+			( pending_ack->getTargetIdentifier() != ident ) ||
+			( pending_ack->getMessageLength() + ACK_ENTRY_LENGTH > MAX_MSG_DATA ) ) )
+		sendAcks();
+	dedup->acknowledge( frame, length, pending_ack.get() );
+
+	return ( dedup->isDuplicate( frame, length ) );
+}
+
+void Connection::sendAcks(void)
+{
+	// the first entry makes it a control message
+	if ( !pending_ack || !pending_ack->isControl() )
+		return;
+
+	outbound.push( pending_ack.get() );
+	pending_ack->clear();
+	outbound.writeTo( conn.fd );	// a lost ack is made good by the resend
+}
+
+size_t Connection::queueOverdue(void)
+{
+	// resends go ahead of new bulk data, the receiver is waiting on them
+	return retransmits->retransmit( [this](const char *frame, size_t length)
+	{
+		outbound.push( frame, length, MSG_PRIORITY_HIGH );
+	} );
+}
+
+int Connection::startConnect(const addr_storage &a, int &fd)
+{
+	sa_family_t fam;
+	std::memcpy( &fam, a.addr, sizeof(fam) );
+
+	if ( ( fd = socket( fam, protocol_type | SOCK_NONBLOCK, protocol ) ) < 0 )
+		return ( errno );
+
+	applyProfile( fd );
+	if ( ( streams > 0 ) && ( protocol == IPPROTO_SCTP ) )
+	{
+		sctp_initmsg init = {0};
+		init.sinit_num_ostreams = streams;
+		init.sinit_max_instreams = streams;
+		setsockopt( fd, IPPROTO_SCTP, SCTP_INITMSG, &init, sizeof(init) );
+		int on = 1;
+		setsockopt( fd, IPPROTO_SCTP, SCTP_RECVRCVINFO, &on, sizeof(on) );
+	}
+
+	if ( connect( fd, (const struct sockaddr *) a.addr, (socklen_t) a.length ) == 0 )
+		return ( 0 );
+
+	int err = errno;
+	if ( err != EINPROGRESS )
+		close( fd );
+	return ( err );
+}
+
+int Connection::connectResult(int fd)
+{
+	int err = 0;
+	socklen_t len = sizeof(err);
+
+	if ( getsockopt( fd, SOL_SOCKET, SO_ERROR, &err, &len ) < 0 )
+		return ( errno );
+	return ( err );
+}
+
+void Connection::negotiatedStreams(void)
+{
+	sctp_status status;
+	socklen_t len = sizeof(status);
+	memset( &status, 0, sizeof(status) );
+
+	// the peer may grant fewer inbound streams than we asked to send on
+	if ( ( getsockopt( conn.fd, IPPROTO_SCTP, SCTP_STATUS, &status, &len ) == 0 ) &&
+			( status.sstat_outstrms > 0 ) && ( status.sstat_outstrms < streams ) )
+		streams = status.sstat_outstrms;
+}
+
 } /* namespace kcmsg */
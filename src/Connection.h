@@ -10,18 +10,42 @@
 
 #include <stdint.h>
 #include <netinet/in.h>
+#include <sys/un.h>
 #include <netdb.h>
 #include <string>
 #include <array>
 #include <vector>
+#include <functional>
+#include <memory>
+#include <atomic>
 
 #include <log4cplus/loggingmacros.h>
 
 #include "Message.h"
+#include "OutboundQueue.h"
+#include "ReceiveBuffer.h"
+#include "DatagramBatch.h"
+#include "SocketProfile.h"
+#include "ZeroCopySender.h"
+#include "RetransmitQueue.h"
+#include "DeduplicationWindow.h"
 
 namespace kcmsg {
 
-#define MAXADDRLEN 104
+const size_t CONNECTION_MAX_FDS = 253;	// descriptors per SCM_RIGHTS message, the kernel's SCM_MAX_FD
+
+/* How SendMessage() picks the SCTP stream of a message, see setStreams() */
+const int STREAM_MAP_APPLICATION = 0;	// transaction_application modulo the streams
+const int STREAM_MAP_PRIORITY = 1;		// one stream per priority class, URGENT on stream 0
+const uint16_t CONNECTION_SCTP_STREAMS = 16;
+
+const int CONNECTION_ATTEMPT_DELAY = 250;	// ms before racing the next address, RFC 8305
+const int CONNECTION_ATTEMPT_DELAY_MIN = 10;
+
+const size_t CONNECTION_DEDUP_CAPACITY = 16384;	// once-and-only-once identifiers remembered per Connection, to start with
+const uint32_t CONNECTION_RETRANSMIT_CHECK = 10;	// ms between scans for overdue acks by Flush()
+
+#define MAXADDRLEN 112		// room for a sockaddr_un
 
 struct addr_storage
 {
@@ -39,17 +63,42 @@ struct connection_storage
 class Connection {
 private:
 	int listen_max;
+	int max_threads;
 	int family;
 	int protocol_type;
 	int protocol;
 	connection_storage conn;
 	std::vector<connection_storage> clients;
+	kcmsg::OutboundQueue outbound;
+	kcmsg::ReceiveBuffer inbound;
+	std::unique_ptr<kcmsg::DatagramBatch> datagrams;	// SOCK_DGRAM only, made on first use
+	kcmsg::SocketProfile profile;
+	std::unique_ptr<kcmsg::ZeroCopySender> zerocopy;	// made by setZeroCopy()
+	bool credit_flow;
+	std::atomic<uint32_t> credit;	// messages the peer will still take
+	std::unique_ptr<kcmsg::RetransmitQueue> retransmits;	// made by setOnceAndOnlyOnce()
+	std::unique_ptr<kcmsg::DeduplicationWindow> dedup;
+	std::unique_ptr<kcmsg::Message> pending_ack;	// acks gathered while reading, reused
+	uint64_t retransmit_check;
+	uint16_t streams;		// SCTP streams in use, 0 before setStreams()
+	int stream_map;
 //	log4cplus::Logger logger_;
 
 	std::string formatAddress(void);
 	std::string formatErrno(int err);
+	int resolve(const char *host, const char *service, int flags);
+	void negotiatedStreams(void);
+	int startConnect(const addr_storage &a, int &fd);
+	bool admit(kcmsg::Message *msg);
+	bool spendCredit(void);
+	bool takeFrame(const char *frame, size_t length);
+	void sendAcks(void);
+	size_t queueOverdue(void);
+	static int connectResult(int fd);
 
 public:
+	typedef std::function<void(const char *frame, size_t length)> FrameCallback;
+
 	/*  Parameters
 	 *    fam:  Protocol family
 	 *       AF_INET  - IP version 4
@@ -66,6 +115,10 @@ public:
 	 *       IPPROTO_TCP    - Streaming TCP
 	 *       IPPROTO_UDP    - Datagram UDP
 	 *       IPPROTO_SCTP   - Association SCTP
+	 *       0              - AF_LOCAL, any type
+	 *
+	 *    maxthreads: threads that serve the Connection, see EventLoopGroup.
+	 *       Also the initial listen() backlog.
 	 *
 	 *  Connection is passed values for the underlying socket call.
 	 *                  |   AF_INET   |   AF_INET6  |   AF_LOCAL  |   AF_ROUTE  |    AF_KEY   |
@@ -75,27 +128,76 @@ public:
 	 *   SOCK_SEQPACKET |     SCTP    |     SCTP    |  SUPPORTED  |  NOT VALID  |  NOT VALID  |
 	 *   SOCK_RAW       |     IPv4    |     IPv6    |  NOT VALID  |  SUPPORTED  |  SUPPORTED  |
 	 *
+	 *  AF_LOCAL Connections are addressed with setLocalPath(), or with
+	 *  resolveHost() where the host is the path and a leading '@' names the
+	 *  abstract namespace.  They skip the TCP/IP stack entirely, which makes
+	 *  them the fastest transport between processes on one host.  A stream
+	 *  or seqpacket AF_LOCAL Connection works with EventLoop like TCP.
 	 */
 	Connection(sa_family_t fam, int t, int p, int maxtheads, std::string loginstance);
 	virtual ~Connection();
 
+	/* resolveHost() resolves host and service with getaddrinfo() on the
+	 *               calling thread and takes the first address.  The wide
+	 *               overload converts through the current locale and accepts
+	 *               internationalized domain names.  Servers should resolve
+	 *               with a Resolver and use setAddress() instead.
+	 */
 	int resolveHost(std::string host, std::string service);
 	int resolveHost(std::wstring host, std::wstring service);
 	void setAddress(std::string a);
 	void setAddress(uint32_t a);
+
+	/* setAddress() takes an already resolved address, e.g. from a Resolver.
+	 *              Throws std::invalid_argument if its family is not the
+	 *              Connection's.
+	 */
+	void setAddress(const kcmsg::addr_storage &a);
+
+	/* setLocalPath() addresses an AF_LOCAL Connection.  With 'abstract' the
+	 *                name lives in the abstract namespace: no file is made
+	 *                and it disappears with its last socket.  A listener
+	 *                bound to a path must remove the file itself; bind()
+	 *                fails while it exists.  Throws std::invalid_argument if
+	 *                the Connection is not AF_LOCAL or the path too long.
+	 */
+	void setLocalPath(const std::string &path, bool abstract = false);
 	void setService(std::string p);
 	void setService(uint16_t p);
 	void setListenerQueueSize(uint32_t s);
+
+	/* setReusePort() lets several Connections bind the same address, with
+	 *                the kernel spreading new connections over them.  Call
+	 *                before Bind().
+	 * setReusePortSteering() attaches a classic BPF program to the reuse
+	 *                group that picks listener (cpu % shards), counted in
+	 *                bind order, so the listener serving the CPU that took the
+	 *                connection accepts it.  Call on any member after Bind().
+	 */
+	void setReusePort(bool on);
+	void setReusePortSteering(uint32_t shards);
+
+	/* setProfile() sets the socket options applied before Bind() and
+	 *              Connect() and to every accepted socket, whether by
+	 *              Accept() or by an EventLoop serving this listener.
+	 * applyProfile() applies them to 'fd'; returns the number refused.
+	 */
+	void setProfile(const kcmsg::SocketProfile &p);
+	const kcmsg::SocketProfile &getProfile(void);
+	int applyProfile(int fd);
 	bool isValidateAddress(std::string a);
 	bool isValidatePort(std::string p);
 	bool isValidatePort(int p);
 	int getDescriptor(void);
+	int getMaxThreads(void);
+	std::vector<connection_storage> &getClients(void);
 
-    /* Accept()
-     *
+    /* Accept() accepts one pending connection on a listening Connection.
+     *          Returns false if accept() failed; errno holds the reason.
 	 *
 	 * Each successful Accept adds a connection_storage to the end of the
-	 * vector of clients.
+	 * vector of clients.  Servers with many clients should hand the
+	 * listening Connection to an EventLoop instead.
      */
 	bool Accept(void);
 
@@ -135,6 +237,29 @@ public:
 	 */
 	void Connect(void);
 
+	/* Connect(timeout) connects without waiting longer than 'timeout' ms.
+	 *              Throws std::ios_base::failure when the deadline passes,
+	 *              with errno ETIMEDOUT, or the connection is refused.
+	 *              The descriptor is then replaced by a fresh socket, so
+	 *              the Connection can try again; its options are applied
+	 *              again by the next Connect().
+	 *
+	 * ConnectAny() races the addresses of a host, e.g. everything a
+	 *              Resolver returned for AF_UNSPEC, as RFC 8305 "happy
+	 *              eyeballs" does.  The list is reordered to alternate
+	 *              address families, starting with the family of the first
+	 *              address, and a new attempt starts every 'delay' ms, or
+	 *              at once when an attempt fails, while the earlier ones
+	 *              keep going.  The first to connect wins and the rest are
+	 *              closed, so an unreachable family costs one delay rather
+	 *              than a full TCP timeout.  The Connection takes the
+	 *              winning socket, with its family and address, in place of
+	 *              its own.  Throws std::ios_base::failure, with errno from
+	 *              the last failed attempt, if none connects in 'timeout' ms.
+	 */
+	void Connect(int timeout);
+	void ConnectAny(const std::vector<addr_storage> &addrs, int timeout, int delay = CONNECTION_ATTEMPT_DELAY);
+
 	/* Listen() converts an unconnected Connection into a passive listening socket.
 	 *          The application may want to set the listen_max member variable prior to
 	 *          calling Listen().  On creation of a Connection(), the default value is
@@ -159,9 +284,174 @@ public:
 	void Shutdown(int sockfd, int howto);
 
 	size_t Readn(char *msg, size_t nbytes);
+
+	/* ReadMessage() reads the next frame into 'msg', blocking until a whole
+	 *               frame has arrived.  Returns the frame length, 0 on orderly
+	 *               shutdown, or -1 on error; errno is EMSGSIZE if the frame
+	 *               is longer than 'nbytes' and EPROTO if framing was lost.
+	 * ReadFrames() does one read and passes every complete frame it yields
+	 *               to 'cb' as a view into the receive buffer, valid during
+	 *               the call only.  Returns the number of frames, or -1 on
+	 *               error or orderly shutdown (errno 0).
+	 *
+	 * Both read as much as the socket holds into the Connection's
+	 * ReceiveBuffer, so several frames arriving together cost one read.
+	 * Bytes read ahead are kept for the next call; do not mix them with
+	 * Readn() on the same Connection.  getBuffered() returns how many
+	 * there are.
+	 */
 	size_t ReadMessage(kcmsg::Message *msg, size_t nbytes);
+	size_t ReadFrames(FrameCallback cb);
+	size_t getBuffered(void);
 	size_t Writen(char *msg, size_t nbytes);
 	size_t WriteMessage(kcmsg::Message *msg);
+
+	/* QueueMessage() adds a message to the outbound lane for its priority
+	 *                class without writing it.  Returns false, with errno
+	 *                EWOULDBLOCK and nothing queued, while the queue is over
+	 *                its high watermark or the peer has granted no credit;
+	 *                WriteMessage() then returns -1.  Control messages are
+	 *                always taken.
+	 * Flush() writes queued frames, most urgent first, until the queue is
+	 *         empty or the socket would block, gathering many frames into
+	 *         each writev().  Returns the number of bytes written or -1 on
+	 *         error.
+	 *
+	 * WriteMessage() is QueueMessage() followed by Flush(), so a message
+	 * written while bulk data is still queued goes out in priority order.
+	 */
+	bool QueueMessage(kcmsg::Message *msg);
+	size_t Flush(void);
+
+	/* setWatermarks() sets the high and low marks of the outbound queue in
+	 *              bytes and frames, see OutboundQueue.  A producer that
+	 *              queues faster than the socket drains is refused from
+	 *              the high marks until Flush() gets down to the low ones.
+	 * isWritable() is true when QueueMessage() would take a message.
+	 */
+	void setWatermarks(size_t highbytes, size_t lowbytes, size_t highframes = 0, size_t lowframes = 0);
+	bool isWritable(void);
+
+	/* Credit based flow control lets the receiver pace the sender.  With
+	 * setCreditFlow() on, every message other than a control message uses
+	 * one credit and none is queued without one; the receiver hands out
+	 * more with MSG_CONTROL_CREDIT messages as it gets through its work,
+	 * e.g. with GrantCredit() or EventLoop::setCreditWindow().  Credit
+	 * frames are taken out of the stream by ReadMessage() and ReadFrames(),
+	 * so a sender must keep reading for its credit to arrive.
+	 *
+	 * setCreditFlow() turns it on with 'initial' credits, e.g. what the
+	 *              protocol lets a sender assume before the first grant,
+	 *              and asks the peer for credit with a grant of 0, which
+	 *              an EventLoop answers with its window.  Call it once
+	 *              connected.
+	 * GrantCredit() lets the peer send 'n' more messages.  Returns the
+	 *              bytes written or -1.
+	 * AwaitCredit() reads until there is credit, passing the other frames
+	 *              that arrive to 'cb', for at most 'timeout' ms.  Returns
+	 *              false with errno ETIMEDOUT if none came, or on error.
+	 */
+	void setCreditFlow(bool on, uint32_t initial = 0);
+	uint32_t getCredit(void);
+	size_t GrantCredit(uint32_t n);
+	bool AwaitCredit(int timeout, FrameCallback cb);
+
+	/* setOnceAndOnlyOnce() makes the Connection honour
+	 *              MSG_FLAG_ONCE_AND_ONLY_ONCE both ways.  Messages written
+	 *              with the flag set are numbered and kept in a
+	 *              RetransmitQueue of 'capacity' messages until the peer
+	 *              acknowledges them; QueueMessage() refuses them with
+	 *              errno ENOBUFS while it is full.  Without it they are
+	 *              refused with errno EINVAL, since a receiver could not
+	 *              tell them apart.  Flush() resends those
+	 *              whose ack is overdue.  Flagged messages read are
+	 *              acknowledged and screened by a DeduplicationWindow, so
+	 *              a resent copy is not delivered twice.  Acks are taken out
+	 *              of the stream like credit frames.
+	 * Retransmit() resends the overdue messages now, for a sender that has
+	 *              nothing else to write.  Returns the number resent or -1.
+	 */
+	void setOnceAndOnlyOnce(bool on, size_t capacity = RETRANSMIT_CAPACITY);
+	size_t Retransmit(void);
+
+	/* setZeroCopy() makes WriteFrame() send frames of at least 'threshold'
+	 *               bytes with MSG_ZEROCOPY once the queue ahead of them is
+	 *               flushed; see ZeroCopySender.  Close() waits for the
+	 *               kernel to release the buffers still in flight.  Throws
+	 *               std::logic_error if the Connection is not a stream.
+	 * getZeroCopy() returns the sender for its counters, or nullptr.
+	 * getFrameBuffer() returns a buffer of 'length' bytes to encode a frame
+	 *               in, from the sender's free list when zero copy is on.
+	 * WriteFrame() writes one encoded frame built in such a buffer and
+	 *               takes the buffer.  It is admitted like WriteMessage()
+	 *               admits a message, but a once-and-only-once frame is
+	 *               refused with errno EINVAL since it cannot be numbered;
+	 *               use WriteMessage() for those.  Returns the frame length
+	 *               or -1.
+	 *
+	 * WriteMessage() never sends zero copy: the frame lives in the Message,
+	 * which the caller may change as soon as the call returns, and copying
+	 * it out first costs what the kernel's copy does.
+	 */
+	void setZeroCopy(bool on, size_t threshold = ZEROCOPY_THRESHOLD);
+	kcmsg::ZeroCopySender *getZeroCopy(void);
+	std::vector<char> getFrameBuffer(size_t length);
+	size_t WriteFrame(std::vector<char> &&frame);
+
+	/* SendBatch() sends up to 'count' messages on a datagram Connection, one
+	 *             message per datagram, with as few system calls as the
+	 *             kernel allows.  'peers' holds a destination per message or
+	 *             is nullptr after Connect().  Returns the number of messages
+	 *             sent or -1 on error.
+	 * RecvBatch() receives up to 'count' messages, blocking for the first
+	 *             unless 'flags' has MSG_DONTWAIT, and stores each source
+	 *             address in 'peers' if not nullptr.  Returns the number of
+	 *             messages or -1 on error.
+	 *
+	 * Both use sendmmsg()/recvmmsg() and UDP segmentation and receive
+	 * offload where available; see DatagramBatch.
+	 */
+	int SendBatch(kcmsg::Message **msgs, int count, const addr_storage *peers);
+	int RecvBatch(kcmsg::Message **msgs, int count, addr_storage *peers, int flags);
+
+	/* SendDescriptors() passes 'nfds' open descriptors to the peer of an
+	 *             AF_LOCAL socket with SCM_RIGHTS, together with 'length'
+	 *             bytes of data (a single 0 byte if none is given, since a
+	 *             control message needs data to ride on).  Returns the
+	 *             bytes sent, counting that one, or -1 on error.
+	 * RecvDescriptors() receives data and up to 'nfds' descriptors into
+	 *             'fds' and sets 'nfds' to the number received.  They are
+	 *             opened close-on-exec and belong to the caller.  Returns
+	 *             the bytes received, 0 on orderly shutdown, or -1 on
+	 *             error; errno is EMSGSIZE if descriptors were dropped for
+	 *             lack of room, after the ones that fit are returned.
+	 */
+	ssize_t SendDescriptors(int sockfd, const int *fds, size_t nfds, const char *data, size_t length);
+	ssize_t RecvDescriptors(int sockfd, int *fds, size_t &nfds, char *data, size_t length);
+
+	/* setStreams() asks for 'n' SCTP streams each way, before Bind() or
+	 *              Connect(), and sets how SendMessage() maps messages onto
+	 *              them.  Each stream is ordered on its own, so a lost
+	 *              packet only holds up the messages behind it on the same
+	 *              stream.  After Connect() the count drops to what the
+	 *              peer granted.  Throws std::logic_error if the Connection
+	 *              is not SCTP.
+	 * streamFor() is the stream SendMessage() would use for 'msg'.
+	 * SendMessage() sends one message on its stream.  Control messages and
+	 *              quick death messages go unordered: acknowledgements and
+	 *              pings need no order and a quick death message is worth
+	 *              most when it is not queued behind older ones.  'peer' is
+	 *              the association's address on a one-to-many socket, or
+	 *              nullptr.  Returns the message length or -1 on error.
+	 * RecvMessage() receives the next message, with its stream and source
+	 *              if asked for.  Association notifications are skipped.
+	 *              Returns the message length, 0 on shutdown, or -1 on
+	 *              error; errno is EMSGSIZE if the message did not fit.
+	 */
+	void setStreams(uint16_t n, int map = STREAM_MAP_APPLICATION);
+	uint16_t streamFor(kcmsg::Message *msg);
+	size_t SendMessage(kcmsg::Message *msg, const addr_storage *peer = nullptr);
+	size_t RecvMessage(kcmsg::Message *msg, uint16_t *stream = nullptr, addr_storage *peer = nullptr);
 };
 
 } /* namespace kcmsg */
@@ -0,0 +1,439 @@
+/*
+ * ConnectionPool.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#include "ConnectionPool.h"
+
+#include <stdexcept>
+#include <ios>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <cerrno>
+#include <ctime>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+namespace kcmsg {
+
+ConnectionPool::ConnectionPool(sa_family_t fam, size_t perpeer, uint32_t pinginterval)
+{
+	family = fam;
+	per_peer = ( perpeer > 0 ) ? perpeer : 1;
+	ping_interval = pinginterval;
+	ping_timeout = POOL_PING_TIMEOUT;
+	idle_timeout = POOL_IDLE_TIMEOUT;
+	stopping = false;
+
+	if ( ping_interval > 0 )
+		checker = std::thread( &ConnectionPool::checkerMain, this );
+}
+
+ConnectionPool::~ConnectionPool()
+{
+	{
+		std::lock_guard<std::mutex> guard( lock );
+		stopping = true;
+		wake.notify_one();
+	}
+	if ( checker.joinable() )
+		checker.join();
+
+	closeIdle();
+}
+
+void ConnectionPool::setPingTimeout(uint32_t ms)
+{
+	ping_timeout = ms;
+}
+
+void ConnectionPool::setIdleTimeout(uint32_t ms)
+{
+	idle_timeout = ms;
+}
+
+ConnectionPool::Lease ConnectionPool::acquire(const std::string &host, const std::string &service, uint32_t wait)
+{
+	std::unique_lock<std::mutex> guard( lock );
+
+	std::unique_ptr<Peer> &slot = peers[host + " " + service];
+	if ( !slot )
+	{
+		slot.reset( new Peer() );
+		slot->host = host;
+		slot->service = service;
+		slot->open = 0;
+	}
+	Peer &peer = *slot;
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( wait );
+
+	for (;;)
+	{
+		while ( !peer.idle.empty() )
+		{
+			kcmsg::Connection *conn = peer.idle.back().conn.release();
+			peer.idle.pop_back();
+
+			if ( alive( conn ) )
+				return ( Lease( this, &peer, conn ) );
+
+			destroy( conn );
+			peer.open--;
+		}
+
+		if ( peer.open < per_peer )
+		{
+			peer.open++;
+			guard.unlock();
+
+			try
+			{
+				return ( Lease( this, &peer, open( peer, deadline ) ) );
+			}
+			catch ( ... )
+			{
+				guard.lock();
+				peer.open--;
+				peer.freed.notify_one();
+				throw;
+			}
+		}
+
+		if ( peer.freed.wait_until( guard, deadline ) == std::cv_status::timeout )
+			throw std::ios_base::failure( "No pooled connection available" );
+	}
+}
+
+size_t ConnectionPool::checkIdle(void)
+{
+	std::vector<std::pair<Peer *, Idle>> due;
+	size_t closed = 0;
+	uint64_t t = now();
+
+	{
+		std::lock_guard<std::mutex> guard( lock );
+
+		for ( auto &p : peers )
+		{
+			Peer &peer = *p.second;
+			for ( auto it = peer.idle.begin(); it != peer.idle.end(); )
+			{
+				if ( t - it->since >= idle_timeout )
+				{
+					destroy( it->conn.release() );
+					peer.open--;
+					closed++;
+					peer.freed.notify_one();
+					it = peer.idle.erase( it );
+				}
+				else if ( t - it->checked >= ping_interval )
+				{
+					due.push_back( std::make_pair( &peer, std::move( *it ) ) );
+					it = peer.idle.erase( it );
+				}
+				else
+					++it;
+			}
+		}
+	}
+
+	// ping outside the lock, the connections still count against their cap
+	for ( auto &d : due )
+	{
+		bool ok = ping( d.second.conn.get() );
+
+		std::lock_guard<std::mutex> guard( lock );
+		Peer &peer = *d.first;
+
+		if ( ok )
+		{
+			d.second.checked = now();
+			peer.idle.push_front( std::move( d.second ) );		// oldest end, it was idle longest
+		}
+		else
+		{
+			destroy( d.second.conn.release() );
+			peer.open--;
+			closed++;
+		}
+		peer.freed.notify_one();
+	}
+
+	return ( closed );
+}
+
+void ConnectionPool::closeIdle(void)
+{
+	std::lock_guard<std::mutex> guard( lock );
+
+	for ( auto &p : peers )
+	{
+		Peer &peer = *p.second;
+		for ( auto &i : peer.idle )
+		{
+			destroy( i.conn.release() );
+			peer.open--;
+		}
+		peer.idle.clear();
+		peer.freed.notify_all();
+	}
+}
+
+size_t ConnectionPool::idleCount(void)
+{
+	std::lock_guard<std::mutex> guard( lock );
+
+	size_t n = 0;
+	for ( auto &p : peers )
+		n += p.second->idle.size();
+	return ( n );
+}
+
+size_t ConnectionPool::openCount(void)
+{
+	std::lock_guard<std::mutex> guard( lock );
+
+	size_t n = 0;
+	for ( auto &p : peers )
+		n += p.second->open;
+	return ( n );
+}
+
+/* private methods */
+
+kcmsg::Connection *ConnectionPool::open(Peer &peer, std::chrono::steady_clock::time_point deadline)
+{
+	// the lookup may outlive a caller that gave up, so its result lives on the heap
+	struct Lookup
+	{
+		std::mutex lock;
+		std::condition_variable done;
+		bool finished;
+		int error;
+		std::vector<kcmsg::addr_storage> addrs;
+	};
+	std::shared_ptr<Lookup> l( new Lookup() );
+	l->finished = false;
+	l->error = 0;
+
+	resolver.resolve( peer.host, peer.service, family, SOCK_STREAM,
+			[l]( int error, const std::vector<kcmsg::addr_storage> &addrs )
+			{
+				std::lock_guard<std::mutex> guard( l->lock );
+				l->error = error;
+				l->addrs = addrs;
+				l->finished = true;
+				l->done.notify_one();
+			} );
+
+	{
+		std::unique_lock<std::mutex> guard( l->lock );
+		if ( !l->done.wait_until( guard, deadline, [&l]() { return ( l->finished ); } ) )
+		{
+			errno = ETIMEDOUT;
+			throw std::ios_base::failure( "Timed out resolving pooled connection" );
+		}
+		if ( l->error != 0 )
+			throw std::ios_base::failure( gai_strerror( l->error ) );
+	}
+
+	auto left = std::chrono::duration_cast<std::chrono::milliseconds>( deadline - std::chrono::steady_clock::now() );
+	if ( left.count() <= 0 )
+	{
+		errno = ETIMEDOUT;
+		throw std::ios_base::failure( "Timed out connecting pooled connection" );
+	}
+
+	std::unique_ptr<kcmsg::Connection> conn( new kcmsg::Connection( family, SOCK_STREAM, IPPROTO_TCP, 1, "kcmsg.pool" ) );
+
+	try
+	{
+		conn->ConnectAny( l->addrs, (int) left.count() );
+	}
+	catch ( ... )
+	{
+		conn->Close( conn->getDescriptor() );
+		throw;
+	}
+
+	return ( conn.release() );
+}
+
+void ConnectionPool::giveBack(Peer *peer, kcmsg::Connection *conn, bool healthy)
+{
+	std::lock_guard<std::mutex> guard( lock );
+
+	if ( healthy && !stopping )
+	{
+		uint64_t t = now();
+		Idle i;
+		i.conn.reset( conn );
+		i.since = i.checked = t;
+		peer->idle.push_back( std::move( i ) );
+	}
+	else
+	{
+		destroy( conn );
+		peer->open--;
+	}
+
+	peer->freed.notify_one();
+}
+
+void ConnectionPool::destroy(kcmsg::Connection *conn)
+{
+	conn->Close( conn->getDescriptor() );
+	delete conn;
+}
+
+bool ConnectionPool::alive(kcmsg::Connection *conn)
+{
+	// an idle connection has nothing to read: readable means closed or out of step
+	if ( conn->getBuffered() > 0 )
+		return ( false );
+
+	pollfd p = { conn->getDescriptor(), POLLIN, 0 };
+	int n = poll( &p, 1, 0 );
+
+	return ( n == 0 );
+}
+
+bool ConnectionPool::ping(kcmsg::Connection *conn)
+{
+	kcmsg::Message msg;
+	msg.setControl( true );
+	msg.setTransactionIdentifier( MSG_CONTROL_PING );
+
+	const char *frame = msg.serialize();
+	size_t length = msg.getMessageLength();
+	int fd = conn->getDescriptor();
+
+	// MSG_NOSIGNAL: the peer may well be gone, that must not raise SIGPIPE
+	for ( size_t off = 0; off < length; )
+	{
+		ssize_t n = ::send( fd, frame + off, length - off, MSG_NOSIGNAL );
+		if ( ( n < 0 ) && ( errno == EINTR ) )
+			continue;
+		if ( n <= 0 )
+			return ( false );
+		off += n;
+	}
+
+	pollfd p = { fd, POLLIN, 0 };
+	int n;
+	do
+	{
+		n = poll( &p, 1, ping_timeout );
+	} while ( ( n < 0 ) && ( errno == EINTR ) );
+
+	if ( ( n <= 0 ) || !( p.revents & POLLIN ) )
+		return ( false );
+
+	size_t got = conn->ReadMessage( &msg, MAX_MSG_DATA );
+	if ( ( got == 0 ) || ( got == (size_t) -1 ) )
+		return ( false );
+
+	return ( msg.isControl() && ( msg.getTransactionIdentifier() == MSG_CONTROL_PONG ) );
+}
+
+void ConnectionPool::checkerMain(void)
+{
+	std::unique_lock<std::mutex> guard( lock );
+
+	while ( !stopping )
+	{
+		// a quarter interval keeps a connection at most 1.25 intervals unchecked
+		wake.wait_for( guard, std::chrono::milliseconds( std::max( 1u, ping_interval / 4 ) ) );
+		if ( stopping )
+			break;
+
+		guard.unlock();
+		checkIdle();
+		guard.lock();
+	}
+}
+
+uint64_t ConnectionPool::now(void)
+{
+	timespec ts;
+	clock_gettime( CLOCK_MONOTONIC_COARSE, &ts );
+	return ( (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000 );
+}
+
+/* Lease */
+
+ConnectionPool::Lease::Lease()
+{
+	pool = nullptr;
+	peer = nullptr;
+	conn = nullptr;
+}
+
+ConnectionPool::Lease::Lease(ConnectionPool *p, Peer *pr, kcmsg::Connection *c)
+{
+	pool = p;
+	peer = pr;
+	conn = c;
+}
+
+ConnectionPool::Lease::Lease(Lease &&other)
+{
+	pool = other.pool;
+	peer = other.peer;
+	conn = other.conn;
+	other.conn = nullptr;
+}
+
+ConnectionPool::Lease &ConnectionPool::Lease::operator=(Lease &&other)
+{
+	if ( this != &other )
+	{
+		release();
+		pool = other.pool;
+		peer = other.peer;
+		conn = other.conn;
+		other.conn = nullptr;
+	}
+	return ( *this );
+}
+
+ConnectionPool::Lease::~Lease()
+{
+	release();
+}
+
+kcmsg::Connection *ConnectionPool::Lease::get(void)
+{
+	return ( conn );
+}
+
+kcmsg::Connection *ConnectionPool::Lease::operator->(void)
+{
+	return ( conn );
+}
+
+ConnectionPool::Lease::operator bool(void) const
+{
+	return ( conn != nullptr );
+}
+
+void ConnectionPool::Lease::release(void)
+{
+	if ( conn )
+		pool->giveBack( peer, conn, true );
+	conn = nullptr;
+}
+
+void ConnectionPool::Lease::discard(void)
+{
+	if ( conn )
+		pool->giveBack( peer, conn, false );
+	conn = nullptr;
+}
+
+} /* namespace kcmsg */
@@ -0,0 +1,162 @@
+/*
+ * ConnectionPool.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#ifndef CONNECTIONPOOL_H_
+#define CONNECTIONPOOL_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <deque>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "Connection.h"
+#include "Resolver.h"
+
+namespace kcmsg {
+
+const size_t POOL_DEFAULT_PER_PEER = 8;			// open connections per destination
+const uint32_t POOL_PING_INTERVAL = 30000;		// ms an idle connection goes unchecked
+const uint32_t POOL_PING_TIMEOUT = 1000;		// ms to wait for the MSG_CONTROL_PONG
+const uint32_t POOL_IDLE_TIMEOUT = 300000;		// ms before an idle connection is closed
+const uint32_t POOL_ACQUIRE_TIMEOUT = 5000;		// ms acquire() waits at the per peer cap
+
+/*
+ * ConnectionPool keeps connected stream Connections per destination and
+ * leases them out, so a request reuses a warm connection instead of paying
+ * for resolution and a handshake every time.
+ *
+ * acquire() hands out the most recently returned idle connection of the
+ * destination, which is the one most likely to still be alive, after a
+ * zero timeout poll() that catches a peer that has closed.  Only when none
+ * is idle does it connect a new one, and at most 'perpeer' connections are
+ * open to one destination, leased or idle; beyond that acquire() waits for
+ * one to come back.  New connections resolve through the pool's Resolver,
+ * so a name is looked up once per TTL rather than once per connect, and
+ * race the addresses found with Connection::ConnectAny().
+ *
+ * A checker thread pings every connection that has been idle for the ping
+ * interval with an MSG_CONTROL_PING and closes those that do not answer
+ * with MSG_CONTROL_PONG within the ping timeout, or that have been idle for
+ * longer than the idle timeout.  EventLoop answers pings itself.  A
+ * connection being checked is neither idle nor leased but still counts
+ * against the cap.
+ *
+ * Returning a connection with unread replies or a request half written
+ * would hand the next lessee a broken stream; discard() it instead.  All
+ * leases must end before the pool is destroyed.
+ */
+class ConnectionPool {
+private:
+	struct Idle
+	{
+		std::unique_ptr<kcmsg::Connection> conn;
+		uint64_t since;			// returned to the pool
+		uint64_t checked;		// last answered ping, or 'since'
+	};
+
+	struct Peer
+	{
+		std::string host;
+		std::string service;
+		std::deque<Idle> idle;	// most recently returned at the back
+		size_t open;			// idle, leased and being checked
+		std::condition_variable freed;
+	};
+
+	sa_family_t family;
+	size_t per_peer;
+	uint32_t ping_interval;
+	uint32_t ping_timeout;
+	uint32_t idle_timeout;
+
+	kcmsg::Resolver resolver;
+
+	std::mutex lock;
+	std::map<std::string, std::unique_ptr<Peer>> peers;
+	std::thread checker;
+	std::condition_variable wake;
+	bool stopping;
+
+	kcmsg::Connection *open(Peer &peer, std::chrono::steady_clock::time_point deadline);
+	void giveBack(Peer *peer, kcmsg::Connection *conn, bool healthy);
+	void destroy(kcmsg::Connection *conn);
+	bool alive(kcmsg::Connection *conn);
+	bool ping(kcmsg::Connection *conn);
+	void checkerMain(void);
+	static uint64_t now(void);
+
+public:
+	/* Lease is a connection on loan from the pool; it goes back when the
+	 * Lease is destroyed or released.
+	 */
+	class Lease {
+	private:
+		ConnectionPool *pool;
+		Peer *peer;
+		kcmsg::Connection *conn;
+
+		friend class ConnectionPool;
+		Lease(ConnectionPool *p, Peer *pr, kcmsg::Connection *c);
+
+	public:
+		Lease();
+		Lease(Lease &&other);
+		Lease &operator=(Lease &&other);
+		Lease(const Lease &) = delete;
+		Lease &operator=(const Lease &) = delete;
+		virtual ~Lease();
+
+		kcmsg::Connection *get(void);
+		kcmsg::Connection *operator->(void);
+		explicit operator bool(void) const;
+
+		/* release() returns the connection for reuse.
+		 * discard() closes it, e.g. after an error or a broken exchange.
+		 */
+		void release(void);
+		void discard(void);
+	};
+
+	/* fam is AF_INET or AF_INET6.  A ping interval of 0 disables the
+	 * checker thread; checkIdle() may then be called by the application.
+	 */
+	ConnectionPool(sa_family_t fam, size_t perpeer = POOL_DEFAULT_PER_PEER,
+			uint32_t pinginterval = POOL_PING_INTERVAL);
+	virtual ~ConnectionPool();
+
+	void setPingTimeout(uint32_t ms);
+	void setIdleTimeout(uint32_t ms);
+
+	/* acquire() leases a connection to host and service, connecting a new
+	 *           one if none is idle.  Throws std::ios_base::failure if the
+	 *           lookup or connect fails, or if no connection is leased
+	 *           within 'wait' ms, whether waiting at the cap, resolving or
+	 *           connecting.
+	 */
+	Lease acquire(const std::string &host, const std::string &service, uint32_t wait = POOL_ACQUIRE_TIMEOUT);
+
+	/* checkIdle() pings the idle connections that are due and closes the
+	 *             dead and expired ones.  Returns the number closed.
+	 */
+	size_t checkIdle(void);
+
+	/* closeIdle() closes every idle connection; leased ones are unaffected */
+	void closeIdle(void);
+
+	size_t idleCount(void);
+	size_t openCount(void);
+};
+
+} /* namespace kcmsg */
+
+#endif /* CONNECTIONPOOL_H_ */
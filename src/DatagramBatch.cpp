@@ -0,0 +1,227 @@
+/*
+ * DatagramBatch.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#include "DatagramBatch.h"
+#include "Connection.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+namespace kcmsg {
+
+DatagramBatch::DatagramBatch(int sockfd, int fam)
+{
+	fd = sockfd;
+	family = fam;
+	gso = gro = -1;
+
+	hdrs.resize( DATAGRAM_BATCH_MAX );
+	iovs.resize( DATAGRAM_BATCH_MAX * DATAGRAM_GSO_SEGMENTS );
+	control.resize( DATAGRAM_BATCH_MAX * controlSpace() );
+	groups.resize( DATAGRAM_BATCH_MAX );
+	names.resize( DATAGRAM_BATCH_MAX );
+}
+
+DatagramBatch::~DatagramBatch() {
+
+}
+
+int DatagramBatch::send(kcmsg::Message **msgs, int count, const kcmsg::addr_storage *peers)
+{
+	size_t limit = hasSegmentOffload() ? gsoLimit() : 0;
+	int nhdr = 0, niov = 0, i = 0;
+
+	while ( ( i < count ) && ( nhdr < DATAGRAM_BATCH_MAX ) )
+	{
+		mmsghdr &h = hdrs[nhdr];
+		memset( &h, 0, sizeof(h) );
+
+		size_t length = msgs[i]->getMessageLength();
+		size_t total = 0;
+		int j = i;
+
+		// a run of equal sized messages to one peer goes out as one offloaded send
+		do
+		{
+			iovs[niov + ( j - i )].iov_base = (void *) msgs[j]->serialize();
+			iovs[niov + ( j - i )].iov_len = length;
+			total += length;
+			j++;
+		} while ( ( j < count ) && ( length <= limit ) && ( j - i < DATAGRAM_GSO_SEGMENTS ) &&
+				( total + length <= DATAGRAM_GSO_BYTES ) &&
+				( msgs[j]->getMessageLength() == length ) &&
+				( !peers || ( ( peers[j].length == peers[i].length ) &&
+						( memcmp( peers[j].addr, peers[i].addr, peers[i].length ) == 0 ) ) ) );
+
+		h.msg_hdr.msg_iov = &iovs[niov];
+		h.msg_hdr.msg_iovlen = j - i;
+		if ( peers )
+		{
+			h.msg_hdr.msg_name = (void *) peers[i].addr;
+			h.msg_hdr.msg_namelen = peers[i].length;
+		}
+
+		if ( j - i > 1 )
+		{
+			h.msg_hdr.msg_control = &control[nhdr * controlSpace()];
+			h.msg_hdr.msg_controllen = CMSG_SPACE( sizeof(uint16_t) );
+
+			cmsghdr *cm = CMSG_FIRSTHDR( &h.msg_hdr );
+			cm->cmsg_level = SOL_UDP;
+			cm->cmsg_type = UDP_SEGMENT;
+			cm->cmsg_len = CMSG_LEN( sizeof(uint16_t) );
+			uint16_t seg = (uint16_t) length;
+			memcpy( CMSG_DATA( cm ), &seg, sizeof(seg) );
+		}
+
+		groups[nhdr++] = j - i;
+		niov += j - i;
+		i = j;
+	}
+
+	int n;
+	do
+	{
+		n = sendmmsg( fd, hdrs.data(), nhdr, 0 );
+	} while ( ( n < 0 ) && ( errno == EINTR ) );
+
+	if ( n < 0 )
+		return (-1);
+
+	int sent = 0;
+	for ( int k = 0; k < n; k++ )
+		sent += groups[k];
+
+	return ( sent );
+}
+
+int DatagramBatch::recv(kcmsg::Message **msgs, int count, kcmsg::addr_storage *peers, int flags)
+{
+	if ( segments.empty() )
+	{
+		hasReceiveOffload();
+		if ( slots.empty() )
+			slots.resize( DATAGRAM_BATCH_MAX * DATAGRAM_SLOT_SIZE );
+
+		int nslots = std::min( count, DATAGRAM_BATCH_MAX );
+		for ( int k = 0; k < nslots; k++ )
+		{
+			mmsghdr &h = hdrs[k];
+			memset( &h, 0, sizeof(h) );
+			iovs[k].iov_base = &slots[k * DATAGRAM_SLOT_SIZE];
+			iovs[k].iov_len = DATAGRAM_SLOT_SIZE;
+			h.msg_hdr.msg_iov = &iovs[k];
+			h.msg_hdr.msg_iovlen = 1;
+			h.msg_hdr.msg_name = &names[k];
+			h.msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+			h.msg_hdr.msg_control = &control[k * controlSpace()];
+			h.msg_hdr.msg_controllen = controlSpace();
+		}
+
+		int n;
+		do
+		{
+			n = recvmmsg( fd, hdrs.data(), nslots, flags | MSG_WAITFORONE, nullptr );
+		} while ( ( n < 0 ) && ( errno == EINTR ) );
+
+		if ( n < 0 )
+			return (-1);
+
+		for ( int k = 0; k < n; k++ )
+		{
+			size_t length = hdrs[k].msg_len;
+			size_t seg = length;
+
+			for ( cmsghdr *cm = CMSG_FIRSTHDR( &hdrs[k].msg_hdr ); cm != nullptr;
+					cm = CMSG_NXTHDR( &hdrs[k].msg_hdr, cm ) )
+			{
+				if ( ( cm->cmsg_level == SOL_UDP ) && ( cm->cmsg_type == UDP_GRO ) )
+				{
+					int gso_size;
+					memcpy( &gso_size, CMSG_DATA( cm ), sizeof(gso_size) );
+					if ( gso_size > 0 )
+						seg = gso_size;
+				}
+			}
+
+			// a coalesced train: every datagram is 'seg' long except perhaps the last
+			const char *base = &slots[k * DATAGRAM_SLOT_SIZE];
+			for ( size_t off = 0; off < length; off += seg )
+			{
+				Segment s = { base + off, std::min( seg, length - off ), k, hdrs[k].msg_hdr.msg_namelen };
+				segments.push_back( s );
+			}
+		}
+	}
+
+	int got = 0;
+	while ( ( got < count ) && !segments.empty() )
+	{
+		Segment s = segments.front();
+		segments.pop_front();
+
+		try
+		{
+			msgs[got]->deserialize( s.frame, s.length );
+		}
+		catch ( std::domain_error &e )
+		{
+			continue;	// not one of ours, or truncated
+		}
+
+		if ( peers )
+		{
+			peers[got].length = std::min( (size_t) s.namelen, sizeof(peers[got].addr) );
+			memcpy( peers[got].addr, &names[s.slot], peers[got].length );
+		}
+		got++;
+	}
+
+	return ( got );
+}
+
+bool DatagramBatch::hasSegmentOffload(void)
+{
+	if ( gso < 0 )
+	{
+		int val;
+		socklen_t len = sizeof(val);
+		gso = ( getsockopt( fd, SOL_UDP, UDP_SEGMENT, &val, &len ) == 0 ) ? 1 : 0;
+	}
+
+	return ( gso == 1 );
+}
+
+bool DatagramBatch::hasReceiveOffload(void)
+{
+	if ( gro < 0 )
+	{
+		int one = 1;
+		gro = ( setsockopt( fd, SOL_UDP, UDP_GRO, &one, sizeof(one) ) == 0 ) ? 1 : 0;
+	}
+
+	return ( gro == 1 );
+}
+
+/* private methods */
+
+size_t DatagramBatch::gsoLimit(void)
+{
+	// every segment has to fit the path MTU; assume Ethernet
+	return ( family == AF_INET6 ) ? 1500 - 40 - 8 : 1500 - 20 - 8;
+}
+
+size_t DatagramBatch::controlSpace(void)
+{
+	return ( CMSG_SPACE( sizeof(int) ) );
+}
+
+} /* namespace kcmsg */
@@ -0,0 +1,94 @@
+/*
+ * DatagramBatch.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#ifndef DATAGRAMBATCH_H_
+#define DATAGRAMBATCH_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "Message.h"
+
+namespace kcmsg {
+
+struct addr_storage;
+
+const int DATAGRAM_BATCH_MAX = 64;			// datagrams per sendmmsg()/recvmmsg() slot list
+const int DATAGRAM_GSO_SEGMENTS = 64;		// datagrams per offloaded send
+const size_t DATAGRAM_GSO_BYTES = 65000;	// payload per offloaded send
+const size_t DATAGRAM_SLOT_SIZE = 65536;	// receive buffer per slot, room for a GRO train
+
+/*
+ * DatagramBatch moves many message datagrams per system call on a UDP
+ * socket, one message per datagram.
+ *
+ * send() packs the messages into one sendmmsg().  Where the kernel offers
+ * UDP generic segmentation offload, a run of equal sized messages to the
+ * same peer becomes a single entry with a UDP_SEGMENT control message and
+ * the kernel, or the NIC, cuts it into datagrams.  Only messages that fit
+ * an Ethernet sized datagram are offloaded.
+ *
+ * recv() fills up to DATAGRAM_BATCH_MAX slots with one recvmmsg().  With
+ * UDP_GRO enabled the kernel may hand back a train of datagrams coalesced
+ * into one slot, split here again by the segment size it reports.  Messages
+ * beyond what the caller asked for are kept for the next call.
+ */
+class DatagramBatch {
+private:
+	struct Segment
+	{
+		const char *frame;
+		size_t length;
+		int slot;
+		socklen_t namelen;
+	};
+
+	int fd;
+	int family;
+	int gso;		// -1 unknown, 0 no, 1 yes
+	int gro;
+
+	std::vector<mmsghdr> hdrs;
+	std::vector<iovec> iovs;
+	std::vector<char> control;
+	std::vector<int> groups;				// messages carried by each send entry
+	std::vector<sockaddr_storage> names;
+	std::vector<char> slots;
+	std::deque<Segment> segments;			// received, not yet returned
+
+	size_t gsoLimit(void);
+	size_t controlSpace(void);
+
+public:
+	DatagramBatch(int sockfd, int fam);
+	virtual ~DatagramBatch();
+
+	/* send() sends up to 'count' messages.  'peers' holds one destination per
+	 *        message, or is nullptr on a connected socket.  Returns the number
+	 *        of messages sent, or -1 with errno set.
+	 */
+	int send(kcmsg::Message **msgs, int count, const kcmsg::addr_storage *peers);
+
+	/* recv() receives up to 'count' messages, blocking until at least one
+	 *        datagram is there unless 'flags' has MSG_DONTWAIT.  Each source
+	 *        address goes to 'peers' if not nullptr.  Datagrams that are not
+	 *        a valid frame are dropped.  Returns the number of messages, or
+	 *        -1 with errno set.
+	 */
+	int recv(kcmsg::Message **msgs, int count, kcmsg::addr_storage *peers, int flags);
+
+	bool hasSegmentOffload(void);
+	bool hasReceiveOffload(void);
+};
+
+} /* namespace kcmsg */
+
+#endif /* DATAGRAMBATCH_H_ */
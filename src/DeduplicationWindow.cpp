@@ -0,0 +1,346 @@
+/*
+ * DeduplicationWindow.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#include "DeduplicationWindow.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+namespace kcmsg {
+
+const uint64_t KEY_OCCUPIED = 1ULL << 63;
+const int BLOOM_HASHES = 3;
+const size_t BLOOM_BITS_PER_KEY = 8;
+
+static size_t nextPowerOfTwo(size_t v)
+{
+	size_t p = 1;
+	while ( p < v )
+		p <<= 1;
+	return p;
+}
+
+DeduplicationWindow::DeduplicationWindow(size_t capacity, uint32_t window, uint32_t horizon)
+{
+	if ( capacity < 2 )
+		throw std::invalid_argument( "deduplication capacity too small" );
+
+	generation_capacity = capacity / 2;
+	allocate( generation_capacity );
+
+	for ( int i = 0; i < 2; i++ )
+		generations[i].started = now();
+
+	current = 0;
+	this->horizon = horizon;
+	// a time rotation drops keys at least half a window old
+	half_window = std::max( (uint64_t) window * 1000 / 2, (uint64_t) horizon );
+	duplicates = 0;
+}
+
+DeduplicationWindow::~DeduplicationWindow() {
+
+}
+
+bool DeduplicationWindow::isDuplicate(kcmsg::Message *msg)
+{
+	if ( !msg->isOnceAndOnlyOnce() )
+		return ( false );
+
+	return isDuplicate( msg->getSourceOrganization(), msg->getSourceIdentifier(),
+			msg->getTransactionIdentifier(), msg->getSession(), msg->getSequence() );
+}
+
+bool DeduplicationWindow::isDuplicate(const char *frame, size_t length)
+{
+	uint16_t org;
+	uint32_t ident, session, seq;
+
+	// read straight from the frame, the receive path need not decode it
+	if ( !Message::sequenceOf( frame, length, session, seq ) || !Message::sourceOf( frame, length, org, ident ) )
+		return ( false );
+
+	return isDuplicate( org, ident, Message::transactionOf( frame, length ), session, seq );
+}
+
+bool DeduplicationWindow::isDuplicate(uint16_t org, uint32_t ident, uint16_t trans, uint32_t session, uint32_t seq)
+{
+	Key k;
+	k.hi = ( (uint64_t) org << 32 ) | ident;
+	k.lo = KEY_OCCUPIED | ( (uint64_t) trans << 32 ) | seq;
+	k.session = session;
+
+	uint64_t h = hashKey( k );
+	age( now() );
+
+	// a bloom miss proves the identifier is new, skip the table probe
+	if ( bloomMaybe( h ) && find( k, h ) )
+	{
+		duplicates++;
+		return ( true );
+	}
+
+	insert( k, h );
+	return ( false );
+}
+
+void DeduplicationWindow::acknowledge(kcmsg::Message *received, kcmsg::Message *ack)
+{
+	if ( !ack->isControl() )
+	{
+		ack->setControl( true );
+		ack->setTransactionIdentifier( MSG_CONTROL_ACK );
+		ack->setTargetOrganization( received->getSourceOrganization() );
+		ack->setTargetIdentifier( received->getSourceIdentifier() );
+		ack->setSourceOrganization( received->getTargetOrganization() );
+		ack->setSourceIdentifier( received->getTargetIdentifier() );
+	}
+
+	ack->putInt( (int32_t) received->getSession() );
+	ack->putInt( (int32_t) received->getSequence() );
+}
+
+void DeduplicationWindow::acknowledge(const char *frame, size_t length, kcmsg::Message *ack)
+{
+	uint16_t src_org, tgt_org;
+	uint32_t src_ident, tgt_ident, session, seq;
+
+	if ( !Message::sequenceOf( frame, length, session, seq ) )
+		return;
+
+	if ( !ack->isControl() )
+	{
+		Message::sourceOf( frame, length, src_org, src_ident );
+		Message::targetOf( frame, length, tgt_org, tgt_ident );
+		ack->setControl( true );
+		ack->setTransactionIdentifier( MSG_CONTROL_ACK );
+		ack->setTargetOrganization( src_org );
+		ack->setTargetIdentifier( src_ident );
+		ack->setSourceOrganization( tgt_org );
+		ack->setSourceIdentifier( tgt_ident );
+	}
+
+	ack->putInt( (int32_t) session );
+	ack->putInt( (int32_t) seq );
+}
+
+void DeduplicationWindow::expire(void)
+{
+	age( now() );
+}
+
+size_t DeduplicationWindow::getCapacity(void)
+{
+	return ( generation_capacity * 2 );
+}
+
+size_t DeduplicationWindow::size(void)
+{
+	return ( generations[0].keys.size() + generations[1].keys.size() );
+}
+
+uint64_t DeduplicationWindow::getDuplicateCount(void)
+{
+	return ( duplicates );
+}
+
+/* private methods */
+
+uint64_t DeduplicationWindow::hashKey(const Key &k)
+{
+	// 64 bit finalizer from MurmurHash3 over both halves of the key
+	uint64_t h = k.hi ^ ( k.lo * 0x9E3779B97F4A7C15ULL ) ^ ( (uint64_t) k.session << 17 );
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ULL;
+	h ^= h >> 33;
+	return ( h );
+}
+
+uint64_t DeduplicationWindow::now(void)
+{
+	timespec ts;
+	clock_gettime( CLOCK_MONOTONIC_COARSE, &ts );
+	return ( (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000 );
+}
+
+bool DeduplicationWindow::bloomMaybe(uint64_t h)
+{
+	uint64_t h1 = h & 0xFFFFFFFF;
+	uint64_t h2 = h >> 32;
+
+	for ( int g = 0; g < 2; g++ )
+	{
+		const uint64_t *bits = generations[g].bloom.data();
+		int i;
+		for ( i = 0; i < BLOOM_HASHES; i++ )
+		{
+			uint64_t b = ( h1 + i * h2 ) & bloom_mask;
+			if ( !( bits[b >> 6] & ( 1ULL << ( b & 63 ) ) ) )
+				break;
+		}
+		if ( i == BLOOM_HASHES )
+			return ( true );
+	}
+
+	return ( false );
+}
+
+void DeduplicationWindow::bloomAdd(Generation &g, uint64_t h)
+{
+	uint64_t h1 = h & 0xFFFFFFFF;
+	uint64_t h2 = h >> 32;
+
+	for ( int i = 0; i < BLOOM_HASHES; i++ )
+	{
+		uint64_t b = ( h1 + i * h2 ) & bloom_mask;
+		g.bloom[b >> 6] |= ( 1ULL << ( b & 63 ) );
+	}
+}
+
+bool DeduplicationWindow::find(const Key &k, uint64_t h)
+{
+	size_t i = h & table_mask;
+
+	while ( table[i].lo != 0 )
+	{
+		if ( ( table[i].hi == k.hi ) && ( table[i].lo == k.lo ) && ( table[i].session == k.session ) )
+			return ( true );
+		i = ( i + 1 ) & table_mask;
+	}
+
+	return ( false );
+}
+
+void DeduplicationWindow::insert(const Key &k, uint64_t h)
+{
+	size_t i = h & table_mask;
+
+	while ( table[i].lo != 0 )
+		i = ( i + 1 ) & table_mask;
+
+	table[i] = k;
+
+	Generation &g = generations[current];
+	g.keys.push_back( k );
+	bloomAdd( g, h );
+}
+
+void DeduplicationWindow::erase(const Key &k)
+{
+	size_t i = hashKey( k ) & table_mask;
+
+	while ( table[i].lo != 0 )
+	{
+		if ( ( table[i].hi == k.hi ) && ( table[i].lo == k.lo ) && ( table[i].session == k.session ) )
+			break;
+		i = ( i + 1 ) & table_mask;
+	}
+
+	if ( table[i].lo == 0 )
+		return;
+
+	// backward shift deletion keeps linear probing free of tombstones
+	size_t j = i;
+	for (;;)
+	{
+		j = ( j + 1 ) & table_mask;
+		if ( table[j].lo == 0 )
+			break;
+
+		size_t home = hashKey( table[j] ) & table_mask;
+		bool movable = ( i <= j ) ? ( ( home <= i ) || ( home > j ) )
+		                          : ( ( home <= i ) && ( home > j ) );
+		if ( movable )
+		{
+			table[i] = table[j];
+			i = j;
+		}
+	}
+
+	table[i].hi = table[i].lo = 0;
+	table[i].session = 0;
+}
+
+void DeduplicationWindow::allocate(size_t capacity)
+{
+	// keep the probe sequences short; the table is at most half full
+	table.assign( nextPowerOfTwo( capacity * 4 ), Key{0, 0, 0} );
+	table_mask = table.size() - 1;
+
+	size_t bloom_bits = nextPowerOfTwo( capacity * BLOOM_BITS_PER_KEY );
+	bloom_mask = bloom_bits - 1;
+
+	for ( int i = 0; i < 2; i++ )
+	{
+		generations[i].keys.reserve( capacity );
+		generations[i].bloom.assign( bloom_bits / 64 + 1, 0 );
+	}
+}
+
+void DeduplicationWindow::grow(void)
+{
+	generation_capacity *= 2;
+	allocate( generation_capacity );
+
+	for ( int g = 0; g < 2; g++ )
+	{
+		for ( auto &k : generations[g].keys )
+		{
+			uint64_t h = hashKey( k );
+			size_t i = h & table_mask;
+			while ( table[i].lo != 0 )
+				i = ( i + 1 ) & table_mask;
+			table[i] = k;
+			bloomAdd( generations[g], h );
+		}
+	}
+}
+
+void DeduplicationWindow::rotate(uint64_t t)
+{
+	int previous = current ^ 1;
+	Generation &g = generations[previous];
+
+	for ( auto &k : g.keys )
+		erase( k );
+
+	g.keys.clear();
+	std::memset( g.bloom.data(), 0, g.bloom.size() * sizeof(uint64_t) );
+	g.started = t;
+
+	current = previous;
+}
+
+void DeduplicationWindow::age(uint64_t t)
+{
+	Generation &g = generations[current];
+
+	if ( t - g.started >= 2 * half_window )
+	{
+		// idle for a whole window: everything either generation holds is
+		// too old, and a single rotation would keep the current one
+		rotate( t );
+		rotate( t );
+	}
+	else if ( t - g.started >= half_window )
+		rotate( t );
+	else if ( g.keys.size() >= generation_capacity )
+	{
+		// rotating drops the previous generation, whose newest key is as old
+		// as the current one; younger than the horizon it may still be resent
+		if ( t - g.started >= horizon )
+			rotate( t );
+		else
+			grow();
+	}
+}
+
+} /* namespace kcmsg */
@@ -0,0 +1,120 @@
+/*
+ * DeduplicationWindow.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#ifndef DEDUPLICATIONWINDOW_H_
+#define DEDUPLICATIONWINDOW_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "Message.h"
+#include "RetransmitQueue.h"
+
+namespace kcmsg {
+
+const size_t DEFAULT_DEDUP_CAPACITY = 1 << 20;	// remembered messages
+const uint32_t DEFAULT_DEDUP_WINDOW = 300;		// seconds
+const uint32_t DEFAULT_DEDUP_HORIZON = RETRANSMIT_TIMEOUT * RETRANSMIT_ATTEMPTS;	// ms a sender may resend for
+const size_t ACK_ENTRY_LENGTH = 10;			// bytes acknowledge() adds to an ack, two tagged ints
+
+/*
+ * DeduplicationWindow is the receive side of MSG_FLAG_ONCE_AND_ONLY_ONCE.
+ * A message is identified by (source_organization, source_ident,
+ * transaction_ident, session, sequence).  The session is the sender's
+ * RetransmitQueue, which numbers from 1 again when it is made anew, so a
+ * restarted sender is not mistaken for a replay of its predecessor.
+ *
+ * An identifier is remembered for at least the horizon, the time a sender
+ * keeps resending (RetransmitQueue timeout times attempts), and for at
+ * most 'window' seconds.  Between the two it is forgotten when 'capacity'
+ * newer identifiers have arrived or half to all of the window has passed.
+ * When more than capacity/2 identifiers arrive within the horizon the
+ * window doubles its capacity instead of forgetting any, so its memory
+ * follows the message rate times the horizon.
+ *
+ * Identifiers live in an open addressing (linear probing) hash set that is
+ * never more than half full.  The set is split into two generations; each
+ * generation has its own bloom filter so a message that was never seen is
+ * usually accepted without touching the hash table at all.  When the current
+ * generation is older than half the window, or fills up and is older than
+ * the horizon, the previous generation is dropped from the set and its
+ * bloom filter is cleared; when the current one is older than the whole
+ * window, both are.  A generation that fills up sooner grows the table.
+ */
+class DeduplicationWindow {
+private:
+	struct Key
+	{
+		uint64_t hi;	// source_organization << 32 | source_ident
+		uint64_t lo;	// occupied bit | transaction_ident << 32 | sequence
+		uint32_t session;
+	};
+
+	struct Generation
+	{
+		std::vector<Key> keys;
+		std::vector<uint64_t> bloom;
+		uint64_t started;
+	};
+
+	std::vector<Key> table;
+	size_t table_mask;
+	Generation generations[2];
+	int current;
+	size_t generation_capacity;
+	size_t bloom_mask;
+	uint64_t half_window;	// milliseconds, at least the horizon
+	uint64_t horizon;		// milliseconds
+	uint64_t duplicates;
+
+	static uint64_t hashKey(const Key &k);
+	static uint64_t now(void);
+
+	bool bloomMaybe(uint64_t h);
+	void bloomAdd(Generation &g, uint64_t h);
+	bool find(const Key &k, uint64_t h);
+	void insert(const Key &k, uint64_t h);
+	void erase(const Key &k);
+	void allocate(size_t capacity);
+	void grow(void);
+	void rotate(uint64_t t);
+	void age(uint64_t t);
+
+public:
+	/*  Parameters
+	 *    capacity: message identifiers remembered, grown if the horizon needs more
+	 *    window:   seconds an identifier is remembered at most
+	 *    horizon:  milliseconds an identifier is remembered at least
+	 */
+	DeduplicationWindow(size_t capacity, uint32_t window, uint32_t horizon = DEFAULT_DEDUP_HORIZON);
+	virtual ~DeduplicationWindow();
+
+	/* isDuplicate() records the message identifier and returns true when it
+	 *               was already seen inside the window.  Messages without
+	 *               MSG_FLAG_ONCE_AND_ONLY_ONCE are never duplicates.
+	 */
+	bool isDuplicate(kcmsg::Message *msg);
+	bool isDuplicate(const char *frame, size_t length);
+	bool isDuplicate(uint16_t org, uint32_t ident, uint16_t trans, uint32_t session, uint32_t seq);
+
+	/* acknowledge() appends the session and sequence number of 'received' to
+	 *               'ack' and addresses 'ack' back to the sender.  Several
+	 *               received messages from one sender may share a single ack.
+	 */
+	void acknowledge(kcmsg::Message *received, kcmsg::Message *ack);
+	void acknowledge(const char *frame, size_t length, kcmsg::Message *ack);
+
+	void expire(void);
+	size_t size(void);
+	size_t getCapacity(void);		// grows, see above
+	uint64_t getDuplicateCount(void);
+};
+
+} /* namespace kcmsg */
+
+#endif /* DEDUPLICATIONWINDOW_H_ */
@@ -0,0 +1,683 @@
+/*
+ * EventLoop.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#include "EventLoop.h"
+#include "UringEventLoop.h"
+#include "ReceiveBuffer.h"
+
+#include <stdexcept>
+#include <ios>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace kcmsg {
+
+const uint32_t CLIENT_EVENTS = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+
+static void setNonBlocking(int fd)
+{
+	int flags = fcntl( fd, F_GETFL, 0 );
+	if ( ( flags < 0 ) || ( fcntl( fd, F_SETFL, flags | O_NONBLOCK ) < 0 ) )
+		throw std::ios_base::failure( "Unable to set non-blocking mode" );
+}
+
+EventLoop::EventLoop() : EventLoop( EVENT_BACKEND_EPOLL )
+{
+
+}
+
+EventLoop::EventLoop(int be)
+{
+	backend = be;
+	running = false;
+	stop_requested = false;
+	client_count = 0;
+	syscalls = messages = 0;
+	epfd = -1;
+	credit_window = 0;
+	deferred_credit = false;
+	for ( int i = 0; i < 4; i++ )
+		watermarks[i] = 0;
+
+	if ( ( wakefd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ) < 0 )
+		throw std::ios_base::failure( "Unable to create eventfd" );
+	slot( wakefd ).kind = KIND_WAKEUP;
+
+	if ( backend != EVENT_BACKEND_EPOLL )
+		return;
+
+	readbuf.resize( EVENT_LOOP_READ_BUFFER );
+
+	if ( ( epfd = epoll_create1( EPOLL_CLOEXEC ) ) < 0 )
+	{
+		close( wakefd );
+		throw std::ios_base::failure( "Unable to create epoll instance" );
+	}
+
+	epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.fd = wakefd;
+	epoll_ctl( epfd, EPOLL_CTL_ADD, wakefd, &ev );
+}
+
+EventLoop::~EventLoop()
+{
+	for ( auto &c : slab )
+	{
+		if ( c && ( c->kind == KIND_CLIENT ) )
+			close( c->fd );
+	}
+
+	close( wakefd );
+	if ( epfd >= 0 )
+		close( epfd );
+}
+
+EventLoop *EventLoop::create(int be)
+{
+	switch ( be )
+	{
+	case EVENT_BACKEND_EPOLL :
+		return new EventLoop();
+	case EVENT_BACKEND_URING :
+		return new UringEventLoop();
+	default:
+		try
+		{
+			return new UringEventLoop();
+		}
+		catch ( std::exception &e )
+		{
+			return new EventLoop();	// old kernel or io_uring disabled
+		}
+	}
+}
+
+void EventLoop::setMessageCallback(MessageCallback cb)
+{
+	on_message = cb;
+}
+
+void EventLoop::setAcceptCallback(ClientCallback cb)
+{
+	on_accept = cb;
+}
+
+void EventLoop::setCloseCallback(ClientCallback cb)
+{
+	on_close = cb;
+}
+
+void EventLoop::setHandoffCallback(HandoffCallback cb)
+{
+	on_handoff = cb;
+}
+
+void EventLoop::setWatermarks(size_t highbytes, size_t lowbytes, size_t highframes, size_t lowframes)
+{
+	if ( ( highbytes && ( lowbytes > highbytes ) ) || ( highframes && ( lowframes > highframes ) ) )
+		throw std::invalid_argument( "low watermark above high watermark" );
+
+	watermarks[0] = highbytes;
+	watermarks[1] = lowbytes;
+	watermarks[2] = highframes;
+	watermarks[3] = lowframes;
+}
+
+bool EventLoop::writable(int fd)
+{
+	if ( ( fd < 0 ) || ( (size_t) fd >= slab.size() ) || !slab[fd] || ( slab[fd]->kind != KIND_CLIENT ) )
+		return ( false );
+
+	return ( !slab[fd]->outbound.overHighWatermark() );
+}
+
+void EventLoop::setWritableCallback(ClientCallback cb)
+{
+	on_writable = cb;
+}
+
+void EventLoop::setCreditWindow(uint32_t window)
+{
+	credit_window = window;
+}
+
+uint32_t EventLoop::getCreditWindow(void)
+{
+	return ( credit_window );
+}
+
+void EventLoop::setDeferredCredit(bool on)
+{
+	deferred_credit = on;
+}
+
+void EventLoop::handled(int fd, uint32_t n)
+{
+	if ( ( fd < 0 ) || ( (size_t) fd >= slab.size() ) || !slab[fd] || ( slab[fd]->kind != KIND_CLIENT ) )
+		return;
+
+	Client &c = *slab[fd];
+	if ( !c.credit_flow )
+		return;
+
+	c.credit_used += n;
+	if ( credit_window && ( c.credit_used >= std::max( credit_window / 2, 1u ) ) )
+	{
+		// handled: the client may send that many more
+		grantCredit( c, c.credit_used );
+		c.credit_used = 0;
+	}
+}
+
+void EventLoop::pauseReading(int fd)
+{
+	if ( ( fd >= 0 ) && ( (size_t) fd < slab.size() ) && slab[fd] && ( slab[fd]->kind == KIND_CLIENT ) )
+		slab[fd]->paused = true;
+}
+
+void EventLoop::resumeReading(int fd)
+{
+	if ( ( fd < 0 ) || ( (size_t) fd >= slab.size() ) || !slab[fd] || ( slab[fd]->kind != KIND_CLIENT ) ||
+			!slab[fd]->paused )
+		return;
+
+	Client &c = *slab[fd];
+	c.paused = false;
+
+	// edge triggered: the socket may have filled up while paused, so read it now
+	if ( deliverPartial( c ) )
+		handleRead( c );
+}
+
+void EventLoop::setDeduplication(size_t capacity, uint32_t window)
+{
+	if ( capacity == 0 )
+		dedup.reset();
+	else
+		dedup.reset( new kcmsg::DeduplicationWindow( capacity, window ) );
+}
+
+void EventLoop::addListener(kcmsg::Connection *listener)
+{
+	int fd = listener->getDescriptor();
+	setNonBlocking( fd );
+
+	// level triggered so an unfinished accept batch is picked up next time round
+	epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	if ( epoll_ctl( epfd, EPOLL_CTL_ADD, fd, &ev ) < 0 )
+		throw std::ios_base::failure( "Unable to watch listener" );
+
+	Client &c = slot( fd );
+	c.kind = KIND_LISTENER;
+	c.listener = listener;
+	c.fd = fd;
+}
+
+void EventLoop::addClient(int fd)
+{
+	setNonBlocking( fd );
+
+	if ( !registerClient( fd ) )
+		throw std::ios_base::failure( "Unable to watch client" );
+}
+
+bool EventLoop::send(int fd, kcmsg::Message *msg)
+{
+	const char *frame = msg->serialize();
+	return send( fd, frame, msg->getMessageLength(), msg->getPriority() );
+}
+
+bool EventLoop::send(int fd, const char *frame, size_t length, uint8_t priority)
+{
+	if ( ( fd < 0 ) || ( (size_t) fd >= slab.size() ) || !slab[fd] || ( slab[fd]->kind != KIND_CLIENT ) )
+		return ( false );
+
+	Client &c = *slab[fd];
+	c.outbound.push( frame, length, priority );
+
+	if ( !c.send_queued )
+	{
+		c.send_queued = true;
+		send_ready.push_back( &c );
+	}
+
+	return ( true );
+}
+
+void EventLoop::closeClient(int fd)
+{
+	if ( ( fd < 0 ) || ( (size_t) fd >= slab.size() ) || !slab[fd] || ( slab[fd]->kind != KIND_CLIENT ) )
+		return;
+
+	Client &c = *slab[fd];
+	unqueueSend( c );
+	epoll_ctl( epfd, EPOLL_CTL_DEL, fd, nullptr );
+
+	c.kind = KIND_NONE;
+	c.partial.clear();
+	c.partial.shrink_to_fit();
+	c.outbound.clear();
+	client_count--;
+
+	// while the descriptor is still held its number cannot be reused, so
+	// whatever the callback does for this client comes before any for the
+	// next connection another thread accepts on the same number
+	if ( on_close )
+		on_close( fd );
+	close( fd );
+}
+
+void EventLoop::run(void)
+{
+	running = true;
+	while ( running )
+	{
+		runOnce( -1 );
+		if ( stop_requested.exchange( false ) )
+			running = false;
+	}
+}
+
+int EventLoop::runOnce(int timeout)
+{
+	epoll_event events[EVENT_LOOP_MAX_EVENTS];
+	int n;
+
+	flushSends();
+
+	syscalls++;
+	if ( ( n = epoll_wait( epfd, events, EVENT_LOOP_MAX_EVENTS, timeout ) ) < 0 )
+	{
+		if ( errno == EINTR )
+			return ( 0 );
+		throw std::ios_base::failure( "epoll_wait() failed" );
+	}
+
+	for ( int i = 0; i < n; i++ )
+	{
+		int fd = events[i].data.fd;
+		uint32_t ev = events[i].events;
+
+		if ( ( (size_t) fd >= slab.size() ) || !slab[fd] )
+			continue;
+		Client &c = *slab[fd];
+
+		switch ( c.kind )
+		{
+		case KIND_LISTENER :
+			handleAccept( fd );
+			break;
+		case KIND_WAKEUP :
+		{
+			uint64_t count;
+			if ( read( wakefd, &count, sizeof(count) ) > 0 )
+				handleWakeup();
+			break;
+		}
+		case KIND_CLIENT :
+			if ( ev & ( EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR ) )
+				handleRead( c );
+			if ( ( c.kind == KIND_CLIENT ) && ( ev & EPOLLOUT ) )
+				handleWrite( c );
+			if ( ( c.kind == KIND_CLIENT ) && ( ev & ( EPOLLHUP | EPOLLERR ) ) )
+				closeClient( fd );
+			break;
+		default:
+			break;	// closed earlier in this batch
+		}
+	}
+
+	flushSends();
+	return ( n );
+}
+
+void EventLoop::stop(void)
+{
+	uint64_t one = 1;
+	stop_requested = true;
+
+	// 'running' belongs to the loop thread; a failed write means the
+	// counter is saturated and a wakeup is pending anyway, and run()
+	// checks stop_requested after every pass as well
+	if ( write( wakefd, &one, sizeof(one) ) < 0 )
+		return;
+}
+
+void EventLoop::post(Task task)
+{
+	bool idle;
+	{
+		std::lock_guard<std::mutex> guard( post_lock );
+		idle = posted.empty();
+		posted.push_back( std::move( task ) );
+	}
+
+	// one wakeup covers everything queued before the loop drains the list
+	uint64_t one = 1;
+	if ( idle && ( write( wakefd, &one, sizeof(one) ) < 0 ) )
+		throw std::ios_base::failure( "Unable to wake event loop" );
+}
+
+size_t EventLoop::clientCount(void)
+{
+	return ( client_count );
+}
+
+int EventLoop::getBackend(void)
+{
+	return ( backend );
+}
+
+uint64_t EventLoop::getSyscallCount(void)
+{
+	return ( syscalls );
+}
+
+uint64_t EventLoop::getMessageCount(void)
+{
+	return ( messages );
+}
+
+/* protected methods */
+
+EventLoop::Client &EventLoop::slot(int fd)
+{
+	if ( (size_t) fd >= slab.size() )
+		slab.resize( std::max( (size_t) fd + 1, slab.size() * 2 ) );
+
+	if ( !slab[fd] )
+	{
+		slab[fd].reset( new Client() );
+		slab[fd]->kind = KIND_NONE;
+		slab[fd]->fd = fd;
+		slab[fd]->pending = 0;
+		slab[fd]->recv_armed = slab[fd]->send_armed = slab[fd]->send_queued = false;
+		slab[fd]->listener = nullptr;
+		slab[fd]->credit_flow = false;
+		slab[fd]->credit_used = 0;
+		slab[fd]->paused = false;
+	}
+
+	return ( *slab[fd] );
+}
+
+bool EventLoop::registerClient(int fd)
+{
+	epoll_event ev;
+	ev.events = CLIENT_EVENTS;
+	ev.data.fd = fd;
+	if ( epoll_ctl( epfd, EPOLL_CTL_ADD, fd, &ev ) < 0 )
+		return ( false );
+
+	Client &c = slot( fd );
+	c.kind = KIND_CLIENT;
+	c.fd = fd;
+	c.partial.clear();
+	c.outbound.clear();
+	client_count++;
+	clientReady( c );
+	return ( true );
+}
+
+void EventLoop::clientReady(Client &c)
+{
+	c.outbound.setWatermarks( watermarks[0], watermarks[1], watermarks[2], watermarks[3] );
+	c.credit_flow = false;
+	c.credit_used = 0;
+	c.paused = false;
+}
+
+void EventLoop::checkWritable(Client &c)
+{
+	if ( c.outbound.resumed() && on_writable )
+		on_writable( c.fd );
+}
+
+void EventLoop::grantCredit(Client &c, uint32_t n)
+{
+	Message grant;
+	grant.setControl( true );
+	grant.setTransactionIdentifier( MSG_CONTROL_CREDIT );
+	grant.setPriority( MSG_PRIORITY_URGENT );
+	grant.putInt( (int32_t) n );
+	send( c.fd, &grant );
+}
+
+void EventLoop::handleAccept(int fd)
+{
+	for ( int i = 0; i < EVENT_LOOP_ACCEPT_BATCH; i++ )
+	{
+		syscalls++;
+		int cfd = accept4( fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC );
+		if ( cfd < 0 )
+		{
+			if ( errno == EINTR || errno == ECONNABORTED )
+				continue;
+			break;	// EAGAIN: backlog drained; EMFILE etc: retry on the next wakeup
+		}
+
+		slab[fd]->listener->applyProfile( cfd );
+		if ( on_handoff && on_handoff( fd, cfd ) )
+			continue;
+
+		if ( !registerClient( cfd ) )
+		{
+			close( cfd );
+			continue;
+		}
+
+		if ( on_accept )
+			on_accept( cfd );
+	}
+}
+
+void EventLoop::handleRead(Client &c)
+{
+	int fd = c.fd;
+	char *buf = readbuf.data();
+	size_t have = c.partial.size();
+
+	if ( have )
+		memcpy( buf, c.partial.data(), have );
+	c.partial.clear();
+
+	// edge triggered: keep reading until the socket is empty or reads pause
+	while ( !c.paused )
+	{
+		syscalls++;
+		ssize_t n = recv( fd, buf + have, readbuf.size() - have, 0 );
+
+		if ( n > 0 )
+		{
+			have += n;
+			size_t used = deliverFrames( fd, buf, have );
+			if ( ( used == (size_t) -1 ) || ( c.kind != KIND_CLIENT ) )
+				return;
+
+			have -= used;
+			if ( have && used )
+				memmove( buf, buf + used, have );
+			continue;
+		}
+
+		if ( ( n < 0 ) && ( errno == EINTR ) )
+			continue;
+		if ( ( n < 0 ) && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+			break;
+
+		closeClient( fd );	// orderly shutdown or error
+		return;
+	}
+
+	c.partial.assign( buf, buf + have );
+}
+
+void EventLoop::handleWrite(Client &c)
+{
+	if ( c.outbound.empty() )
+		return;
+
+	if ( c.outbound.writeTo( c.fd, &syscalls ) == (size_t) -1 )
+		closeClient( c.fd );
+	else
+		checkWritable( c );
+}
+
+void EventLoop::flushSends(void)
+{
+	std::vector<Client *> ready;
+	ready.swap( send_ready );
+
+	for ( Client *c : ready )
+	{
+		if ( !c->send_queued )
+			continue;	// closed by an earlier flush's close callback
+		c->send_queued = false;
+		handleWrite( *c );
+	}
+
+	// keep the capacity for the next iteration
+	ready.clear();
+	if ( send_ready.empty() )
+		send_ready.swap( ready );
+}
+
+void EventLoop::handleWakeup(void)
+{
+	std::vector<Task> tasks;
+	{
+		std::lock_guard<std::mutex> guard( post_lock );
+		tasks.swap( posted );
+	}
+
+	for ( auto &task : tasks )
+		task();
+
+	if ( stop_requested.exchange( false ) )
+		running = false;
+}
+
+void EventLoop::unqueueSend(Client &c)
+{
+	if ( !c.send_queued )
+		return;
+
+	auto it = std::find( send_ready.begin(), send_ready.end(), &c );
+	if ( it != send_ready.end() )
+		send_ready.erase( it );
+	c.send_queued = false;
+}
+
+size_t EventLoop::deliverFrames(int fd, const char *buf, size_t length)
+{
+	size_t off = 0;
+	std::unique_ptr<Message> ack;	// one ack covers the frames of a read
+
+	while ( !slab[fd]->paused )
+	{
+		size_t flen = ReceiveBuffer::frameLength( buf + off, length - off );
+
+		if ( flen == (size_t) -1 )
+		{
+			closeClient( fd );	// lost framing, nothing after this can be trusted
+			return (-1);
+		}
+		if ( flen == 0 )
+			break;
+
+		messages++;
+		uint16_t code = Message::controlCode( buf + off, flen );
+		if ( code == MSG_CONTROL_PING )
+		{
+			// answered here so a busy application cannot fail a health check
+			Message pong;
+			pong.setControl( true );
+			pong.setTransactionIdentifier( MSG_CONTROL_PONG );
+			pong.setPriority( MSG_PRIORITY_URGENT );
+			send( fd, &pong );
+		}
+		else if ( ( code == 0 ) && dedup && isResend( fd, buf + off, flen, ack ) )
+		{
+			// delivered before; acking it again stops the resends
+		}
+		else if ( code == MSG_CONTROL_CREDIT )
+		{
+			// the client's first credit frame asks for credit; it gets the
+			// window, and later grants as it is worked through
+			if ( !slab[fd]->credit_flow && ( slab[fd]->kind == KIND_CLIENT ) )
+			{
+				slab[fd]->credit_flow = true;
+				if ( credit_window )
+					grantCredit( *slab[fd], credit_window );
+			}
+		}
+		else
+		{
+			if ( on_message )
+				on_message( fd, buf + off, flen );
+			if ( credit_window && !deferred_credit && ( slab[fd]->kind == KIND_CLIENT ) && slab[fd]->credit_flow &&
+					( ++slab[fd]->credit_used >= std::max( credit_window / 2, 1u ) ) )
+			{
+				// handled: the client may send that many more
+				grantCredit( *slab[fd], slab[fd]->credit_used );
+				slab[fd]->credit_used = 0;
+			}
+		}
+		off += flen;
+
+		if ( slab[fd]->kind != KIND_CLIENT )
+			return (-1);		// the callback closed the client
+	}
+
+	if ( ack )
+		send( fd, ack.get() );
+	return ( off );
+}
+
+bool EventLoop::deliverPartial(Client &c)
+{
+	// delivered from a copy: a callback that closes the client frees 'partial'
+	std::vector<char> held;
+	held.swap( c.partial );
+	int fd = c.fd;
+
+	size_t used = held.empty() ? 0 : deliverFrames( fd, held.data(), held.size() );
+	if ( ( used == (size_t) -1 ) || ( slab[fd]->kind != KIND_CLIENT ) )
+		return ( false );
+
+	c.partial.assign( held.begin() + used, held.end() );
+	return ( true );
+}
+
+bool EventLoop::isResend(int fd, const char *frame, size_t length, std::unique_ptr<Message> &ack)
+{
+	uint32_t session, seq;
+	if ( !Message::sequenceOf( frame, length, session, seq ) )
+		return ( false );
+
+	if ( ack && ( ack->getMessageLength() + ACK_ENTRY_LENGTH > MAX_MSG_DATA ) )
+	{
+		send( fd, ack.get() );
+		ack.reset();
+	}
+	if ( !ack )
+		ack.reset( new Message() );
+
+	dedup->acknowledge( frame, length, ack.get() );
+	return ( dedup->isDuplicate( frame, length ) );
+}
+
+} /* namespace kcmsg */
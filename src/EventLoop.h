@@ -0,0 +1,258 @@
+/*
+ * EventLoop.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#ifndef EVENTLOOP_H_
+#define EVENTLOOP_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <atomic>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "Connection.h"
+#include "Message.h"
+#include "OutboundQueue.h"
+#include "DeduplicationWindow.h"
+
+namespace kcmsg {
+
+const int EVENT_LOOP_MAX_EVENTS = 256;	// events per epoll_wait()
+const int EVENT_LOOP_ACCEPT_BATCH = 64;	// accepts per listener wakeup
+const size_t EVENT_LOOP_READ_BUFFER = 256 * 1024;
+
+/* I/O backends for EventLoop::create() */
+const int EVENT_BACKEND_AUTO = 0;		// io_uring when the kernel supports it, else epoll
+const int EVENT_BACKEND_EPOLL = 1;
+const int EVENT_BACKEND_URING = 2;
+
+/*
+ * EventLoop is a single threaded, edge triggered epoll reactor.  It owns
+ * listening sockets and the client sockets accepted from them, and hands
+ * every complete message frame to the message callback.
+ *
+ * Per descriptor state lives in a slab indexed by the descriptor number, so
+ * finding a client is an array index.  Listeners are level triggered and
+ * accept at most EVENT_LOOP_ACCEPT_BATCH connections per wakeup with
+ * accept4(SOCK_NONBLOCK | SOCK_CLOEXEC), so a reconnect storm cannot starve
+ * established clients.  Clients are edge triggered for both directions:
+ * reads drain the socket into one loop wide buffer, complete frames are
+ * delivered from it without copying, and only a trailing partial frame is
+ * kept per client.  send() only queues: every client with queued frames is
+ * flushed once per loop iteration, after the events are handled, so the
+ * replies to a whole batch of messages leave in one writev().  Writes that
+ * would block resume when the socket becomes writable again.  A
+ * MSG_CONTROL_PING frame is answered with MSG_CONTROL_PONG by the loop and
+ * never reaches the message callback.  With setDeduplication() the loop
+ * acknowledges once-and-only-once messages and drops the copies a client
+ * resends.  Watermarks and a credit window
+ * bound what a slow peer or a slow application can pile up; see
+ * setWatermarks() and setCreditWindow().
+ *
+ * Apart from stop() and post(), every method must be called on the loop's
+ * thread or before run() starts.  Other threads hand work to the loop with
+ * post(); see EventLoopGroup.
+ *
+ * EventLoop itself is the epoll backend.  create() picks a backend at run
+ * time and falls back to epoll when io_uring is unavailable; see
+ * UringEventLoop.
+ */
+class EventLoop {
+public:
+	typedef std::function<void(int fd, const char *frame, size_t length)> MessageCallback;
+	typedef std::function<void(int fd)> ClientCallback;
+	typedef std::function<bool(int listener, int fd)> HandoffCallback;
+	typedef std::function<void(void)> Task;
+
+protected:
+	enum DescriptorKind { KIND_NONE, KIND_LISTENER, KIND_CLIENT, KIND_WAKEUP };
+
+	struct Client
+	{
+		DescriptorKind kind;
+		int fd;
+		std::vector<char> partial;		// unfinished frame carried between reads
+		kcmsg::OutboundQueue outbound;
+		uint32_t pending;				// io_uring operations in flight
+		bool recv_armed;
+		bool send_armed;
+		bool send_queued;
+		std::vector<iovec> send_iov;	// gather list of the io_uring send in flight
+		msghdr send_hdr;
+		kcmsg::Connection *listener;	// KIND_LISTENER: tunes the sockets accepted
+		bool credit_flow;				// asked for credit, see setCreditWindow()
+		uint32_t credit_used;			// messages handled since the last grant
+		bool paused;					// pauseReading(): deliver nothing, read nothing
+	};
+
+	int backend;
+	int epfd;
+	int wakefd;
+	bool running;
+	size_t client_count;
+	uint64_t syscalls;
+	uint64_t messages;
+	std::vector<std::unique_ptr<Client>> slab;
+	std::vector<Client *> send_ready;		// clients with frames queued by send()
+	std::vector<char> readbuf;
+
+	MessageCallback on_message;
+	ClientCallback on_accept;
+	ClientCallback on_close;
+	HandoffCallback on_handoff;
+	ClientCallback on_writable;
+
+	size_t watermarks[4];				// high/low bytes, high/low frames for new clients
+	uint32_t credit_window;
+	bool deferred_credit;				// handled() counts messages, not the callback
+	std::unique_ptr<kcmsg::DeduplicationWindow> dedup;	// made by setDeduplication()
+	std::vector<std::unique_ptr<kcmsg::Message>> ack_pool;	// ack buffers for deliverFrames() to reuse
+
+	std::mutex post_lock;
+	std::vector<Task> posted;			// tasks from other threads
+	std::atomic<bool> stop_requested;
+
+	EventLoop(int be);
+
+	Client &slot(int fd);
+	virtual bool registerClient(int fd);
+	void clientReady(Client &c);
+	void checkWritable(Client &c);
+	void grantCredit(Client &c, uint32_t n);
+	void handleAccept(int fd);
+	void handleRead(Client &c);
+	void handleWrite(Client &c);
+	virtual void flushSends(void);
+	void unqueueSend(Client &c);
+	void handleWakeup(void);
+	size_t deliverFrames(int fd, const char *buf, size_t length);
+	bool deliverPartial(Client &c);
+	bool isResend(int fd, const char *frame, size_t length, std::unique_ptr<Message> &ack);
+
+public:
+	EventLoop();
+	virtual ~EventLoop();
+
+	/* create() returns a new loop on the requested backend.  Throws
+	 *          std::ios_base::failure if EVENT_BACKEND_URING is requested and
+	 *          the kernel does not support it.
+	 */
+	static EventLoop *create(int be = EVENT_BACKEND_AUTO);
+
+	/* The close callback runs before the descriptor is closed, so its
+	 * number is not yet free for another connection.
+	 */
+	void setMessageCallback(MessageCallback cb);
+	void setAcceptCallback(ClientCallback cb);
+	void setCloseCallback(ClientCallback cb);
+
+	/* setHandoffCallback() sees every accepted descriptor first, with the
+	 *                      listener it came from.  If it returns true it has
+	 *                      taken the descriptor, e.g. to post it to another
+	 *                      loop, and this loop ignores it.
+	 */
+	void setHandoffCallback(HandoffCallback cb);
+
+	/* Backpressure.  send() never refuses a frame, since replies produced
+	 * by the loop itself must not be lost, but a producer that can wait
+	 * checks writable() first and holds back while it is false.
+	 *
+	 * setWatermarks() sets the outbound queue marks of clients registered
+	 *                 from now on, see OutboundQueue::setWatermarks().
+	 * writable() is false while a client's queue is over its high marks.
+	 * setWritableCallback() is called when a client that was over its high
+	 *                 marks has drained to its low ones.
+	 */
+	void setWatermarks(size_t highbytes, size_t lowbytes, size_t highframes = 0, size_t lowframes = 0);
+	bool writable(int fd);
+	void setWritableCallback(ClientCallback cb);
+
+	/* setCreditWindow() paces clients that use credit flow control, see
+	 *                 Connection::setCreditFlow().  A client asks for
+	 *                 credit with a grant of 0 and is granted 'window'
+	 *                 messages; after the message callback has returned
+	 *                 for half of them (or handled() has counted them)
+	 *                 that many are granted again, so a client can be at
+	 *                 most 'window' messages ahead of the application.
+	 *                 Clients that never ask are sent no credit frames.
+	 *                 0, the default, grants nothing.  MSG_CONTROL_CREDIT
+	 *                 frames from clients are not delivered; the loop does
+	 *                 not pace its own sends by them.
+	 */
+	void setCreditWindow(uint32_t window);
+	uint32_t getCreditWindow(void);
+
+	/* Deferred handling, for a message callback that only queues the frame
+	 * for another thread; see EventLoopGroup.
+	 *
+	 * setDeferredCredit() stops counting a message as handled when the
+	 *                 callback returns; the owner reports it with handled()
+	 *                 instead, so credit follows the application.
+	 * handled() counts 'n' messages of a client as handled.
+	 * pauseReading() stops delivering a client's messages after the current
+	 *                 one.  Its socket is not read either, so TCP holds the
+	 *                 peer back.
+	 * resumeReading() delivers the messages held back and reads on.
+	 */
+	void setDeferredCredit(bool on);
+	void handled(int fd, uint32_t n);
+	virtual void pauseReading(int fd);
+	virtual void resumeReading(int fd);
+
+	/* setDeduplication() screens MSG_FLAG_ONCE_AND_ONLY_ONCE messages from
+	 *                 clients through one DeduplicationWindow for the loop
+	 *                 and answers each with MSG_CONTROL_ACK, so a client
+	 *                 Connection with setOnceAndOnlyOnce() stops resending
+	 *                 it.  A copy already seen is acknowledged again but
+	 *                 not delivered.  'capacity' 0 turns it off.  Acks from
+	 *                 clients are delivered; the loop does not resend its
+	 *                 own messages.
+	 */
+	void setDeduplication(size_t capacity, uint32_t window = DEFAULT_DEDUP_WINDOW);
+
+	/* addListener() serves every connection accepted on a listening
+	 *               Connection.  The Connection must outlive the loop.
+	 * addClient() serves an already connected descriptor; the loop takes
+	 *               ownership and closes it.
+	 */
+	virtual void addListener(kcmsg::Connection *listener);
+	void addClient(int fd);
+
+	/* send() queues a message for a client; it is written at the end of the
+	 *        current loop iteration, or at the start of the next one when
+	 *        called outside the loop.  Returns false if the client is
+	 *        unknown.  A failed write closes the client.
+	 */
+	bool send(int fd, kcmsg::Message *msg);
+	bool send(int fd, const char *frame, size_t length, uint8_t priority);
+	virtual void closeClient(int fd);
+
+	/* run() dispatches events until stop() is called from any thread.
+	 * runOnce() waits at most 'timeout' milliseconds and returns the number
+	 *           of events handled.
+	 * post() runs 'task' on the loop's thread soon; safe from any thread.
+	 */
+	void run(void);
+	virtual int runOnce(int timeout);
+	void stop(void);
+	void post(Task task);
+
+	size_t clientCount(void);
+	int getBackend(void);
+
+	/* system calls issued and messages delivered so far, for benchmarking */
+	uint64_t getSyscallCount(void);
+	uint64_t getMessageCount(void);
+};
+
+} /* namespace kcmsg */
+
+#endif /* EVENTLOOP_H_ */
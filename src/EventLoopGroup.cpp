@@ -0,0 +1,557 @@
+/*
+ * EventLoopGroup.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#include "EventLoopGroup.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstdlib>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+namespace kcmsg {
+
+const size_t MAX_GROUP_DESCRIPTORS = 1 << 20;
+
+/* the loop the calling thread runs, so sends from callbacks skip the post */
+static thread_local EventLoopGroup *current_group = nullptr;
+static thread_local size_t current_loop = 0;
+
+EventLoopGroup::EventLoopGroup(int iothreads, int handlers, int backend)
+{
+	init( iothreads, handlers, backend );
+}
+
+EventLoopGroup::EventLoopGroup(kcmsg::Configuration &conf, int maxthreads)
+{
+	int backend = EVENT_BACKEND_AUTO;
+	std::string name = conf.getProperty( CONF_EVENT_BACKEND );
+
+	if ( name == "epoll" )
+		backend = EVENT_BACKEND_EPOLL;
+	else if ( name == "uring" )
+		backend = EVENT_BACKEND_URING;
+
+	init( configured( conf, CONF_IO_THREADS, maxthreads ),
+			configured( conf, CONF_HANDLER_THREADS, maxthreads ), backend );
+	profile = kcmsg::SocketProfile::fromConfiguration( conf );
+}
+
+EventLoopGroup::~EventLoopGroup()
+{
+	stop();
+
+	for ( auto &listener : shards )
+		listener->Close( listener->getDescriptor() );
+}
+
+void EventLoopGroup::setMessageCallback(kcmsg::EventLoop::MessageCallback cb)
+{
+	on_message = cb;
+}
+
+void EventLoopGroup::setAcceptCallback(kcmsg::EventLoop::ClientCallback cb)
+{
+	on_accept = cb;
+}
+
+void EventLoopGroup::setCloseCallback(kcmsg::EventLoop::ClientCallback cb)
+{
+	on_close = cb;
+}
+
+void EventLoopGroup::setAffinity(bool on)
+{
+	pin = on;
+}
+
+void EventLoopGroup::setSocketProfile(const kcmsg::SocketProfile &p)
+{
+	profile = p;
+}
+
+void EventLoopGroup::addListener(kcmsg::Connection *listener)
+{
+	if ( started )
+		throw std::logic_error( "listeners are added before start()" );
+
+	loops[listeners++ % loops.size()]->addListener( listener );
+}
+
+uint16_t EventLoopGroup::listenSharded(sa_family_t family, const std::string &host, const std::string &service,
+		int backlog, bool steer)
+{
+	if ( started )
+		throw std::logic_error( "listeners are added before start()" );
+	if ( !shards.empty() )
+		throw std::logic_error( "group already has sharded listeners" );
+
+	std::string port = service;
+	uint16_t bound = 0;
+	this->steer = steer;
+
+	// listener i goes to loop i: the steering program indexes the reuse group in bind order
+	for ( size_t i = 0; i < loops.size(); i++ )
+	{
+		std::unique_ptr<kcmsg::Connection> listener( new kcmsg::Connection( family, SOCK_STREAM, IPPROTO_TCP,
+				backlog, "kcmsg.group" ) );
+		listener->setReusePort( true );
+		listener->setProfile( profile );
+		listener->resolveHost( host, port );
+		listener->Bind();
+
+		if ( i == 0 )
+		{
+			sockaddr_storage local;
+			socklen_t len = sizeof(local);
+			if ( getsockname( listener->getDescriptor(), (sockaddr *) &local, &len ) < 0 )
+				throw std::ios_base::failure( "Unable to read sharded listener address" );
+
+			bound = ntohs( ( family == AF_INET6 ) ? ( (sockaddr_in6 *) &local )->sin6_port
+					: ( (sockaddr_in *) &local )->sin_port );
+			port = std::to_string( bound );
+		}
+
+		listener->setListenerQueueSize( backlog );
+		listener->Listen();
+
+		int fd = listener->getDescriptor();
+		if ( (size_t) fd >= sharded.size() )
+			sharded.resize( fd + 1, 0 );
+		sharded[fd] = 1;
+
+		loops[i]->addListener( listener.get() );
+		shards.push_back( std::move( listener ) );
+	}
+
+	return ( bound );
+}
+
+void EventLoopGroup::addClient(int fd)
+{
+	size_t target = next_loop++ % loops.size();
+	loops[target]->post( [this, target, fd]() { adopt( target, fd ); } );
+}
+
+bool EventLoopGroup::send(int fd, kcmsg::Message *msg)
+{
+	int owner = ownerOf( fd );
+	if ( owner < 0 )
+		return ( false );
+
+	kcmsg::EventLoop *loop = loops[owner].get();
+	if ( ( current_group == this ) && ( current_loop == (size_t) owner ) )
+		return loop->send( fd, msg );
+
+	const char *frame = msg->serialize();
+	std::shared_ptr<std::vector<char>> copy( new std::vector<char>( frame, frame + msg->getMessageLength() ) );
+	uint8_t priority = msg->getPriority();
+
+	loop->post( [loop, fd, copy, priority]() { loop->send( fd, copy->data(), copy->size(), priority ); } );
+	return ( true );
+}
+
+void EventLoopGroup::closeClient(int fd)
+{
+	int owner = ownerOf( fd );
+	if ( owner < 0 )
+		return;
+
+	kcmsg::EventLoop *loop = loops[owner].get();
+	if ( ( current_group == this ) && ( current_loop == (size_t) owner ) )
+		loop->closeClient( fd );
+	else
+		loop->post( [loop, fd]() { loop->closeClient( fd ); } );
+}
+
+void EventLoopGroup::start(void)
+{
+	if ( started )
+		return;
+	started = true;
+
+	credit = false;
+	for ( auto &loop : loops )
+		credit = credit || ( loop->getCreditWindow() > 0 );
+
+	for ( auto &q : queues )
+	{
+		q->stopping = false;
+		handler_threads.push_back( std::thread( &EventLoopGroup::handlerMain, this, q.get() ) );
+	}
+
+	bool pinning = pin && ( loops.size() <= cpus.size() );
+	bool pinned = pinning;
+	for ( size_t i = 0; i < loops.size(); i++ )
+	{
+		io_threads.push_back( std::thread( &EventLoopGroup::ioMain, this, i ) );
+
+		if ( pinning )
+		{
+			cpu_set_t set;
+			CPU_ZERO( &set );
+			CPU_SET( cpus[i], &set );
+			if ( pthread_setaffinity_np( io_threads.back().native_handle(), sizeof(set), &set ) != 0 )
+				pinned = false;
+		}
+	}
+
+	// by CPU only makes sense while each CPU has a loop of its own
+	if ( steer && pinned && steerable() )
+		shards.front()->setReusePortSteering( loops.size() );
+}
+
+void EventLoopGroup::stop(void)
+{
+	if ( !started )
+		return;
+
+	for ( auto &loop : loops )
+		loop->stop();
+	for ( auto &t : io_threads )
+		t.join();
+	io_threads.clear();
+
+	// handlers finish what the loops already queued
+	for ( auto &q : queues )
+	{
+		std::lock_guard<std::mutex> guard( q->lock );
+		q->stopping = true;
+		q->ready.notify_one();
+	}
+	for ( auto &t : handler_threads )
+		t.join();
+	handler_threads.clear();
+
+	started = false;
+}
+
+size_t EventLoopGroup::size(void)
+{
+	return ( loops.size() );
+}
+
+size_t EventLoopGroup::handlerCount(void)
+{
+	return ( queues.size() );
+}
+
+kcmsg::EventLoop *EventLoopGroup::getLoop(size_t i)
+{
+	return ( loops.at( i ).get() );
+}
+
+/* private methods */
+
+void EventLoopGroup::init(int iothreads, int handlers, int backend)
+{
+	cpus = allowedCpus();
+
+	if ( iothreads <= 0 )
+		iothreads = cpus.size();
+	if ( handlers < 0 )
+		handlers = 0;
+
+	rlimit rl;
+	max_fds = MAX_GROUP_DESCRIPTORS;
+	if ( ( getrlimit( RLIMIT_NOFILE, &rl ) == 0 ) && ( rl.rlim_cur != RLIM_INFINITY ) )
+		max_fds = std::min( (size_t) rl.rlim_cur, MAX_GROUP_DESCRIPTORS );
+
+	owners.reset( new std::atomic<int>[max_fds] );
+	for ( size_t i = 0; i < max_fds; i++ )
+		owners[i] = -1;
+
+	next_loop = 0;
+	listeners = 0;
+	pin = ( (size_t) iothreads <= cpus.size() );
+	steer = false;
+	started = false;
+	credit = false;
+
+	for ( int i = 0; i < iothreads; i++ )
+	{
+		loops.emplace_back( kcmsg::EventLoop::create( backend ) );
+		kcmsg::EventLoop *loop = loops.back().get();
+		size_t self = i;
+
+		// with handlers a message is only queued by the callback; they report it handled
+		loop->setDeferredCredit( handlers > 0 );
+
+		loop->setMessageCallback( [this]( int fd, const char *frame, size_t length )
+			{
+				dispatch( EVENT_MESSAGE, fd, frame, length );
+			} );
+
+		loop->setAcceptCallback( [this, self]( int fd )
+			{
+				owners[fd] = (int) self;
+				dispatch( EVENT_ACCEPT, fd, nullptr, 0 );
+			} );
+
+		loop->setCloseCallback( [this]( int fd )
+			{
+				owners[fd] = -1;
+				dispatch( EVENT_CLOSE, fd, nullptr, 0 );
+			} );
+
+		// deal accepted connections round robin over all loops
+		loop->setHandoffCallback( [this, self]( int listener, int fd ) -> bool
+			{
+				if ( (size_t) fd >= max_fds )
+				{
+					close( fd );
+					return ( true );
+				}
+
+				// a sharded listener's connections stay with the loop that accepted them
+				if ( ( (size_t) listener < sharded.size() ) && sharded[listener] )
+					return ( false );
+
+				size_t target = next_loop++ % loops.size();
+				if ( target == self )
+					return ( false );
+
+				loops[target]->post( [this, target, fd]() { adopt( target, fd ); } );
+				return ( true );
+			} );
+	}
+
+	for ( int i = 0; i < handlers; i++ )
+	{
+		queues.emplace_back( new HandlerQueue() );
+		queues.back()->stopping = false;
+	}
+}
+
+int EventLoopGroup::configured(kcmsg::Configuration &conf, const char *key, int fallback)
+{
+	if ( !conf.propertyExists( key ) )
+		return ( fallback );
+
+	std::string value = conf.getProperty( key );
+	char *end;
+	long n = strtol( value.c_str(), &end, 10 );
+
+	return ( ( end == value.c_str() ) || ( n < 0 ) ) ? fallback : (int) n;
+}
+
+std::vector<int> EventLoopGroup::allowedCpus(void)
+{
+	std::vector<int> allowed;
+	cpu_set_t set;
+
+	CPU_ZERO( &set );
+	if ( sched_getaffinity( 0, sizeof(set), &set ) == 0 )
+	{
+		for ( int cpu = 0; cpu < CPU_SETSIZE; cpu++ )
+			if ( CPU_ISSET( cpu, &set ) )
+				allowed.push_back( cpu );
+	}
+
+	if ( allowed.empty() )
+		for ( unsigned cpu = 0; cpu < std::max( 1u, std::thread::hardware_concurrency() ); cpu++ )
+			allowed.push_back( (int) cpu );
+
+	return ( allowed );
+}
+
+bool EventLoopGroup::steerable(void)
+{
+	// the program picks listener cpu % N, which must be the loop pinned to that cpu
+	if ( shards.empty() || ( loops.size() < 2 ) || ( cpus.size() != loops.size() ) )
+		return ( false );
+
+	for ( size_t i = 0; i < cpus.size(); i++ )
+		if ( (size_t) cpus[i] != i )
+			return ( false );
+
+	return ( true );
+}
+
+int EventLoopGroup::ownerOf(int fd)
+{
+	if ( ( fd < 0 ) || ( (size_t) fd >= max_fds ) )
+		return (-1);
+	return ( owners[fd] );
+}
+
+void EventLoopGroup::adopt(size_t loop, int fd)
+{
+	if ( (size_t) fd >= max_fds )
+	{
+		close( fd );
+		return;
+	}
+
+	try
+	{
+		loops[loop]->addClient( fd );
+	}
+	catch ( std::exception &e )
+	{
+		close( fd );
+		return;
+	}
+
+	owners[fd] = (int) loop;
+	dispatch( EVENT_ACCEPT, fd, nullptr, 0 );
+}
+
+void EventLoopGroup::dispatch(EventKind kind, int fd, const char *frame, size_t length)
+{
+	if ( queues.empty() )
+	{
+		switch ( kind )
+		{
+		case EVENT_ACCEPT :
+			if ( on_accept )
+				on_accept( fd );
+			break;
+		case EVENT_MESSAGE :
+			if ( on_message )
+				on_message( fd, frame, length );
+			break;
+		case EVENT_CLOSE :
+			if ( on_close )
+				on_close( fd );
+			break;
+		}
+		return;
+	}
+
+	// one queue per descriptor keeps a connection's events in order
+	HandlerQueue &q = *queues[fd % queues.size()];
+	Event e;
+	e.kind = kind;
+	e.fd = fd;
+	e.loop = current_loop;
+	if ( frame )
+		e.frame.assign( frame, frame + length );
+
+	bool idle, full;
+	{
+		std::lock_guard<std::mutex> guard( q.lock );
+		idle = q.events.empty();
+		q.events.push_back( std::move( e ) );
+		full = ( kind == EVENT_MESSAGE ) && ( q.events.size() >= HANDLER_QUEUE_HIGH );
+		if ( full )
+			q.paused.push_back( std::make_pair( current_loop, fd ) );
+	}
+
+	// the resume is posted to this thread, so it cannot overtake the pause
+	if ( full )
+		loops[current_loop]->pauseReading( fd );
+	if ( idle )
+		q.ready.notify_one();
+}
+
+void EventLoopGroup::handlerMain(HandlerQueue *q)
+{
+	std::deque<Event> batch;
+	std::vector<std::shared_ptr<Feedback>> pending( loops.size() );
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> guard( q->lock );
+			q->ready.wait( guard, [q]() { return ( !q->events.empty() || q->stopping ); } );
+			if ( q->events.empty() )
+				return;		// stopping and drained
+			batch.swap( q->events );
+		}
+
+		for ( auto &e : batch )
+		{
+			switch ( e.kind )
+			{
+			case EVENT_ACCEPT :
+				if ( on_accept )
+					on_accept( e.fd );
+				break;
+			case EVENT_MESSAGE :
+				if ( on_message )
+					on_message( e.fd, e.frame.data(), e.frame.size() );
+				if ( credit )
+				{
+					auto &handled = reportTo( pending, e.loop ).handled;
+					if ( !handled.empty() && ( handled.back().first == e.fd ) )
+						handled.back().second++;
+					else
+						handled.push_back( std::make_pair( e.fd, 1u ) );
+				}
+				break;
+			case EVENT_CLOSE :
+				if ( on_close )
+					on_close( e.fd );
+				if ( pending[e.loop] )
+				{
+					// the descriptor may name a new connection by the time the loop sees the report
+					auto &handled = pending[e.loop]->handled;
+					handled.erase( std::remove_if( handled.begin(), handled.end(),
+							[&e]( const std::pair<int, uint32_t> &h ) { return ( h.first == e.fd ); } ),
+							handled.end() );
+				}
+				break;
+			}
+		}
+		batch.clear();
+
+		{
+			std::lock_guard<std::mutex> guard( q->lock );
+			if ( !q->paused.empty() && ( q->events.size() <= HANDLER_QUEUE_LOW ) )
+			{
+				for ( auto &p : q->paused )
+					reportTo( pending, p.first ).resume.push_back( p.second );
+				q->paused.clear();
+			}
+		}
+
+		feedback( pending );
+	}
+}
+
+void EventLoopGroup::feedback(std::vector<std::shared_ptr<Feedback>> &pending)
+{
+	for ( size_t i = 0; i < pending.size(); i++ )
+	{
+		if ( !pending[i] )
+			continue;
+
+		kcmsg::EventLoop *loop = loops[i].get();
+		std::shared_ptr<Feedback> f( std::move( pending[i] ) );
+		loop->post( [loop, f]()
+			{
+				for ( auto &h : f->handled )
+					loop->handled( h.first, h.second );
+				for ( int fd : f->resume )
+					loop->resumeReading( fd );
+			} );
+	}
+}
+
+EventLoopGroup::Feedback &EventLoopGroup::reportTo(std::vector<std::shared_ptr<Feedback>> &pending, size_t loop)
+{
+	if ( !pending[loop] )
+		pending[loop].reset( new Feedback() );
+	return ( *pending[loop] );
+}
+
+void EventLoopGroup::ioMain(size_t loop)
+{
+	current_group = this;
+	current_loop = loop;
+
+	loops[loop]->run();
+
+	current_group = nullptr;
+}
+
+} /* namespace kcmsg */
@@ -0,0 +1,181 @@
+/*
+ * EventLoopGroup.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#ifndef EVENTLOOPGROUP_H_
+#define EVENTLOOPGROUP_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <utility>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <string>
+
+#include "Configuration.h"
+#include "Connection.h"
+#include "EventLoop.h"
+
+namespace kcmsg {
+
+/* Configuration keys read by EventLoopGroup(Configuration &, int) */
+const char * const CONF_IO_THREADS = "kcmsg.threads.io";
+const char * const CONF_HANDLER_THREADS = "kcmsg.threads.handlers";
+const char * const CONF_EVENT_BACKEND = "kcmsg.eventloop.backend";	// auto | epoll | uring
+
+const size_t HANDLER_QUEUE_HIGH = 4096;	// events queued for a handler before reads pause
+const size_t HANDLER_QUEUE_LOW = 1024;	// and when they resume
+
+/*
+ * EventLoopGroup is the threading model for a server: N IO threads, each
+ * running its own EventLoop, and a separate pool of handler threads that
+ * run the application callbacks.
+ *
+ * Listeners are spread over the loops.  Every connection a loop accepts is
+ * dealt round robin to one of the loops and stays there, so its socket is
+ * only ever touched by one thread.  IO threads are pinned to one CPU each,
+ * in order of the CPUs the process may run on (sched_getaffinity()), when
+ * there are no more of them than those CPUs.
+ *
+ * Complete frames are copied to a handler queue chosen by the descriptor,
+ * so the messages of one connection are handled in order by one handler
+ * thread while different connections run in parallel.  A connection whose
+ * message finds its queue at HANDLER_QUEUE_HIGH events stops being read
+ * until the handler has worked the queue down to HANDLER_QUEUE_LOW, and
+ * with a credit window (EventLoop::setCreditWindow()) a message counts as
+ * handled once the handler's callback has returned.  With no handler
+ * threads the callbacks run directly on the IO threads, which is fastest
+ * when they never block.  send() and closeClient() may be called from any
+ * thread; they are forwarded to the owning loop.
+ *
+ * listenSharded() instead gives every loop its own SO_REUSEPORT listener
+ * on the same address.  Each loop then accepts and serves its own
+ * connections without a handoff, and with steering the kernel picks the
+ * listener of the CPU that received the connection, so a connection stays
+ * on one core from interrupt to handler.  The kernel's choice is the CPU
+ * number modulo the number of listeners, so start() only steers when every
+ * IO thread was pinned and each allowed CPU is the one its loop runs on,
+ * i.e. the process may run on CPUs 0 to N-1 and there are N IO threads.
+ *
+ * Connections are named by descriptor.  A descriptor closed and reused
+ * while a handler still works on it names the new connection.
+ */
+class EventLoopGroup {
+private:
+	enum EventKind { EVENT_ACCEPT, EVENT_MESSAGE, EVENT_CLOSE };
+
+	struct Event
+	{
+		EventKind kind;
+		int fd;
+		size_t loop;				// the loop that queued it
+		std::vector<char> frame;
+	};
+
+	struct HandlerQueue
+	{
+		std::mutex lock;
+		std::condition_variable ready;
+		std::deque<Event> events;
+		std::vector<std::pair<size_t, int>> paused;	// (loop, fd) waiting for the queue to drain
+		bool stopping;
+	};
+
+	/* what a handler batch reports back to one loop */
+	struct Feedback
+	{
+		std::vector<std::pair<int, uint32_t>> handled;	// (fd, messages)
+		std::vector<int> resume;
+	};
+
+	std::vector<std::unique_ptr<kcmsg::EventLoop>> loops;
+	std::vector<std::thread> io_threads;
+	std::vector<std::unique_ptr<HandlerQueue>> queues;
+	std::vector<std::thread> handler_threads;
+
+	std::unique_ptr<std::atomic<int>[]> owners;		// loop serving each descriptor, -1 if none
+	size_t max_fds;
+	std::atomic<uint32_t> next_loop;
+	size_t listeners;
+	std::vector<std::unique_ptr<kcmsg::Connection>> shards;	// per loop listeners from listenSharded()
+	std::vector<int> sharded;								// their descriptors, served where accepted
+	kcmsg::SocketProfile profile;							// applied to the sharded listeners
+	std::vector<int> cpus;				// the CPUs the process may run on
+	bool pin;
+	bool steer;							// listenSharded() asked for steering
+	bool started;
+	bool credit;		// some loop has a credit window; handlers report what they handled
+
+	kcmsg::EventLoop::MessageCallback on_message;
+	kcmsg::EventLoop::ClientCallback on_accept;
+	kcmsg::EventLoop::ClientCallback on_close;
+
+	void init(int iothreads, int handlers, int backend);
+	static int configured(kcmsg::Configuration &conf, const char *key, int fallback);
+	static std::vector<int> allowedCpus(void);
+	bool steerable(void);
+
+	int ownerOf(int fd);
+	void adopt(size_t loop, int fd);
+	void dispatch(EventKind kind, int fd, const char *frame, size_t length);
+	void handlerMain(HandlerQueue *q);
+	void feedback(std::vector<std::shared_ptr<Feedback>> &pending);
+	static Feedback &reportTo(std::vector<std::shared_ptr<Feedback>> &pending, size_t loop);
+	void ioMain(size_t loop);
+
+public:
+	/* iothreads of 0 means one per CPU; handlers of 0 runs the callbacks on
+	 * the IO threads.
+	 */
+	EventLoopGroup(int iothreads, int handlers, int backend = EVENT_BACKEND_AUTO);
+
+	/* sizes the group from CONF_IO_THREADS and CONF_HANDLER_THREADS, falling
+	 * back to 'maxthreads' (usually Connection::getMaxThreads()) for both, and
+	 * reads the socket profile from the CONF_SOCKET_ keys.
+	 */
+	EventLoopGroup(kcmsg::Configuration &conf, int maxthreads);
+	virtual ~EventLoopGroup();
+
+	/* callbacks and listeners are set before start() */
+	void setMessageCallback(kcmsg::EventLoop::MessageCallback cb);
+	void setAcceptCallback(kcmsg::EventLoop::ClientCallback cb);
+	void setCloseCallback(kcmsg::EventLoop::ClientCallback cb);
+	void setAffinity(bool on);
+	void setSocketProfile(const kcmsg::SocketProfile &p);
+	void addListener(kcmsg::Connection *listener);
+
+	/* listenSharded() binds one SO_REUSEPORT listener per loop to host and
+	 *                 service, and with 'steer' has the kernel pick the
+	 *                 listener by receiving CPU when start() finds each CPU
+	 *                 served by its own pinned loop; otherwise the kernel
+	 *                 hashes connections over the listeners.  A service of
+	 *                 "0" binds the first listener to an ephemeral port and
+	 *                 the rest to the same one.  Returns the bound port.
+	 */
+	uint16_t listenSharded(sa_family_t family, const std::string &host, const std::string &service,
+			int backlog, bool steer = true);
+
+	/* addClient() hands an already connected descriptor to one of the loops */
+	void addClient(int fd);
+	bool send(int fd, kcmsg::Message *msg);
+	void closeClient(int fd);
+
+	void start(void);
+	void stop(void);
+
+	size_t size(void);
+	size_t handlerCount(void);
+	kcmsg::EventLoop *getLoop(size_t i);
+};
+
+} /* namespace kcmsg */
+
+#endif /* EVENTLOOPGROUP_H_ */
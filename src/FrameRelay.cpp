@@ -0,0 +1,340 @@
+/*
+ * FrameRelay.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#include "FrameRelay.h"
+#include "Connection.h"
+#include "RoutingTable.h"
+
+#include <ios>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <ctime>
+#include <boost/endian/buffers.hpp>
+
+namespace kcmsg {
+
+static uint64_t now(void)
+{
+	timespec ts;
+	clock_gettime( CLOCK_MONOTONIC_COARSE, &ts );
+	return ( (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000 );
+}
+
+FrameRelay::FrameRelay(size_t pipe_size)
+{
+	in_pipe = 0;
+	timeout = RELAY_TIMEOUT;
+	forwarded = 0;
+	dropped = 0;
+	bytes = 0;
+
+	if ( pipe2( pipefd, O_CLOEXEC ) < 0 )
+		throw std::ios_base::failure( "Unable to create relay pipe" );
+
+	// a larger pipe moves a frame in fewer rounds; the default 64K still works
+	fcntl( pipefd[1], F_SETPIPE_SZ, (int) pipe_size );
+
+	if ( ( devnull = open( "/dev/null", O_WRONLY | O_CLOEXEC ) ) < 0 )
+	{
+		close( pipefd[0] );
+		close( pipefd[1] );
+		throw std::ios_base::failure( "Unable to open /dev/null" );
+	}
+}
+
+FrameRelay::~FrameRelay()
+{
+	close( pipefd[0] );
+	close( pipefd[1] );
+	close( devnull );
+}
+
+size_t FrameRelay::relay(int from, RouteCallback route)
+{
+	char header[MESSAGE_HEADER_LENGTH];
+
+	ssize_t n = peekHeader( from, header );
+	if ( n <= 0 )
+		return ( n );
+
+	boost::endian::little_uint16_buf_t flen;
+	memcpy( &flen, header + MESSAGE_LENGTH_OFFSET, sizeof(flen) );
+	if ( flen.value() < MESSAGE_HEADER_LENGTH )
+	{
+		errno = EPROTO;
+		return (-1);
+	}
+
+	uint64_t deadline = now() + timeout;
+	if ( !awaitFrame( from, flen.value(), deadline ) )
+		return (-1);
+
+	int to = route( header, sizeof(header) );
+	if ( to < 0 )
+	{
+		if ( !moveFrame( from, devnull, flen.value(), deadline ) )
+			return (-1);
+		dropped++;
+		return ( flen.value() );
+	}
+
+	if ( !moveFrame( from, to, flen.value(), deadline ) )
+		return (-1);
+
+	forwarded++;
+	bytes += flen.value();
+	return ( flen.value() );
+}
+
+size_t FrameRelay::relay(int from, int to)
+{
+	return relay( from, [to](const char *, size_t) { return ( to ); } );
+}
+
+size_t FrameRelay::relay(int from, kcmsg::RoutingTable &table)
+{
+	return relay( from, [&table](const char *header, size_t length)
+	{
+		kcmsg::Connection *target = table.route( header, length );
+		return ( target ? target->getDescriptor() : -1 );
+	} );
+}
+
+size_t FrameRelay::relay(kcmsg::Connection &from, kcmsg::Connection &to)
+{
+	return relay( from.getDescriptor(), to.getDescriptor() );
+}
+
+void FrameRelay::setTimeout(uint32_t ms)
+{
+	timeout = ms;
+}
+
+uint64_t FrameRelay::getForwardedCount(void)
+{
+	return ( forwarded );
+}
+
+uint64_t FrameRelay::getDroppedCount(void)
+{
+	return ( dropped );
+}
+
+uint64_t FrameRelay::getByteCount(void)
+{
+	return ( bytes );
+}
+
+/* private methods */
+
+ssize_t FrameRelay::peekHeader(int from, char *header)
+{
+	ssize_t n;
+	do
+	{
+		n = recv( from, header, MESSAGE_HEADER_LENGTH, MSG_PEEK | MSG_WAITALL );
+	} while ( ( n < 0 ) && ( errno == EINTR ) );
+
+	if ( n <= 0 )
+		return ( n );
+
+	if ( (size_t) n < MESSAGE_HEADER_LENGTH )
+	{
+		// a partial header is normal on a non-blocking socket, but not after
+		// the peer has finished sending
+		pollfd p = { from, POLLRDHUP, 0 };
+		errno = ( ( poll( &p, 1, 0 ) > 0 ) && ( p.revents & ( POLLRDHUP | POLLHUP ) ) ) ? EPROTO : EAGAIN;
+		return (-1);
+	}
+
+	return ( n );
+}
+
+bool FrameRelay::awaitFrame(int from, size_t length, uint64_t deadline)
+{
+	int avail = 0;
+	if ( ( ioctl( from, FIONREAD, &avail ) == 0 ) && ( (size_t) avail >= length ) )
+		return ( true );
+
+	// with the low watermark at the frame length, POLLIN waits for the whole
+	// frame instead of firing on every segment of it
+	int lowat = (int) length;
+	setsockopt( from, SOL_SOCKET, SO_RCVLOWAT, &lowat, sizeof(lowat) );
+
+	int err = 0;
+	while ( err == 0 )
+	{
+		if ( ( ioctl( from, FIONREAD, &avail ) == 0 ) && ( (size_t) avail >= length ) )
+			break;
+
+		pollfd p = { from, POLLIN | POLLRDHUP, 0 };
+		uint64_t t = now();
+		int n = ( t < deadline ) ? poll( &p, 1, (int) ( deadline - t ) ) : 0;
+		if ( ( n < 0 ) && ( errno == EINTR ) )
+			continue;
+		if ( n < 0 )
+			err = errno;
+		else if ( n == 0 )
+			err = ETIMEDOUT;
+		else if ( p.revents & ( POLLRDHUP | POLLHUP | POLLERR ) )
+		{
+			// the peer is done; whatever is left of the frame is all there is
+			if ( ( ioctl( from, FIONREAD, &avail ) < 0 ) || ( (size_t) avail < length ) )
+				err = EPROTO;
+		}
+	}
+
+	lowat = 1;
+	setsockopt( from, SOL_SOCKET, SO_RCVLOWAT, &lowat, sizeof(lowat) );
+
+	if ( err != 0 )
+	{
+		errno = err;
+		return ( false );
+	}
+	return ( true );
+}
+
+bool FrameRelay::moveFrame(int from, int to, size_t length, uint64_t deadline)
+{
+	size_t left = length;
+	size_t sent = 0;		// bytes of this frame already on 'to'
+	int err = 0;
+
+	while ( left > 0 )
+	{
+		// the whole frame is queued on the source, so EAGAIN here means the
+		// pipe is full, and the pipe is drained before waiting
+		ssize_t n = splice( from, nullptr, pipefd[1], nullptr, left,
+				SPLICE_F_MOVE | SPLICE_F_MORE | SPLICE_F_NONBLOCK );
+		if ( n > 0 )
+		{
+			left -= n;
+			in_pipe += n;
+		}
+		else if ( n == 0 )
+		{
+			err = EPROTO;		// the source ended inside a frame
+			break;
+		}
+		else if ( errno == EINTR )
+			continue;
+		else if ( ( errno == EAGAIN ) && ( in_pipe == 0 ) )
+		{
+			if ( !waitFor( from, POLLIN, deadline ) )
+			{
+				err = errno;
+				break;
+			}
+		}
+		else if ( errno != EAGAIN )
+		{
+			err = errno;
+			break;
+		}
+
+		if ( in_pipe > 0 )
+		{
+			size_t before = in_pipe;
+			bool ok = drainPipe( to, left > 0, deadline );
+			sent += before - in_pipe;
+			if ( !ok )
+			{
+				err = errno;
+				break;
+			}
+		}
+	}
+
+	if ( err == 0 )
+		return ( true );
+
+	if ( ( sent > 0 ) && ( to != devnull ) )
+	{
+		// part of the frame is on the destination and the rest never will
+		// be; its reader would take the next frame's bytes for this one's,
+		// so the destination is shut down instead
+		shutdown( to, SHUT_RDWR );
+	}
+
+	// keep the source in step: the rest of this frame goes nowhere
+	drainPipe( devnull, false, deadline );
+	while ( left > 0 )
+	{
+		ssize_t n = splice( from, nullptr, pipefd[1], nullptr, left, SPLICE_F_MOVE | SPLICE_F_NONBLOCK );
+		if ( ( n < 0 ) && ( errno == EINTR ) )
+			continue;
+		if ( n <= 0 )
+			break;
+		left -= n;
+		in_pipe += n;
+		drainPipe( devnull, false, deadline );
+	}
+
+	errno = err;
+	return ( false );
+}
+
+bool FrameRelay::drainPipe(int to, bool more, uint64_t deadline)
+{
+	while ( in_pipe > 0 )
+	{
+		ssize_t n = splice( pipefd[0], nullptr, to, nullptr, in_pipe,
+				SPLICE_F_MOVE | SPLICE_F_NONBLOCK | ( more ? SPLICE_F_MORE : 0 ) );
+		if ( n > 0 )
+		{
+			in_pipe -= n;
+			continue;
+		}
+		if ( ( n < 0 ) && ( errno == EINTR ) )
+			continue;
+		if ( ( n < 0 ) && ( errno == EAGAIN ) )
+		{
+			if ( !waitFor( to, POLLOUT, deadline ) )
+				return ( false );
+			continue;
+		}
+		if ( n == 0 )
+			errno = EPIPE;
+		return ( false );
+	}
+
+	return ( true );
+}
+
+bool FrameRelay::waitFor(int fd, short events, uint64_t deadline)
+{
+	pollfd p = { fd, events, 0 };
+
+	for ( ;; )
+	{
+		uint64_t t = now();
+		if ( t >= deadline )
+		{
+			errno = ETIMEDOUT;
+			return ( false );
+		}
+
+		int n = poll( &p, 1, (int) ( deadline - t ) );
+		if ( n > 0 )
+			return ( true );
+		if ( n == 0 )
+		{
+			errno = ETIMEDOUT;
+			return ( false );
+		}
+		if ( errno != EINTR )
+			return ( false );
+	}
+}
+
+} /* namespace kcmsg */
@@ -0,0 +1,105 @@
+/*
+ * FrameRelay.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#ifndef FRAMERELAY_H_
+#define FRAMERELAY_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+#include "Message.h"
+
+namespace kcmsg {
+
+class Connection;
+class RoutingTable;
+
+const size_t RELAY_PIPE_SIZE = 256 * 1024;	// pipe capacity asked for, several maximum frames
+const uint32_t RELAY_TIMEOUT = 5000;		// ms a frame may take to arrive whole and be sent on
+
+/*
+ * FrameRelay forwards whole message frames from one stream socket to
+ * another without bringing their bytes into user memory, for a broker
+ * that only routes.
+ *
+ * relay() peeks the frame header with MSG_PEEK, asks the route callback
+ * (or a RoutingTable) for the destination, then moves exactly the frame's
+ * bytes from the source socket into a pipe and from the pipe to the
+ * destination with splice().  The kernel passes page references instead
+ * of copying, so only the header crosses into user space.  Frames with no
+ * route are spliced to /dev/null, which keeps the source in step.
+ *
+ * relay() waits, up to the timeout, until the whole frame is queued on
+ * the source before it moves any of it, so a slow or stalled sender costs
+ * nothing but the wait and leaves the source on a frame boundary.  A frame
+ * is then moved in as many rounds as the pipe needs; a non-blocking
+ * destination that is full is waited for within the same timeout.  If the
+ * destination fails or times out after part of a frame reached it, it is
+ * shut down, since its reader could no longer find the next frame.  A
+ * blocking destination blocks in splice() as it would in send().  Nothing
+ * must have read ahead of the relay on the source socket, e.g.
+ * Connection::ReadMessage(), or framing is lost.  The source's
+ * SO_RCVLOWAT is used while waiting and left at 1.
+ *
+ * splice() cannot be given MSG_NOSIGNAL, so a process relaying to peers
+ * that may disappear should ignore SIGPIPE.
+ *
+ * One FrameRelay owns one pipe and is used by one thread at a time.
+ */
+class FrameRelay {
+public:
+	/* returns the destination descriptor for a frame, or -1 to drop it */
+	typedef std::function<int(const char *header, size_t length)> RouteCallback;
+
+private:
+	int pipefd[2];
+	int devnull;
+	size_t in_pipe;			// bytes spliced into the pipe, not yet out
+	uint32_t timeout;		// ms
+	uint64_t forwarded;
+	uint64_t dropped;
+	uint64_t bytes;
+
+	ssize_t peekHeader(int from, char *header);
+	bool awaitFrame(int from, size_t length, uint64_t deadline);
+	bool moveFrame(int from, int to, size_t length, uint64_t deadline);
+	bool drainPipe(int to, bool more, uint64_t deadline);
+	bool waitFor(int fd, short events, uint64_t deadline);
+
+public:
+	/* Throws std::ios_base::failure if the pipe cannot be made */
+	FrameRelay(size_t pipe_size = RELAY_PIPE_SIZE);
+	virtual ~FrameRelay();
+
+	/* relay() forwards the next frame from 'from'.  Returns the frame
+	 *         length, 0 on orderly shutdown, or -1 with errno set: EAGAIN
+	 *         if a non-blocking source has no whole header yet (nothing is
+	 *         consumed), ETIMEDOUT if the rest of the frame did not
+	 *         arrive in the timeout (nothing is consumed either), EPROTO if
+	 *         framing is lost.  If the destination fails or times out the
+	 *         rest of the frame is discarded, so the source stays on a frame
+	 *         boundary, and -1 is returned with its errno.
+	 */
+	size_t relay(int from, RouteCallback route);
+	size_t relay(int from, int to);
+	size_t relay(int from, kcmsg::RoutingTable &table);
+
+	/* relay() between Connections, see Connection::getDescriptor() */
+	size_t relay(kcmsg::Connection &from, kcmsg::Connection &to);
+
+	/* setTimeout() sets the ms one frame may take, RELAY_TIMEOUT by default */
+	void setTimeout(uint32_t ms);
+
+	uint64_t getForwardedCount(void);
+	uint64_t getDroppedCount(void);
+	uint64_t getByteCount(void);		// bytes forwarded
+};
+
+} /* namespace kcmsg */
+
+#endif /* FRAMERELAY_H_ */
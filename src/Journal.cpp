@@ -0,0 +1,503 @@
+/*
+ * Journal.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#include "Journal.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+#include <ios>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <boost/filesystem.hpp>
+#include <boost/endian/buffers.hpp>
+#include <boost/crc.hpp>
+
+namespace kcmsg {
+
+const char JOURNAL_MAGIC[8] = { 'K', 'C', 'M', 'S', 'G', 'J', 'N', 'L' };
+const size_t JOURNAL_SEGMENT_HEADER = 16;	// magic, first sequence
+const size_t JOURNAL_RECORD_HEADER = 24;	// length, crc32, sequence, timestamp
+const size_t JOURNAL_RECORD_ALIGN = 8;
+const char *JOURNAL_SUFFIX = ".journal";
+
+static size_t recordSize(size_t length)
+{
+	return ( ( JOURNAL_RECORD_HEADER + length + JOURNAL_RECORD_ALIGN - 1 ) & ~( JOURNAL_RECORD_ALIGN - 1 ) );
+}
+
+static uint32_t recordChecksum(const char *rec, size_t length)
+{
+	// covers sequence, timestamp and frame
+	boost::crc_32_type crc;
+	crc.process_bytes( rec + 8, JOURNAL_RECORD_HEADER - 8 + length );
+	return ( crc.checksum() );
+}
+
+static uint64_t wallClock(void)
+{
+	timespec ts;
+	clock_gettime( CLOCK_REALTIME, &ts );
+	return ( (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec );
+}
+
+Journal::Journal(std::string dir, size_t segsize, size_t maxsegments, uint32_t maxage)
+{
+	if ( segsize < JOURNAL_SEGMENT_HEADER + recordSize( MAX_MSG_DATA ) )
+		throw std::invalid_argument( "journal segment size too small" );
+	if ( segsize > UINT32_MAX )
+		throw std::invalid_argument( "journal segment size over 4 GiB" );
+
+	directory = dir;
+	segment_size = segsize;
+	max_segments = ( maxsegments == 0 ) ? 1 : maxsegments;
+	max_age = maxage;
+	readonly = false;
+
+	boost::filesystem::create_directories( boost::filesystem::path( directory ) );
+	openDirectory();
+}
+
+Journal::Journal(std::string dir)
+{
+	directory = dir;
+	segment_size = 0;
+	max_segments = 0;
+	max_age = 0;
+	readonly = true;
+
+	boost::system::error_code ec;
+	if ( !boost::filesystem::is_directory( boost::filesystem::path( directory ), ec ) )
+		throw std::ios_base::failure( "Journal directory not found" );
+
+	openDirectory();
+}
+
+Journal::~Journal()
+{
+	try
+	{
+		if ( !readonly )
+			commit();
+	}
+	catch ( std::exception &e )
+	{
+		// nowhere to report it; the records stay in the page cache
+	}
+
+	for ( auto &s : segments )
+		closeSegment( s );
+}
+
+uint64_t Journal::append(kcmsg::Message *msg)
+{
+	const char *frame = msg->serialize();
+	return append( frame, msg->getMessageLength() );
+}
+
+uint64_t Journal::append(const char *frame, size_t length)
+{
+	if ( length > MAX_MSG_DATA )
+		throw std::domain_error( "exceeded maximum message size" );
+	if ( readonly )
+		throw std::logic_error( "journal is read only" );
+
+	std::lock_guard<std::mutex> guard( lock );
+
+	size_t rsize = recordSize( length );
+	if ( segments.back().written + rsize > segments.back().size )
+		rollover();
+
+	Segment &s = segments.back();
+	char *rec = s.map + s.written;
+	uint64_t seq = next_sequence;
+
+	boost::endian::little_uint32_buf_t len;
+	boost::endian::little_uint32_buf_t crc;
+	boost::endian::little_uint64_buf_t nseq;
+	boost::endian::little_uint64_buf_t ts;
+
+	nseq = seq;
+	ts = wallClock();
+	memcpy( rec + 8, &nseq, sizeof(nseq) );
+	memcpy( rec + 16, &ts, sizeof(ts) );
+	memcpy( rec + JOURNAL_RECORD_HEADER, frame, length );
+	crc = recordChecksum( rec, length );
+	memcpy( rec + 4, &crc, sizeof(crc) );
+
+	// the length goes in last so a reader never sees a partial record
+	len = (uint32_t) length;
+	memcpy( rec, &len, sizeof(len) );
+
+	s.offsets.push_back( (uint32_t) s.written );
+	s.written += rsize;
+	next_sequence++;
+
+	return ( seq );
+}
+
+void Journal::commit(void)
+{
+	if ( readonly )
+		throw std::logic_error( "journal is read only" );
+
+	std::unique_lock<std::mutex> lk( lock );
+	uint64_t target = next_sequence;
+
+	while ( synced < target )
+	{
+		if ( syncing )
+		{
+			// another caller is already syncing, its msync may cover us
+			synced_cv.wait( lk );
+			continue;
+		}
+
+		syncing = true;
+
+		Segment &s = segments.back();
+		char *base = s.map;
+		size_t page = sysconf( _SC_PAGESIZE );
+		size_t from = synced_offset & ~( page - 1 );
+		size_t to = s.written;
+		uint64_t upto = next_sequence;
+
+		lk.unlock();
+		int res = msync( base + from, to - from, MS_SYNC );
+		lk.lock();
+
+		syncing = false;
+		if ( res < 0 )
+		{
+			synced_cv.notify_all();
+			throw std::ios_base::failure( "Unable to commit journal" );
+		}
+
+		synced = std::max( synced, upto );
+		if ( segments.back().map == base )
+			synced_offset = std::max( synced_offset, to );
+		synced_cv.notify_all();
+	}
+}
+
+void Journal::acknowledge(uint64_t seq)
+{
+	if ( readonly )
+		throw std::logic_error( "journal is read only" );
+
+	std::lock_guard<std::mutex> guard( lock );
+	acknowledged = std::max( acknowledged, seq );
+}
+
+size_t Journal::replay(uint64_t from, ReplayCallback cb)
+{
+	std::lock_guard<std::mutex> guard( lock );
+	size_t count = 0;
+
+	for ( size_t i = 0; i < segments.size(); i++ )
+	{
+		Segment &s = segments[i];
+		uint64_t end = s.first_sequence + s.offsets.size();
+
+		for ( uint64_t seq = std::max( from, s.first_sequence ); seq < end; seq++ )
+		{
+			const char *rec = recordAt( i, seq );
+			boost::endian::little_uint32_buf_t len;
+			boost::endian::little_uint64_buf_t ts;
+			memcpy( &len, rec, sizeof(len) );
+			memcpy( &ts, rec + 16, sizeof(ts) );
+
+			cb( seq, ts.value(), rec + JOURNAL_RECORD_HEADER, len.value() );
+			count++;
+		}
+	}
+
+	return ( count );
+}
+
+uint64_t Journal::findSequence(uint64_t timestamp)
+{
+	std::lock_guard<std::mutex> guard( lock );
+
+	for ( size_t i = 0; i < segments.size(); i++ )
+	{
+		Segment &s = segments[i];
+		if ( s.offsets.empty() )
+			continue;
+
+		// timestamps are appended in order, binary search within the segment
+		size_t lo = 0, hi = s.offsets.size();
+		while ( lo < hi )
+		{
+			size_t mid = ( lo + hi ) / 2;
+			boost::endian::little_uint64_buf_t ts;
+			memcpy( &ts, s.map + s.offsets[mid] + 16, sizeof(ts) );
+			if ( ts.value() < timestamp )
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		if ( lo < s.offsets.size() )
+			return ( s.first_sequence + lo );
+	}
+
+	return ( next_sequence );
+}
+
+uint64_t Journal::getFirstSequence(void)
+{
+	std::lock_guard<std::mutex> guard( lock );
+	return ( segments.empty() ? next_sequence : segments.front().first_sequence );
+}
+
+uint64_t Journal::getNextSequence(void)
+{
+	std::lock_guard<std::mutex> guard( lock );
+	return ( next_sequence );
+}
+
+uint64_t Journal::getAcknowledged(void)
+{
+	std::lock_guard<std::mutex> guard( lock );
+	return ( acknowledged );
+}
+
+bool Journal::isReadOnly(void)
+{
+	return ( readonly );
+}
+
+/* private methods */
+
+void Journal::openDirectory(void)
+{
+	syncing = false;
+	acknowledged = 0;
+	synced = synced_offset = 0;
+
+	// segment files sort by the first sequence number encoded in their name
+	std::vector<std::pair<uint64_t, std::string>> found;
+	boost::filesystem::path dpath( directory );
+	for ( boost::filesystem::directory_iterator it( dpath ); it != boost::filesystem::directory_iterator(); it++ )
+	{
+		boost::filesystem::path p = it->path();
+		if ( p.extension() == JOURNAL_SUFFIX )
+			found.push_back( std::make_pair( std::stoull( p.stem().string() ), p.string() ) );
+	}
+	std::sort( found.begin(), found.end() );
+
+	for ( auto &f : found )
+		openSegment( f.second, false, f.first );
+
+	if ( segments.empty() )
+	{
+		next_sequence = 1;
+		if ( readonly )
+			return;
+		rollover();
+	}
+	else
+	{
+		Segment &last = segments.back();
+		next_sequence = last.first_sequence + last.offsets.size();
+	}
+
+	acknowledged = segments.front().first_sequence - 1;
+	synced = next_sequence;
+	synced_offset = segments.back().written;
+}
+
+void Journal::openSegment(const std::string &path, bool create, uint64_t first)
+{
+	Segment s;
+	s.path = path;
+	s.first_sequence = first;
+	s.written = JOURNAL_SEGMENT_HEADER;
+	s.size = segment_size;
+
+	int mode = readonly ? O_RDONLY : O_RDWR;
+	if ( ( s.fd = open( path.c_str(), mode | O_CLOEXEC | ( create ? O_CREAT | O_EXCL : 0 ), 0644 ) ) < 0 )
+		throw std::ios_base::failure( "Unable to open journal segment" );
+
+	if ( create )
+	{
+		// reserve the blocks now: writing a hole of a sparse file through the
+		// mapping on a full disk raises SIGBUS instead of failing
+		if ( posix_fallocate( s.fd, 0, segment_size ) != 0 )
+		{
+			close( s.fd );
+			unlink( path.c_str() );
+			throw std::ios_base::failure( "Unable to allocate journal segment" );
+		}
+		s.created = time( nullptr );
+	}
+	else
+	{
+		struct stat st;
+		if ( ( fstat( s.fd, &st ) < 0 ) || ( (size_t) st.st_size < JOURNAL_SEGMENT_HEADER ) )
+		{
+			close( s.fd );
+			throw std::ios_base::failure( "Invalid journal segment" );
+		}
+		if ( (uint64_t) st.st_size > UINT32_MAX )
+		{
+			close( s.fd );
+			throw std::ios_base::failure( "Journal segment over 4 GiB" );
+		}
+		// a segment recovered from disk keeps the size it was written with
+		s.size = st.st_size;
+		s.created = st.st_mtime;
+	}
+
+	int prot = readonly ? PROT_READ : PROT_READ | PROT_WRITE;
+	s.map = (char *) mmap( nullptr, s.size, prot, MAP_SHARED, s.fd, 0 );
+	if ( s.map == MAP_FAILED )
+	{
+		close( s.fd );
+		if ( create )
+			unlink( path.c_str() );
+		throw std::ios_base::failure( "Unable to map journal segment" );
+	}
+
+	if ( create )
+	{
+		boost::endian::little_uint64_buf_t nfirst;
+		nfirst = first;
+		memcpy( s.map, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC) );
+		memcpy( s.map + sizeof(JOURNAL_MAGIC), &nfirst, sizeof(nfirst) );
+	}
+	else
+	{
+		recoverSegment( s );
+	}
+
+	segments.push_back( s );
+}
+
+void Journal::recoverSegment(Segment &s)
+{
+	if ( memcmp( s.map, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC) ) != 0 )
+	{
+		closeSegment( s );
+		throw std::ios_base::failure( "Invalid journal segment" );
+	}
+
+	size_t off = JOURNAL_SEGMENT_HEADER;
+	while ( off + JOURNAL_RECORD_HEADER <= s.size )
+	{
+		boost::endian::little_uint32_buf_t len;
+		boost::endian::little_uint32_buf_t crc;
+		boost::endian::little_uint64_buf_t seq;
+		memcpy( &len, s.map + off, sizeof(len) );
+		memcpy( &crc, s.map + off + 4, sizeof(crc) );
+		memcpy( &seq, s.map + off + 8, sizeof(seq) );
+
+		if ( ( len.value() == 0 ) || ( len.value() > MAX_MSG_DATA ) ||
+				( off + recordSize( len.value() ) > s.size ) ||
+				( seq.value() != s.first_sequence + s.offsets.size() ) ||
+				( crc.value() != recordChecksum( s.map + off, len.value() ) ) )
+			break;
+
+		s.offsets.push_back( (uint32_t) off );
+		off += recordSize( len.value() );
+	}
+
+	// wipe a torn tail so stale records can never be mistaken for new ones;
+	// a reader leaves it to the writer, which may still be appending
+	s.written = off;
+	if ( !readonly )
+		memset( s.map + off, 0, s.size - off );
+}
+
+void Journal::closeSegment(Segment &s)
+{
+	if ( s.map && s.map != MAP_FAILED )
+		munmap( s.map, s.size );
+	if ( s.fd >= 0 )
+		close( s.fd );
+	s.map = nullptr;
+	s.fd = -1;
+}
+
+void Journal::rollover(void)
+{
+	// caller holds the lock
+	if ( !segments.empty() )
+	{
+		Segment &old = segments.back();
+		if ( msync( old.map, old.written, MS_SYNC ) < 0 )
+			throw std::ios_base::failure( "Unable to commit journal" );
+		synced = std::max( synced, next_sequence );
+	}
+
+	char name[32];
+	snprintf( name, sizeof(name), "%020llu", (unsigned long long) next_sequence );
+	boost::filesystem::path p( directory );
+	p /= std::string( name ) + JOURNAL_SUFFIX;
+
+	openSegment( p.string(), true, next_sequence );
+	synced_offset = 0;
+
+	// the new name must survive a crash as well as the records in it
+	syncDirectory();
+
+	enforceRetention();
+}
+
+void Journal::enforceRetention(void)
+{
+	// the leader of a group commit may still be syncing an older segment
+	if ( syncing )
+		return;
+
+	time_t now = time( nullptr );
+	bool removed = false;
+
+	while ( segments.size() > 1 )
+	{
+		Segment &s = segments.front();
+		uint64_t last = s.first_sequence + s.offsets.size() - 1;
+
+		if ( last > acknowledged )
+			break;
+		if ( ( segments.size() <= max_segments ) && ( (uint32_t)( now - s.created ) < max_age ) )
+			break;
+
+		closeSegment( s );
+		unlink( s.path.c_str() );
+		segments.erase( segments.begin() );
+		removed = true;
+	}
+
+	if ( removed )
+		syncDirectory();
+}
+
+void Journal::syncDirectory(void)
+{
+	int fd = open( directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+	if ( fd < 0 )
+		throw std::ios_base::failure( "Unable to open journal directory" );
+
+	int rc = fsync( fd );
+	close( fd );
+	if ( rc < 0 )
+		throw std::ios_base::failure( "Unable to commit journal directory" );
+}
+
+const char *Journal::recordAt(size_t segment, uint64_t sequence)
+{
+	Segment &s = segments[segment];
+	return ( s.map + s.offsets[sequence - s.first_sequence] );
+}
+
+} /* namespace kcmsg */
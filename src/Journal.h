@@ -0,0 +1,158 @@
+/*
+ * Journal.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#ifndef JOURNAL_H_
+#define JOURNAL_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+
+#include "Message.h"
+
+namespace kcmsg {
+
+const size_t DEFAULT_JOURNAL_SEGMENT_SIZE = 64 * 1024 * 1024;
+const size_t DEFAULT_JOURNAL_MAX_SEGMENTS = 16;
+const uint32_t DEFAULT_JOURNAL_MAX_AGE = 24 * 60 * 60;	// seconds
+
+/*
+ * Journal is an append-only store of encoded Message frames used for store
+ * and forward.  Frames are copied into memory mapped segment files named
+ * after the first sequence number they hold:
+ *
+ *     <directory>/00000000000000000001.journal
+ *
+ *                            RECORD FORMAT
+ *                            =============
+ *
+ *  | 00 01 02 03 | 04 05 06 07 | 08 .. 0F | 10 .. 17  | 18 ....         |
+ *  |   length    |   crc32     | sequence | timestamp | frame, padded  |
+ *
+ * Every field is little endian, the timestamp is nanoseconds since the epoch
+ * and records are aligned to 8 bytes.  A zero length ends the segment.
+ *
+ * append() only copies into the mapping.  commit() makes everything appended
+ * so far durable with msync(); concurrent callers of commit() are grouped so
+ * a single msync() covers all of them.  Opening an existing directory
+ * rebuilds the sequence index and discards a torn record at the tail.
+ * Existing segments keep the size they were written with, whatever the
+ * segment size given now; it applies to the segments made from then on.
+ * Record offsets are 32 bits, so a segment is at most 4 GiB.  A new
+ * segment's blocks are allocated when it is made, so a full disk fails
+ * that with std::ios_base::failure instead of a later write through the
+ * mapping raising SIGBUS.  The directory is synced whenever a segment is
+ * made or deleted.
+ *
+ * A journal opened read only, e.g. to replay a recording, changes nothing
+ * on disk: it may be another process's live journal or on read only media.
+ *
+ * A segment is deleted once every message in it is acknowledged and it is
+ * past the segment count or age retention limit.  Acknowledgements are not
+ * persisted, so after a restart every retained record is replayed and the
+ * receiver's DeduplicationWindow discards what it has already seen.
+ */
+class Journal {
+public:
+	typedef std::function<void(uint64_t sequence, uint64_t timestamp,
+			const char *frame, size_t length)> ReplayCallback;
+
+private:
+	struct Segment
+	{
+		std::string path;
+		int fd;
+		char *map;
+		size_t size;				// bytes mapped, the file size
+		uint64_t first_sequence;
+		uint64_t created;			// seconds since the epoch
+		size_t written;				// bytes used in the mapping
+		std::vector<uint32_t> offsets;	// record offset by (sequence - first_sequence)
+	};
+
+	std::string directory;
+	size_t segment_size;
+	size_t max_segments;
+	uint32_t max_age;
+	bool readonly;
+
+	std::vector<Segment> segments;
+	uint64_t next_sequence;
+	uint64_t acknowledged;
+	uint64_t synced;
+	size_t synced_offset;		// in the active segment
+	bool syncing;
+
+	std::mutex lock;
+	std::condition_variable synced_cv;
+
+	void openDirectory(void);
+	void openSegment(const std::string &path, bool create, uint64_t first);
+	void recoverSegment(Segment &s);
+	void closeSegment(Segment &s);
+	void rollover(void);
+	void enforceRetention(void);
+	void syncDirectory(void);
+	const char *recordAt(size_t segment, uint64_t sequence);
+
+public:
+	/*  Parameters
+	 *    dir:          directory holding the segment files, created if missing
+	 *    segsize:      bytes per segment file
+	 *    maxsegments:  acknowledged segments kept for replay
+	 *    maxage:       seconds an acknowledged segment is kept for replay
+	 *
+	 * Throws std::invalid_argument if 'segsize' cannot hold the largest
+	 * message or is over 4 GiB.
+	 */
+	Journal(std::string dir, size_t segsize, size_t maxsegments, uint32_t maxage);
+
+	/* Journal(dir) opens an existing journal read only.  Throws
+	 *          std::ios_base::failure if 'dir' is not a directory or a
+	 *          segment cannot be read.
+	 */
+	explicit Journal(std::string dir);
+	virtual ~Journal();
+
+	/* append() copies an encoded frame into the journal and returns its
+	 *          journal sequence number.  Throws std::ios_base::failure when
+	 *          the segment files cannot be created or mapped, and
+	 *          std::logic_error on a read only journal, as commit() and
+	 *          acknowledge() do.
+	 */
+	uint64_t append(kcmsg::Message *msg);
+	uint64_t append(const char *frame, size_t length);
+
+	/* commit() returns once every frame appended before the call is on disk */
+	void commit(void);
+
+	/* acknowledge() marks every sequence up to and including 'seq' delivered */
+	void acknowledge(uint64_t seq);
+
+	/* replay() calls 'cb' for every record from sequence 'from' onwards.
+	 *          The callback must not append to this journal.
+	 */
+	size_t replay(uint64_t from, ReplayCallback cb);
+
+	/* findSequence() returns the first sequence with a timestamp at or after
+	 *                'timestamp' (nanoseconds), or getNextSequence() if none.
+	 */
+	uint64_t findSequence(uint64_t timestamp);
+
+	uint64_t getFirstSequence(void);
+	uint64_t getNextSequence(void);
+	uint64_t getAcknowledged(void);
+	bool isReadOnly(void);
+};
+
+} /* namespace kcmsg */
+
+#endif /* JOURNAL_H_ */
@@ -31,8 +31,6 @@ namespace kcmsg {
  *  |trn_org|     ttl     | flags |msg_len|  user data ....
  *
  */
-const size_t MESSAGE_LENGTH_OFFSET = 0x18;
-
 const size_t HEADER_SOURCE_IDENT_OFFSET = 0x00;
 const size_t HEADER_SOURCE_ORGANIZATION_OFFSET = 0x04;
 const size_t HEADER_TARGET_IDENT_OFFSET = 0x06;
@@ -144,6 +142,28 @@ void Message::writeHeader(void)
 	memcpy(&data[HEADER_FLAGS_OFFSET], &flags, sizeof(flags));
 }
 
+void Message::resizeHeader(std::size_t from, std::size_t to)
+{
+	// moves the user data when the optional header fields come or go
+	if ( from == to )
+		return;
+
+	if ( data_length - from + to > MAX_MSG_DATA )
+		throw std::domain_error( "exceeded maximum message size" );
+
+	memmove( &data[to], &data[from], data_length - from );
+	if ( to > from )
+		memset( &data[from], 0, to - from );
+
+	if ( offset >= from )
+		offset = offset - from + to;
+
+	boost::endian::little_uint16_buf_t ndl;
+	data_length = data_length - from + to;
+	ndl = data_length;
+	memcpy(&data[MESSAGE_LENGTH_OFFSET], &ndl, sizeof(ndl));
+}
+
 void Message::readMessageLength(void)
 {
 	boost::endian::little_uint16_buf_t msg_len;
@@ -171,9 +191,10 @@ Message::Message()
 
 	// zero out the message space
 	memset(data, 0, maxdata);
+	memset(&hdr, 0, sizeof(hdr));
 
 	// set user data in message to end of message header
-	data_length = offset = (std::size_t) MESSAGE_LENGTH_OFFSET + 2;
+	data_length = offset = MESSAGE_HEADER_LENGTH;
 
 	// store the current length of the message, header plus a two byte length field
 	// into the data.  This forces message size max to not be greater than 64K
@@ -181,6 +202,17 @@ Message::Message()
 	memcpy(&data[MESSAGE_LENGTH_OFFSET], &ndl, sizeof(ndl));
 }
 
+void Message::clear(void)
+{
+	// the bytes past data_length are never read, only the header is reset
+	boost::endian::little_uint16_buf_t ndl;
+	memset(data, 0, MESSAGE_SESSION_OFFSET + 4);
+	memset(&hdr, 0, sizeof(hdr));
+	data_length = offset = MESSAGE_HEADER_LENGTH;
+	ndl = (boost::endian::little_uint16_buf_t) data_length;
+	memcpy(&data[MESSAGE_LENGTH_OFFSET], &ndl, sizeof(ndl));
+}
+
 Message::~Message()
 {
 	if ( data )
@@ -269,10 +301,15 @@ uint32_t Message::getTTL(void)
 
 void Message::setOnceAndOnlyOnce(bool val)
 {
+	size_t before = getHeaderLength();
+
 	if ( val )
 		hdr.flags = hdr.flags | MSG_FLAG_ONCE_AND_ONLY_ONCE;
 	else
 		hdr.flags = hdr.flags & ~MSG_FLAG_ONCE_AND_ONLY_ONCE;
+
+	// the sequence number is only on the wire for once-and-only-once messages
+	resizeHeader( before, getHeaderLength() );
 }
 
 bool Message::isOnceAndOnlyOnce(void)
@@ -306,11 +343,256 @@ bool Message::isMessageFragment(void)
 	return (hdr.flags & MSG_FLAG_FRAGMENT) > 0 ? true : false;
 }
 
+void Message::setControl(bool val)
+{
+	if ( val )
+		hdr.flags = hdr.flags | MSG_FLAG_CONTROL;
+	else
+		hdr.flags = hdr.flags & ~MSG_FLAG_CONTROL;
+}
+
+bool Message::isControl(void)
+{
+	return (hdr.flags & MSG_FLAG_CONTROL) > 0 ? true : false;
+}
+
+void Message::setReply(bool val)
+{
+	if ( val )
+		hdr.flags = hdr.flags | MSG_FLAG_REPLY;
+	else
+		hdr.flags = hdr.flags & ~MSG_FLAG_REPLY;
+}
+
+bool Message::isReply(void)
+{
+	return (hdr.flags & MSG_FLAG_REPLY) > 0 ? true : false;
+}
+
+void Message::setPriority(uint8_t val)
+{
+	hdr.flags = ( hdr.flags & ~MSG_FLAG_PRIORITY_MASK ) |
+			( ( (uint16_t) val << MSG_FLAG_PRIORITY_SHIFT ) & MSG_FLAG_PRIORITY_MASK );
+}
+
+uint8_t Message::getPriority(void)
+{
+	return (uint8_t) ( ( hdr.flags & MSG_FLAG_PRIORITY_MASK ) >> MSG_FLAG_PRIORITY_SHIFT );
+}
+
+void Message::setSequence(uint32_t val)
+{
+	hdr.sequence = val;
+}
+
+uint32_t Message::getSequence(void)
+{
+	return ( hdr.sequence );
+}
+
+void Message::setSession(uint32_t val)
+{
+	hdr.session = val;
+}
+
+uint32_t Message::getSession(void)
+{
+	return ( hdr.session );
+}
+
 size_t Message::getMessageLength(void)
 {
 	return ( data_length );
 }
 
+size_t Message::getHeaderLength(void)
+{
+	if ( hdr.flags & MSG_FLAG_ONCE_AND_ONLY_ONCE )
+		return ( MESSAGE_SESSION_OFFSET + sizeof(uint32_t) );
+
+	return ( MESSAGE_HEADER_LENGTH );
+}
+
+bool Message::hasMoreData(void)
+{
+	return ( offset < data_length );
+}
+
+const char *Message::serialize(void)
+{
+	writeHeader();
+
+	if ( hdr.flags & MSG_FLAG_ONCE_AND_ONLY_ONCE )
+	{
+		boost::endian::little_uint32_buf_t seq;
+		boost::endian::little_uint32_buf_t ses;
+		seq = hdr.sequence;
+		ses = hdr.session;
+		memcpy(&data[MESSAGE_SEQUENCE_OFFSET], &seq, sizeof(seq));
+		memcpy(&data[MESSAGE_SESSION_OFFSET], &ses, sizeof(ses));
+	}
+
+	return ( data );
+}
+
+void Message::deserialize(const char *frame, size_t length)
+{
+	if ( ( length < MESSAGE_HEADER_LENGTH ) || ( length > MAX_MSG_DATA ) )
+		throw std::domain_error( "invalid message frame length" );
+
+	memcpy(data, frame, length);
+	readMessageLength();
+	if ( data_length != length )
+		throw std::domain_error( "message frame length mismatch" );
+
+	readHeader();
+	hdr.sequence = 0;
+	hdr.session = 0;
+
+	if ( hdr.flags & MSG_FLAG_ONCE_AND_ONLY_ONCE )
+	{
+		if ( !sequenceOf( frame, length, hdr.session, hdr.sequence ) )
+			throw std::domain_error( "invalid message frame length" );
+	}
+
+	offset = getHeaderLength();
+}
+
+uint16_t Message::controlCode(const char *frame, size_t length)
+{
+	if ( length < MESSAGE_HEADER_LENGTH )
+		return ( 0 );
+
+	boost::endian::little_uint16_buf_t flags;
+	memcpy(&flags, &frame[HEADER_FLAGS_OFFSET], sizeof(flags));
+	if ( !( flags.value() & MSG_FLAG_CONTROL ) )
+		return ( 0 );
+
+	boost::endian::little_uint16_buf_t trans_id;
+	memcpy(&trans_id, &frame[HEADER_TRANSACTION_IDENT_OFFSET], sizeof(trans_id));
+	return ( trans_id.value() );
+}
+
+bool Message::targetOf(const char *frame, size_t length, uint16_t &org, uint32_t &ident)
+{
+	if ( length < MESSAGE_HEADER_LENGTH )
+		return ( false );
+
+	boost::endian::little_uint32_buf_t tgt_id;
+	boost::endian::little_uint16_buf_t tgt_org;
+	memcpy(&tgt_id, &frame[HEADER_TARGET_IDENT_OFFSET], sizeof(tgt_id));
+	memcpy(&tgt_org, &frame[HEADER_TARGET_ORGANIZATION_OFFSET], sizeof(tgt_org));
+	ident = tgt_id.value();
+	org = tgt_org.value();
+	return ( true );
+}
+
+bool Message::sourceOf(const char *frame, size_t length, uint16_t &org, uint32_t &ident)
+{
+	if ( length < MESSAGE_HEADER_LENGTH )
+		return ( false );
+
+	boost::endian::little_uint32_buf_t src_id;
+	boost::endian::little_uint16_buf_t src_org;
+	memcpy(&src_id, &frame[HEADER_SOURCE_IDENT_OFFSET], sizeof(src_id));
+	memcpy(&src_org, &frame[HEADER_SOURCE_ORGANIZATION_OFFSET], sizeof(src_org));
+	ident = src_id.value();
+	org = src_org.value();
+	return ( true );
+}
+
+bool Message::sequenceOf(const char *frame, size_t length, uint32_t &session, uint32_t &seq)
+{
+	if ( length < MESSAGE_SESSION_OFFSET + sizeof(uint32_t) )
+		return ( false );
+
+	boost::endian::little_uint16_buf_t flags;
+	memcpy(&flags, &frame[HEADER_FLAGS_OFFSET], sizeof(flags));
+	if ( !( flags.value() & MSG_FLAG_ONCE_AND_ONLY_ONCE ) )
+		return ( false );
+
+	boost::endian::little_uint32_buf_t s;
+	boost::endian::little_uint32_buf_t n;
+	memcpy(&s, &frame[MESSAGE_SESSION_OFFSET], sizeof(s));
+	memcpy(&n, &frame[MESSAGE_SEQUENCE_OFFSET], sizeof(n));
+	session = s.value();
+	seq = n.value();
+	return ( true );
+}
+
+uint16_t Message::transactionOf(const char *frame, size_t length)
+{
+	if ( length < MESSAGE_HEADER_LENGTH )
+		return ( 0 );
+
+	boost::endian::little_uint16_buf_t trans_id;
+	memcpy(&trans_id, &frame[HEADER_TRANSACTION_IDENT_OFFSET], sizeof(trans_id));
+	return ( trans_id.value() );
+}
+
+uint16_t Message::flagsOf(const char *frame, size_t length)
+{
+	if ( length < MESSAGE_HEADER_LENGTH )
+		return ( 0 );
+
+	boost::endian::little_uint16_buf_t flags;
+	memcpy(&flags, &frame[HEADER_FLAGS_OFFSET], sizeof(flags));
+	return ( flags.value() );
+}
+
+/* where the user data of an encoded frame of at least a header starts */
+static size_t dataOffsetOf(const char *frame)
+{
+	boost::endian::little_uint16_buf_t flags;
+	memcpy(&flags, &frame[HEADER_FLAGS_OFFSET], sizeof(flags));
+	return ( ( flags.value() & MSG_FLAG_ONCE_AND_ONLY_ONCE ) ? MESSAGE_SESSION_OFFSET + 4 : MESSAGE_HEADER_LENGTH );
+}
+
+/* reads the int at 'off' if it fits in 'length' and is tagged as one */
+static bool intAt(const char *frame, size_t length, size_t off, int32_t &val)
+{
+	boost::endian::little_int32_buf_t n;
+	if ( ( length < off + sizeof(DATA_TYPE) + sizeof(n) ) || ( (uint8_t) frame[off] != DATA_TYPE_INT ) )
+		return ( false );
+
+	memcpy(&n, &frame[off + sizeof(DATA_TYPE)], sizeof(n));
+	val = n.value();
+	return ( true );
+}
+
+uint32_t Message::creditGrant(const char *frame, size_t length)
+{
+	if ( controlCode( frame, length ) != MSG_CONTROL_CREDIT )
+		return ( 0 );
+
+	// read in place: a grant arrives for every few messages handled
+	int32_t n;
+	if ( !intAt( frame, length, dataOffsetOf( frame ), n ) )
+		return ( 0 );
+
+	return ( ( n > 0 ) ? (uint32_t) n : 0 );
+}
+
+bool Message::ackEntryOf(const char *frame, size_t length, size_t &offset, uint32_t &session, uint32_t &seq)
+{
+	if ( offset == 0 )
+	{
+		if ( controlCode( frame, length ) != MSG_CONTROL_ACK )
+			return ( false );
+		offset = dataOffsetOf( frame );
+	}
+
+	int32_t s, n;
+	size_t entry = sizeof(DATA_TYPE) + sizeof(s);
+	if ( !intAt( frame, length, offset, s ) || !intAt( frame, length, offset + entry, n ) )
+		return ( false );
+
+	session = (uint32_t) s;
+	seq = (uint32_t) n;
+	offset += 2 * entry;
+	return ( true );
+}
+
 void Message::debugMessageSerialize(std::string fo)
 {
 	FILE *fd;
@@ -349,6 +631,14 @@ void Message::debugMessagePrint(void)
 	std::cout << "        <is_once>" << ((isOnceAndOnlyOnce())?"true":"false") << "</is_once>" << std::endl;
 	std::cout << "        <is_quick_death>" << ((isQuickDeath())?"true":"false") << "</is_quick_death>" << std::endl;
 	std::cout << "        <is_fragment>" << ((isMessageFragment())?"true":"false") << "</is_fragment>" << std::endl;
+	std::cout << "        <priority>" << (int) getPriority() << "</priority>" << std::endl;
+	std::cout << "        <is_control>" << ((isControl())?"true":"false") << "</is_control>" << std::endl;
+	std::cout << "        <is_reply>" << ((isReply())?"true":"false") << "</is_reply>" << std::endl;
+	if ( isOnceAndOnlyOnce() )
+	{
+		std::cout << "        <sequence>" << getSequence() << "</sequence>" << std::endl;
+		std::cout << "        <session>" << getSession() << "</session>" << std::endl;
+	}
 	std::cout << "    </header>" << std::endl;
 	std::cout << "    <data>" << std::endl;
 
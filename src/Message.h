@@ -20,6 +20,33 @@ const uint32_t MAX_MSG_DATA = 0xFFFF; // 64K Bytes Maximum Message Data Size
 const uint16_t MSG_FLAG_ONCE_AND_ONLY_ONCE = 1<<0;
 const uint16_t MSG_FLAG_QUICK_DEATH = 1<<1;
 const uint16_t MSG_FLAG_FRAGMENT = 1<<2;
+const uint16_t MSG_FLAG_CONTROL = 1<<3;
+const uint16_t MSG_FLAG_PRIORITY_MASK = 3<<4;	// two bit priority class
+const int MSG_FLAG_PRIORITY_SHIFT = 4;
+const uint16_t MSG_FLAG_REPLY = 1<<6;		// answers a request, see RpcChannel
+
+/* Priority classes, stored in the MSG_FLAG_PRIORITY_MASK bits of flags */
+const uint8_t MSG_PRIORITY_NORMAL = 0x00;
+const uint8_t MSG_PRIORITY_BULK = 0x01;
+const uint8_t MSG_PRIORITY_HIGH = 0x02;
+const uint8_t MSG_PRIORITY_URGENT = 0x03;
+
+/* Control message codes carried in transaction_ident when MSG_FLAG_CONTROL is set */
+const uint16_t MSG_CONTROL_ACK = 0x0001;
+const uint16_t MSG_CONTROL_PING = 0x0002;	// liveness probe, answered with MSG_CONTROL_PONG
+const uint16_t MSG_CONTROL_PONG = 0x0003;
+const uint16_t MSG_CONTROL_CREDIT = 0x0004;	// receiver grants the sender more messages, see creditGrant()
+
+/*
+ * Layout constants.  Once-and-only-once messages carry a 32 bit sequence
+ * number and the 32 bit session of the sender that numbered them
+ * immediately after the length field, so their user data starts at
+ * MESSAGE_SESSION_OFFSET + 4 instead of MESSAGE_HEADER_LENGTH.
+ */
+const size_t MESSAGE_LENGTH_OFFSET = 0x18;
+const size_t MESSAGE_HEADER_LENGTH = 0x1A;
+const size_t MESSAGE_SEQUENCE_OFFSET = 0x1A;
+const size_t MESSAGE_SESSION_OFFSET = 0x1E;
 
 struct MessageHeader
 {
@@ -32,6 +59,8 @@ struct MessageHeader
 	uint16_t transaction_organization;   // target organization identifier
 	uint32_t ttl;                   // time to live in seconds
 	uint16_t flags;
+	uint32_t sequence;              // once-and-only-once sequence number
+	uint32_t session;               // sender session the sequence belongs to
 };
 
 class Message {
@@ -44,6 +73,7 @@ private:
 	void readHeader(void);
 	void writeHeader(void);
 	void updateMessageLength(std::size_t delta);
+	void resizeHeader(std::size_t from, std::size_t to);
 
 //	void readMessage(void);
 //	void writeMessage(void);
@@ -58,8 +88,68 @@ public:
 	Message();
 	virtual ~Message();
 
+	/* clear() empties the message for reuse, without the cost of a new one */
+	void clear(void);
+
 	void readMessageLength(void);
 
+	/* serialize() writes the header fields into the message buffer and returns
+	 *             a pointer to the complete encoded frame of getMessageLength()
+	 *             bytes.  The pointer is valid until the message is modified.
+	 * deserialize() loads a complete encoded frame, e.g. one read off a socket,
+	 *             and positions the data offset at the first user data element.
+	 */
+	const char *serialize(void);
+	void deserialize(const char *frame, size_t length);
+
+	/* controlCode() reads the control code of an encoded frame without
+	 *               decoding it.  Returns 0 if the frame is not a control
+	 *               message.
+	 */
+	static uint16_t controlCode(const char *frame, size_t length);
+
+	/* targetOf() reads the target organization and identifier of an encoded
+	 *            frame, or of just its header, without decoding it.  Returns
+	 *            false if 'length' is shorter than a header.
+	 */
+	static bool targetOf(const char *frame, size_t length, uint16_t &org, uint32_t &ident);
+
+	/* sourceOf() reads the source organization and identifier of an encoded
+	 *            frame without decoding it.  Returns false if 'length' is
+	 *            shorter than a header.
+	 * sequenceOf() reads the session and sequence number of an encoded
+	 *            once-and-only-once frame.  Returns false for any other
+	 *            frame.
+	 */
+	static bool sourceOf(const char *frame, size_t length, uint16_t &org, uint32_t &ident);
+	static bool sequenceOf(const char *frame, size_t length, uint32_t &session, uint32_t &seq);
+
+	/* transactionOf() reads the transaction identifier of an encoded frame
+	 *                 without decoding it; 0 if 'length' is shorter than a
+	 *                 header.
+	 */
+	static uint16_t transactionOf(const char *frame, size_t length);
+
+	/* flagsOf() reads the flags of an encoded frame without decoding it; 0
+	 *           if 'length' is shorter than a header.
+	 */
+	static uint16_t flagsOf(const char *frame, size_t length);
+
+	/* creditGrant() returns the number of messages an MSG_CONTROL_CREDIT
+	 *               frame grants, carried as its one int, or 0 for any
+	 *               other frame.
+	 */
+	static uint32_t creditGrant(const char *frame, size_t length);
+
+	/* ackEntryOf() reads the next session and sequence number an
+	 *              MSG_CONTROL_ACK frame acknowledges, starting with
+	 *              'offset' 0, and moves 'offset' past them.  Returns false
+	 *              after the last one or for any other frame.
+	 */
+	static bool ackEntryOf(const char *frame, size_t length, size_t &offset, uint32_t &session, uint32_t &seq);
+	size_t getHeaderLength(void);
+	bool hasMoreData(void);
+
 	void setSourceIdentifier(uint32_t id);
 	uint32_t getSourceIdentifier(void);
 	void setSourceOrganization(uint16_t id);
@@ -82,6 +172,16 @@ public:
 	bool isQuickDeath(void);
 	void setMessageFragment(bool val);
 	bool isMessageFragment(void);
+	void setControl(bool val);
+	bool isControl(void);
+	void setReply(bool val);
+	bool isReply(void);
+	void setPriority(uint8_t val);
+	uint8_t getPriority(void);
+	void setSequence(uint32_t val);
+	uint32_t getSequence(void);
+	void setSession(uint32_t val);
+	uint32_t getSession(void);
 	size_t getMessageLength(void);
 
 	void putBool(bool val);
@@ -0,0 +1,350 @@
+/*
+ * OutboundQueue.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#include "OutboundQueue.h"
+
+#include <stdexcept>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+namespace kcmsg {
+
+/* weighted lanes in round robin order */
+const uint8_t WEIGHTED_LANES[] = { MSG_PRIORITY_HIGH, MSG_PRIORITY_NORMAL, MSG_PRIORITY_BULK };
+const int WEIGHTED_LANE_COUNT = 3;
+
+OutboundQueue::OutboundQueue()
+{
+	for ( int i = 0; i < OUTBOUND_LANES; i++ )
+	{
+		lanes[i].weight = 1;
+		lanes[i].deficit = 0;
+		lanes[i].credited = false;
+	}
+
+	lanes[MSG_PRIORITY_HIGH].weight = 8;
+	lanes[MSG_PRIORITY_NORMAL].weight = 4;
+	lanes[MSG_PRIORITY_BULK].weight = 1;
+
+	round_robin = 0;
+	staged_sent = 0;
+	queued_frames = 0;
+	queued_bytes = 0;
+	cork_depth = DEFAULT_CORK_DEPTH;
+	corked = false;
+	high_bytes = low_bytes = 0;
+	high_frames = low_frames = 0;
+	over_high = false;
+	resumed_flag = false;
+}
+
+OutboundQueue::~OutboundQueue() {
+
+}
+
+void OutboundQueue::push(kcmsg::Message *msg)
+{
+	const char *frame = msg->serialize();
+	push( frame, msg->getMessageLength(), msg->getPriority() );
+}
+
+void OutboundQueue::push(const char *frame, size_t length, uint8_t priority)
+{
+	if ( priority >= OUTBOUND_LANES )
+		throw std::invalid_argument( "invalid message priority" );
+
+	std::lock_guard<std::mutex> guard( lock );
+	lanes[priority].frames.emplace_back( frame, frame + length );
+	queued_frames++;
+	queued_bytes += length;
+
+	if ( ( high_bytes && ( queued_bytes >= high_bytes ) ) || ( high_frames && ( queued_frames >= high_frames ) ) )
+		over_high = true;
+}
+
+const char *OutboundQueue::front(size_t &length)
+{
+	std::lock_guard<std::mutex> guard( lock );
+
+	if ( staged.empty() && !selectNext() )
+	{
+		length = 0;
+		return ( nullptr );
+	}
+
+	length = staged.front().size() - staged_sent;
+	return ( staged.front().data() + staged_sent );
+}
+
+int OutboundQueue::gather(iovec *iov, int max)
+{
+	std::lock_guard<std::mutex> guard( lock );
+	size_t nbytes = 0;
+	int n = 0;
+
+	while ( ( n < max ) && ( nbytes < OUTBOUND_GATHER_BYTES ) )
+	{
+		if ( ( (size_t) n >= staged.size() ) && !selectNext() )
+			break;
+
+		std::vector<char> &f = staged[n];
+		size_t skip = ( n == 0 ) ? staged_sent : 0;
+		iov[n].iov_base = f.data() + skip;
+		iov[n].iov_len = f.size() - skip;
+		nbytes += iov[n].iov_len;
+		n++;
+	}
+
+	return ( n );
+}
+
+void OutboundQueue::consume(size_t nbytes)
+{
+	std::lock_guard<std::mutex> guard( lock );
+
+	queued_bytes -= nbytes;
+	while ( nbytes && !staged.empty() )
+	{
+		size_t left = staged.front().size() - staged_sent;
+		if ( nbytes < left )
+		{
+			staged_sent += nbytes;
+			break;
+		}
+
+		nbytes -= left;
+		staged.pop_front();
+		staged_sent = 0;
+		queued_frames--;
+	}
+
+	if ( over_high && ( queued_bytes <= low_bytes || !high_bytes ) && ( queued_frames <= low_frames || !high_frames ) )
+	{
+		over_high = false;
+		resumed_flag = true;
+	}
+}
+
+size_t OutboundQueue::writeTo(int fd, uint64_t *syscalls)
+{
+	iovec iov[OUTBOUND_IOV_MAX];
+	size_t total, nbatch;
+	ssize_t nwritten;
+	int cnt;
+
+	total = 0;
+
+	while( ( cnt = gather( iov, OUTBOUND_IOV_MAX ) ) > 0 )
+	{
+		if( wantCork( true ) )
+			setCork( fd, true, syscalls );
+
+		nbatch = 0;
+		for( int i = 0; i < cnt; i++ )
+			nbatch += iov[i].iov_len;
+
+		if( syscalls )
+			(*syscalls)++;
+
+		if( ( nwritten = writev( fd, iov, cnt ) ) <= 0 )
+		{
+			if( nwritten < 0 && errno == EINTR )
+			{
+				continue;
+			} else if( nwritten < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+			{
+				break;
+			} else
+			{
+				return (-1);
+			}
+		}
+
+		consume( nwritten );
+		total += nwritten;
+
+		if( (size_t) nwritten < nbatch )
+			break;	// socket buffer full, the next writev() would only say EAGAIN
+	}
+
+	if( wantCork( false ) )
+		setCork( fd, false, syscalls );
+
+	return ( total );
+}
+
+void OutboundQueue::setWeight(uint8_t priority, uint32_t weight)
+{
+	if ( ( priority >= OUTBOUND_LANES ) || ( weight == 0 ) )
+		throw std::invalid_argument( "invalid lane weight" );
+
+	std::lock_guard<std::mutex> guard( lock );
+	lanes[priority].weight = weight;
+}
+
+void OutboundQueue::setCorkDepth(size_t frames)
+{
+	std::lock_guard<std::mutex> guard( lock );
+	cork_depth = frames;
+}
+
+void OutboundQueue::clear(void)
+{
+	std::lock_guard<std::mutex> guard( lock );
+
+	for ( int i = 0; i < OUTBOUND_LANES; i++ )
+	{
+		lanes[i].frames.clear();
+		lanes[i].deficit = 0;
+		lanes[i].credited = false;
+	}
+
+	staged.clear();
+	staged_sent = 0;
+	queued_frames = 0;
+	queued_bytes = 0;
+	corked = false;
+	over_high = false;
+	resumed_flag = false;
+}
+
+void OutboundQueue::setWatermarks(size_t highbytes, size_t lowbytes, size_t highframes, size_t lowframes)
+{
+	if ( ( highbytes && ( lowbytes > highbytes ) ) || ( highframes && ( lowframes > highframes ) ) )
+		throw std::invalid_argument( "low watermark above high watermark" );
+
+	std::lock_guard<std::mutex> guard( lock );
+	high_bytes = highbytes;
+	low_bytes = lowbytes;
+	high_frames = highframes;
+	low_frames = lowframes;
+	over_high = ( high_bytes && ( queued_bytes >= high_bytes ) ) || ( high_frames && ( queued_frames >= high_frames ) );
+}
+
+bool OutboundQueue::overHighWatermark(void)
+{
+	std::lock_guard<std::mutex> guard( lock );
+	return ( over_high );
+}
+
+bool OutboundQueue::resumed(void)
+{
+	std::lock_guard<std::mutex> guard( lock );
+	bool r = resumed_flag;
+	resumed_flag = false;
+	return ( r );
+}
+
+bool OutboundQueue::empty(void)
+{
+	std::lock_guard<std::mutex> guard( lock );
+	return ( queued_frames == 0 );
+}
+
+size_t OutboundQueue::depth(void)
+{
+	std::lock_guard<std::mutex> guard( lock );
+	return ( queued_frames );
+}
+
+size_t OutboundQueue::bytes(void)
+{
+	std::lock_guard<std::mutex> guard( lock );
+	return ( queued_bytes );
+}
+
+/* private methods */
+
+bool OutboundQueue::selectNext(void)
+{
+	// caller holds the lock
+	Lane &urgent = lanes[MSG_PRIORITY_URGENT];
+	if ( !urgent.frames.empty() )
+	{
+		staged.emplace_back();
+		staged.back().swap( urgent.frames.front() );
+		urgent.frames.pop_front();
+		return ( true );
+	}
+
+	bool pending = false;
+	for ( int i = 0; i < WEIGHTED_LANE_COUNT; i++ )
+		pending = pending || !lanes[WEIGHTED_LANES[i]].frames.empty();
+	if ( !pending )
+		return ( false );
+
+	// deficit round robin; terminates because a non-empty lane gains credit
+	for (;;)
+	{
+		Lane &l = lanes[WEIGHTED_LANES[round_robin]];
+
+		if ( l.frames.empty() )
+		{
+			l.deficit = 0;
+			l.credited = false;
+			round_robin = ( round_robin + 1 ) % WEIGHTED_LANE_COUNT;
+			continue;
+		}
+
+		if ( l.deficit >= l.frames.front().size() )
+		{
+			l.deficit -= l.frames.front().size();
+			staged.emplace_back();
+			staged.back().swap( l.frames.front() );
+			l.frames.pop_front();
+			return ( true );
+		}
+
+		if ( !l.credited )
+		{
+			l.deficit += (uint64_t) l.weight * DEFAULT_LANE_QUANTUM;
+			l.credited = true;
+		}
+		else
+		{
+			l.credited = false;
+			round_robin = ( round_robin + 1 ) % WEIGHTED_LANE_COUNT;
+		}
+	}
+}
+
+void OutboundQueue::setCork(int fd, bool on, uint64_t *syscalls)
+{
+	int val = on ? 1 : 0;
+
+	if( syscalls )
+		(*syscalls)++;
+
+	// the system call is made unlocked, a push() need not wait for it
+	bool refused = ( setsockopt( fd, IPPROTO_TCP, TCP_CORK, &val, sizeof(val) ) < 0 );
+
+	std::lock_guard<std::mutex> guard( lock );
+	if( refused )
+	{
+		// not TCP: never try again
+		cork_depth = 0;
+		corked = false;
+		return;
+	}
+
+	corked = on;
+}
+
+bool OutboundQueue::wantCork(bool on)
+{
+	std::lock_guard<std::mutex> guard( lock );
+
+	if( on )
+		return ( cork_depth && !corked && ( queued_frames >= cork_depth ) );
+
+	return ( corked && ( queued_frames == 0 ) );
+}
+
+} /* namespace kcmsg */
@@ -0,0 +1,140 @@
+/*
+ * OutboundQueue.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#ifndef OUTBOUNDQUEUE_H_
+#define OUTBOUNDQUEUE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <sys/uio.h>
+
+#include "Message.h"
+
+namespace kcmsg {
+
+const int OUTBOUND_LANES = 4;				// one lane per priority class
+const uint32_t DEFAULT_LANE_QUANTUM = 4096;	// bytes credited per weight unit
+const int OUTBOUND_IOV_MAX = 1024;			// segments per writev(), within IOV_MAX
+const size_t OUTBOUND_GATHER_BYTES = 256 * 1024;	// bytes staged per writev()
+const size_t DEFAULT_CORK_DEPTH = 64;		// queued frames that turn TCP_CORK on
+
+/*
+ * OutboundQueue holds encoded frames waiting to be written to a Connection,
+ * one lane per message priority class.
+ *
+ * MSG_PRIORITY_URGENT is served strictly first.  The HIGH, NORMAL and BULK
+ * lanes share the link by deficit round robin: each visit credits a lane with
+ * weight * DEFAULT_LANE_QUANTUM bytes and the lane sends frames while its
+ * credit covers them.  The default weights are 8:4:1.
+ *
+ * Scheduling is per frame.  A frame that is partly written stays in front
+ * until it is finished, but the next frame is chosen again afterwards, so
+ * urgent frames go out between the fragments of a large transfer.
+ *
+ * writeTo() gathers the scheduled frames into one writev() of up to
+ * OUTBOUND_IOV_MAX segments or OUTBOUND_GATHER_BYTES, so a busy connection
+ * issues one system call per batch rather than one per frame.  Frames are
+ * scheduled when a batch is gathered; an urgent frame pushed later waits
+ * for that batch only.  While the queue is deeper than the cork depth the
+ * socket is corked, so the kernel sends full segments, and it is uncorked
+ * as soon as the queue drains.
+ *
+ * Optional high and low watermarks, in bytes and in frames, let a producer
+ * see a slow consumer coming.  The queue is over its high watermark from
+ * the push() that reaches either high mark until consume() has taken it
+ * down to both low marks; push() itself never refuses a frame.
+ */
+class OutboundQueue {
+private:
+	struct Lane
+	{
+		std::deque<std::vector<char>> frames;
+		uint32_t weight;
+		uint64_t deficit;
+		bool credited;
+	};
+
+	Lane lanes[OUTBOUND_LANES];
+	int round_robin;
+	std::deque<std::vector<char>> staged;	// scheduled frames, in write order
+	size_t staged_sent;						// bytes of the first one written
+	size_t queued_frames;
+	size_t queued_bytes;
+	size_t cork_depth;
+	bool corked;
+	size_t high_bytes;		// 0: no watermark on that measure
+	size_t low_bytes;
+	size_t high_frames;
+	size_t low_frames;
+	bool over_high;
+	bool resumed_flag;		// fell to the low marks since resumed() was last asked
+	std::mutex lock;
+
+	bool selectNext(void);
+	void setCork(int fd, bool on, uint64_t *syscalls);
+	bool wantCork(bool on);
+
+public:
+	OutboundQueue();
+	virtual ~OutboundQueue();
+
+	/* push() copies the encoded frame into the lane for its priority class */
+	void push(kcmsg::Message *msg);
+	void push(const char *frame, size_t length, uint8_t priority);
+
+	/* front() returns the unwritten bytes of the frame to send next, or
+	 *         nullptr when the queue is empty.
+	 * gather() fills 'iov' with the unwritten bytes of up to 'max' frames in
+	 *         send order and returns the number of segments.
+	 * consume() records that 'nbytes' were written from the front, which
+	 *         may finish several frames.
+	 *
+	 * The memory behind front() and gather() stays put until consume(), so
+	 * it can be handed to the kernel for an asynchronous send.
+	 */
+	const char *front(size_t &length);
+	int gather(iovec *iov, int max);
+	void consume(size_t nbytes);
+
+	/* writeTo() writes queued frames to 'fd' until the queue is empty or the
+	 *           descriptor would block.  Returns the number of bytes written
+	 *           or -1 on error, with errno set.  If 'syscalls' is given it is
+	 *           incremented once per system call issued.
+	 */
+	size_t writeTo(int fd, uint64_t *syscalls = nullptr);
+
+	void setWeight(uint8_t priority, uint32_t weight);
+
+	/* setCorkDepth() sets the queue depth in frames at which writeTo() corks
+	 *                the socket; 0 never corks.
+	 */
+	void setCorkDepth(size_t frames);
+
+	/* setWatermarks() sets the high and low marks in bytes and frames; a
+	 *                 high mark of 0 disables that measure.  Throws
+	 *                 std::invalid_argument if a low mark is above its high
+	 *                 mark.
+	 * overHighWatermark() is true from reaching a high mark until drained
+	 *                 to the low marks.
+	 * resumed() returns true once after the queue dropped from over the
+	 *                 high watermark to the low marks.
+	 */
+	void setWatermarks(size_t highbytes, size_t lowbytes, size_t highframes = 0, size_t lowframes = 0);
+	bool overHighWatermark(void);
+	bool resumed(void);
+	void clear(void);
+	bool empty(void);
+	size_t depth(void);
+	size_t bytes(void);
+};
+
+} /* namespace kcmsg */
+
+#endif /* OUTBOUNDQUEUE_H_ */
@@ -0,0 +1,135 @@
+/*
+ * ReceiveBuffer.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#include "ReceiveBuffer.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <boost/endian/buffers.hpp>
+
+namespace kcmsg {
+
+ReceiveBuffer::ReceiveBuffer(size_t size)
+{
+	if ( size < MAX_MSG_DATA )
+		throw std::invalid_argument( "receive buffer smaller than a frame" );
+
+	capacity = size;
+	head = tail = 0;
+}
+
+ReceiveBuffer::~ReceiveBuffer() {
+
+}
+
+size_t ReceiveBuffer::frameLength(const char *buf, size_t length)
+{
+	if ( length < MESSAGE_HEADER_LENGTH )
+		return ( 0 );
+
+	boost::endian::little_uint16_buf_t flen;
+	memcpy( &flen, buf + MESSAGE_LENGTH_OFFSET, sizeof(flen) );
+
+	if ( flen.value() < MESSAGE_HEADER_LENGTH )
+		return (-1);
+
+	return ( ( length < flen.value() ) ? 0 : flen.value() );
+}
+
+ssize_t ReceiveBuffer::fill(int fd)
+{
+	if ( buffer.empty() )
+		buffer.resize( capacity );
+
+	compact();
+
+	if ( tail == capacity )
+	{
+		errno = ENOBUFS;	// the caller has not taken the frames already here
+		return (-1);
+	}
+
+	ssize_t n;
+	do
+	{
+		n = recv( fd, buffer.data() + tail, capacity - tail, 0 );
+	} while ( ( n < 0 ) && ( errno == EINTR ) );
+
+	if ( n > 0 )
+		tail += n;
+
+	return ( n );
+}
+
+size_t ReceiveBuffer::append(const char *data, size_t length)
+{
+	if ( buffer.empty() )
+		buffer.resize( capacity );
+
+	compact();
+
+	size_t n = std::min( length, capacity - tail );
+	memcpy( buffer.data() + tail, data, n );
+	tail += n;
+
+	return ( n );
+}
+
+const char *ReceiveBuffer::next(size_t &length)
+{
+	size_t flen = frameLength( buffer.data() + head, tail - head );
+
+	if ( flen == (size_t) -1 )
+		throw std::domain_error( "message framing lost" );
+
+	if ( flen == 0 )
+	{
+		length = 0;
+		return ( nullptr );
+	}
+
+	const char *frame = buffer.data() + head;
+	head += flen;
+	if ( head == tail )
+		head = tail = 0;	// drained: the next fill() starts at the front for free
+
+	length = flen;
+	return ( frame );
+}
+
+size_t ReceiveBuffer::pending(void)
+{
+	return ( tail - head );
+}
+
+size_t ReceiveBuffer::space(void)
+{
+	return ( capacity - ( tail - head ) );
+}
+
+void ReceiveBuffer::clear(void)
+{
+	head = tail = 0;
+}
+
+/* private methods */
+
+void ReceiveBuffer::compact(void)
+{
+	// only when a maximum size frame might no longer fit behind the data
+	if ( ( head == 0 ) || ( capacity - tail >= MAX_MSG_DATA ) )
+		return;
+
+	memmove( buffer.data(), buffer.data() + head, tail - head );
+	tail -= head;
+	head = 0;
+}
+
+} /* namespace kcmsg */
@@ -0,0 +1,76 @@
+/*
+ * ReceiveBuffer.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#ifndef RECEIVEBUFFER_H_
+#define RECEIVEBUFFER_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <sys/types.h>
+
+#include "Message.h"
+
+namespace kcmsg {
+
+const size_t DEFAULT_RECEIVE_BUFFER_SIZE = 128 * 1024;	// two maximum size frames
+
+/*
+ * ReceiveBuffer splits a byte stream into message frames.  fill() reads as
+ * much as the socket holds into the free space with one recv(), then next()
+ * hands out every complete frame as a view into the buffer, using the
+ * 16 bit length at MESSAGE_LENGTH_OFFSET.  A partial frame stays behind for
+ * the next fill().
+ *
+ * The buffer never grows: it is allocated on the first fill() and its
+ * capacity, at least one maximum size frame, bounds the memory a connection
+ * holds.  Unread bytes are moved to the front only when the free space at
+ * the end drops below one maximum size frame, so each frame is copied at
+ * most once.  Views stay valid until the next fill() or clear().
+ */
+class ReceiveBuffer {
+private:
+	std::vector<char> buffer;
+	size_t capacity;
+	size_t head;		// first unread byte
+	size_t tail;		// end of received data
+
+	void compact(void);
+
+public:
+	ReceiveBuffer(size_t size = DEFAULT_RECEIVE_BUFFER_SIZE);
+	virtual ~ReceiveBuffer();
+
+	/* frameLength() returns the length of the frame at 'buf' if all of it is
+	 *               in the 'length' bytes, 0 if more bytes are needed, or -1
+	 *               if the length field is invalid and framing is lost.
+	 */
+	static size_t frameLength(const char *buf, size_t length);
+
+	/* fill() does one recv() into the free space.  Returns the bytes read,
+	 *        0 on orderly shutdown, or -1 with errno set (EAGAIN on an empty
+	 *        non-blocking socket, ENOBUFS if the buffer is full of frames
+	 *        next() has not returned yet).
+	 * append() adds bytes received by other means.  Returns the number of
+	 *        bytes that fit.
+	 */
+	ssize_t fill(int fd);
+	size_t append(const char *data, size_t length);
+
+	/* next() returns the next complete frame, or nullptr if none is buffered.
+	 *        Throws std::domain_error if the stream lost its framing.
+	 */
+	const char *next(size_t &length);
+
+	size_t pending(void);		// bytes received but not yet returned by next()
+	size_t space(void);			// bytes the next fill() may read
+	void clear(void);
+};
+
+} /* namespace kcmsg */
+
+#endif /* RECEIVEBUFFER_H_ */
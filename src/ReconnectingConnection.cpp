@@ -0,0 +1,507 @@
+/*
+ * ReconnectingConnection.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#include "ReconnectingConnection.h"
+#include "Resolver.h"
+
+#include <ios>
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+namespace kcmsg {
+
+/* Connections are shared with a reader that may still be inside recv(), so
+ * the descriptor is only closed when the last user lets go of it
+ */
+static void closeConnection(kcmsg::Connection *c)
+{
+	c->Close( c->getDescriptor() );
+	delete c;
+}
+
+ReconnectingConnection::ReconnectingConnection(sa_family_t fam, const std::string &h, const std::string &s,
+		kcmsg::Resolver *res)
+	: jitter( std::random_device()() ),
+	  retransmits( RETRANSMIT_CAPACITY, RETRANSMIT_TIMEOUT, RETRANSMIT_ATTEMPTS )
+{
+	if ( ( fam == AF_UNSPEC ) && ( res == nullptr ) )
+		throw std::invalid_argument( "AF_UNSPEC needs a Resolver" );
+
+	family = fam;
+	host = h;
+	service = s;
+	resolver = res;
+	queued_bytes = 0;
+	max_messages = RECONNECT_QUEUE_MESSAGES;
+	max_bytes = RECONNECT_QUEUE_BYTES;
+	backoff_min = RECONNECT_BACKOFF_MIN;
+	backoff_max = RECONNECT_BACKOFF_MAX;
+	backoff = backoff_min;
+	connect_timeout = RECONNECT_CONNECT_TIMEOUT;
+	write_timeout = RECONNECT_WRITE_TIMEOUT;
+	next_attempt = 0;
+	dropped = 0;
+	reconnects = 0;
+	stopping = false;
+
+	worker = std::thread( &ReconnectingConnection::workerMain, this );
+}
+
+ReconnectingConnection::~ReconnectingConnection()
+{
+	{
+		std::lock_guard<std::mutex> guard( lock );
+		stopping = true;
+		if ( conn )
+			shutdown( conn->getDescriptor(), SHUT_RDWR );
+	}
+	wake.notify_all();
+	connected.notify_all();
+	worker.join();
+}
+
+void ReconnectingConnection::setBackoff(uint32_t min_ms, uint32_t max_ms)
+{
+	if ( ( min_ms == 0 ) || ( max_ms < min_ms ) )
+		throw std::invalid_argument( "invalid reconnect backoff" );
+
+	std::lock_guard<std::mutex> guard( lock );
+	backoff_min = min_ms;
+	backoff_max = max_ms;
+	backoff = min_ms;
+}
+
+void ReconnectingConnection::setConnectTimeout(uint32_t ms)
+{
+	std::lock_guard<std::mutex> guard( lock );
+	connect_timeout = ms;
+}
+
+void ReconnectingConnection::setWriteTimeout(uint32_t ms)
+{
+	std::lock_guard<std::mutex> guard( lock );
+	write_timeout = ms;
+}
+
+void ReconnectingConnection::setQueueLimits(size_t messages, size_t bytes)
+{
+	std::lock_guard<std::mutex> guard( lock );
+	max_messages = messages;
+	max_bytes = bytes;
+}
+
+void ReconnectingConnection::setStateCallback(StateCallback cb)
+{
+	std::lock_guard<std::mutex> guard( lock );
+	on_state = cb;
+}
+
+size_t ReconnectingConnection::WriteMessage(kcmsg::Message *msg)
+{
+	{
+		std::lock_guard<std::mutex> guard( lock );
+
+		// numbered before it is written or queued, so every copy the peer
+		// may see carries the same number; a quick death message about to
+		// be dropped is not, or the worker would resend it later
+		if ( msg->isOnceAndOnlyOnce() && ( conn || !msg->isQuickDeath() ) )
+		{
+			if ( retransmits.isFull() )
+			{
+				dropped++;
+				errno = ENOBUFS;
+				return (-1);
+			}
+			retransmits.track( msg );
+			if ( retransmits.pending() == 1 )
+				wake.notify_all();		// the worker starts watching for overdue acks
+		}
+
+		if ( !conn )
+		{
+			size_t length = msg->getMessageLength();
+			return ( enqueue( msg ) ? length : -1 );
+		}
+	}
+
+	const char *frame = msg->serialize();
+	size_t length = msg->getMessageLength();
+
+	// 'writing' orders whole frames on the socket; 'lock' is only held to
+	// look at the link, so a slow peer holds up writers, not readers or
+	// the worker
+	std::lock_guard<std::mutex> order( writing );
+	std::unique_lock<std::mutex> guard( lock );
+
+	while ( conn )
+	{
+		std::shared_ptr<kcmsg::Connection> c = conn;
+		uint32_t timeout = write_timeout;
+		guard.unlock();
+		bool sent = sendFrame( c->getDescriptor(), frame, length, timeout );
+		guard.lock();
+
+		if ( sent )
+			return ( length );
+		if ( conn != c )
+			continue;		// the link was replaced meanwhile, try the new one
+
+		StateCallback cb = on_state;
+		markDown( c );
+		bool queued = enqueue( msg );
+		int err = errno;
+		guard.unlock();
+		if ( cb )
+			cb( false );
+		errno = err;
+		return ( queued ? length : -1 );
+	}
+
+	return ( enqueue( msg ) ? length : -1 );
+}
+
+size_t ReconnectingConnection::ReadMessage(kcmsg::Message *msg, size_t nbytes, uint32_t wait)
+{
+	std::shared_ptr<kcmsg::Connection> c;
+	{
+		std::unique_lock<std::mutex> guard( lock );
+		connected.wait_for( guard, std::chrono::milliseconds( wait ), [this] { return ( conn || stopping ); } );
+		c = conn;
+	}
+
+	if ( !c )
+	{
+		errno = ENOTCONN;
+		return (-1);
+	}
+
+	size_t n;
+	while ( ( ( n = c->ReadMessage( msg, nbytes ) ) != 0 ) && ( n != (size_t) -1 ) )
+	{
+		if ( !msg->isControl() || ( msg->getTransactionIdentifier() != MSG_CONTROL_ACK ) )
+			return ( n );
+
+		std::lock_guard<std::mutex> guard( lock );
+		retransmits.acknowledge( msg );
+	}
+
+	if ( ( n == (size_t) -1 ) && ( ( errno == EMSGSIZE ) || ( errno == EPROTO ) ) )
+	{
+		// the link is fine but this stream is not usable any more: start over
+		int err = errno;
+		shutdown( c->getDescriptor(), SHUT_RDWR );
+		errno = err;
+	}
+
+	StateCallback cb;
+	bool was_current;
+	{
+		std::lock_guard<std::mutex> guard( lock );
+		was_current = ( conn == c );
+		if ( was_current )
+		{
+			cb = on_state;
+			markDown( c );
+		}
+	}
+	if ( was_current && cb )
+		cb( false );
+
+	errno = ENOTCONN;
+	return (-1);
+}
+
+bool ReconnectingConnection::waitConnected(uint32_t ms)
+{
+	std::unique_lock<std::mutex> guard( lock );
+	return connected.wait_for( guard, std::chrono::milliseconds( ms ), [this] { return ( conn != nullptr ); } );
+}
+
+bool ReconnectingConnection::isConnected(void)
+{
+	std::lock_guard<std::mutex> guard( lock );
+	return ( conn != nullptr );
+}
+
+size_t ReconnectingConnection::queuedCount(void)
+{
+	std::lock_guard<std::mutex> guard( lock );
+	return ( queue.size() );
+}
+
+uint64_t ReconnectingConnection::getDroppedCount(void)
+{
+	std::lock_guard<std::mutex> guard( lock );
+	return ( dropped );
+}
+
+uint64_t ReconnectingConnection::getReconnectCount(void)
+{
+	std::lock_guard<std::mutex> guard( lock );
+	return ( reconnects );
+}
+
+/* private methods */
+
+std::shared_ptr<kcmsg::Connection> ReconnectingConnection::open(void)
+{
+	// with a Resolver ConnectAny() may swap in a socket of the other family
+	sa_family_t fam = ( family == AF_UNSPEC ) ? AF_INET6 : family;
+	std::shared_ptr<kcmsg::Connection> c( new kcmsg::Connection( fam, SOCK_STREAM, IPPROTO_TCP, 1,
+			"kcmsg.reconnect" ), closeConnection );
+
+	try
+	{
+		if ( resolver )
+		{
+			std::vector<kcmsg::addr_storage> addrs;
+			if ( ( resolver->resolveNow( host, service, family, SOCK_STREAM, addrs ) != 0 ) || addrs.empty() )
+				return ( nullptr );
+			c->ConnectAny( addrs, connect_timeout );
+		}
+		else
+		{
+			c->resolveHost( host, service );
+			c->Connect( connect_timeout );
+		}
+	}
+	catch ( std::ios_base::failure &e )
+	{
+		return ( nullptr );
+	}
+
+	return ( c );
+}
+
+bool ReconnectingConnection::replay(std::unique_lock<std::mutex> &guard, kcmsg::Connection *c)
+{
+	// the link is not published yet, so nothing else writes to it; messages
+	// queued while a batch is sent are picked up by the next round
+	for ( ;; )
+	{
+		purgeExpired( now() );
+		if ( queue.empty() )
+			return ( true );
+
+		std::deque<Pending> batch;
+		batch.swap( queue );
+		for ( Pending &p : batch )
+			queued_bytes -= p.frame.size();
+		uint32_t timeout = write_timeout;
+
+		guard.unlock();
+		size_t done = 0;
+		while ( ( done < batch.size() ) &&
+				sendFrame( c->getDescriptor(), batch[done].frame.data(), batch[done].frame.size(), timeout ) )
+			done++;
+		guard.lock();
+
+		if ( done < batch.size() )
+		{
+			// keep the rest, ahead of anything queued meanwhile, for the next link
+			for ( size_t i = batch.size(); i > done; i-- )
+			{
+				queued_bytes += batch[i - 1].frame.size();
+				queue.push_front( std::move( batch[i - 1] ) );
+			}
+			return ( false );
+		}
+	}
+}
+
+bool ReconnectingConnection::sendFrame(int fd, const char *frame, size_t length, uint32_t timeout)
+{
+	uint64_t deadline = now() + timeout;
+	size_t off = 0;
+
+	while ( off < length )
+	{
+		ssize_t n = ::send( fd, frame + off, length - off, MSG_NOSIGNAL | MSG_DONTWAIT );
+		if ( n > 0 )
+		{
+			off += n;
+			continue;
+		}
+		if ( ( n < 0 ) && ( errno == EINTR ) )
+			continue;
+		if ( ( n == 0 ) || ( ( errno != EAGAIN ) && ( errno != EWOULDBLOCK ) ) )
+			return ( false );
+
+		// a peer that stopped reading is as good as gone
+		uint64_t t = now();
+		pollfd p = { fd, POLLOUT, 0 };
+		if ( ( t >= deadline ) || ( ( poll( &p, 1, (int) ( deadline - t ) ) == 0 ) ) )
+		{
+			errno = ETIMEDOUT;
+			return ( false );
+		}
+	}
+
+	return ( true );
+}
+
+bool ReconnectingConnection::enqueue(kcmsg::Message *msg)
+{
+	if ( msg->isQuickDeath() )
+	{
+		dropped++;
+		errno = ENOTCONN;
+		return ( false );
+	}
+
+	const char *frame = msg->serialize();
+	size_t length = msg->getMessageLength();
+	uint64_t t = now();
+
+	if ( ( queue.size() >= max_messages ) || ( queued_bytes + length > max_bytes ) )
+		purgeExpired( t );
+	if ( ( queue.size() >= max_messages ) || ( queued_bytes + length > max_bytes ) )
+	{
+		dropped++;
+		errno = ENOBUFS;
+		return ( false );
+	}
+
+	Pending p;
+	p.frame.assign( frame, frame + length );
+	p.expires = msg->getTTL() ? t + (uint64_t) msg->getTTL() * 1000 : 0;
+	queue.push_back( std::move( p ) );
+	queued_bytes += length;
+	return ( true );
+}
+
+void ReconnectingConnection::resend(std::unique_lock<std::mutex> &guard)
+{
+	std::vector<std::vector<char>> overdue;
+	retransmits.retransmit( [&overdue](const char *frame, size_t length)
+		{
+			overdue.push_back( std::vector<char>( frame, frame + length ) );
+		} );
+	if ( overdue.empty() )
+		return;
+
+	// written between whole frames of the writers, as WriteMessage() does
+	guard.unlock();
+	std::lock_guard<std::mutex> order( writing );
+	guard.lock();
+
+	std::shared_ptr<kcmsg::Connection> c = conn;
+	if ( !c )
+		return;		// kept by the queue, resent once the link is back
+	uint32_t timeout = write_timeout;
+
+	guard.unlock();
+	bool sent = true;
+	for ( size_t i = 0; sent && ( i < overdue.size() ); i++ )
+		sent = sendFrame( c->getDescriptor(), overdue[i].data(), overdue[i].size(), timeout );
+	guard.lock();
+
+	if ( sent || ( conn != c ) )
+		return;
+
+	StateCallback cb = on_state;
+	markDown( c );
+	guard.unlock();
+	if ( cb )
+		cb( false );
+	guard.lock();
+}
+
+void ReconnectingConnection::purgeExpired(uint64_t t)
+{
+	for ( auto it = queue.begin(); it != queue.end(); )
+	{
+		if ( ( it->expires == 0 ) || ( it->expires > t ) )
+		{
+			++it;
+			continue;
+		}
+		queued_bytes -= it->frame.size();
+		it = queue.erase( it );
+		dropped++;
+	}
+}
+
+void ReconnectingConnection::markDown(const std::shared_ptr<kcmsg::Connection> &failed)
+{
+	// wake a reader still blocked on the old link; the last holder closes it
+	shutdown( failed->getDescriptor(), SHUT_RDWR );
+	conn.reset();
+	next_attempt = now();		// the first retry is immediate, backoff applies after
+	wake.notify_all();
+}
+
+void ReconnectingConnection::workerMain(void)
+{
+	std::unique_lock<std::mutex> guard( lock );
+
+	while ( !stopping )
+	{
+		if ( conn )
+		{
+			if ( retransmits.pending() == 0 )
+			{
+				wake.wait( guard );
+			}
+			else
+			{
+				wake.wait_for( guard, std::chrono::milliseconds( RETRANSMIT_TIMEOUT ) );
+				if ( conn && !stopping )
+					resend( guard );
+			}
+			continue;
+		}
+
+		uint64_t t = now();
+		if ( t < next_attempt )
+		{
+			wake.wait_for( guard, std::chrono::milliseconds( next_attempt - t ) );
+			continue;
+		}
+
+		guard.unlock();
+		std::shared_ptr<kcmsg::Connection> c = open();
+		guard.lock();
+
+		if ( stopping )
+			break;
+
+		if ( !c || !replay( guard, c.get() ) )
+		{
+			// half to all of the current step, then double the step
+			std::uniform_int_distribution<uint32_t> spread( backoff / 2, backoff );
+			next_attempt = now() + spread( jitter );
+			backoff = std::min( backoff_max, backoff * 2 );
+			continue;
+		}
+
+		conn = c;
+		backoff = backoff_min;
+		reconnects++;
+		connected.notify_all();
+
+		StateCallback cb = on_state;
+		guard.unlock();
+		if ( cb )
+			cb( true );
+		guard.lock();
+	}
+}
+
+uint64_t ReconnectingConnection::now(void)
+{
+	timespec ts;
+	clock_gettime( CLOCK_MONOTONIC_COARSE, &ts );
+	return ( (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000 );
+}
+
+} /* namespace kcmsg */
@@ -0,0 +1,171 @@
+/*
+ * ReconnectingConnection.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#ifndef RECONNECTINGCONNECTION_H_
+#define RECONNECTINGCONNECTION_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <random>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "Connection.h"
+#include "RetransmitQueue.h"
+
+namespace kcmsg {
+
+class Resolver;
+
+const uint32_t RECONNECT_BACKOFF_MIN = 100;			// ms before the first retry
+const uint32_t RECONNECT_BACKOFF_MAX = 30000;		// ms the retry interval grows to
+const uint32_t RECONNECT_CONNECT_TIMEOUT = 5000;	// ms per connect attempt
+const uint32_t RECONNECT_WRITE_TIMEOUT = 5000;		// ms a frame may take to write
+const size_t RECONNECT_QUEUE_MESSAGES = 4096;		// messages held while disconnected
+const size_t RECONNECT_QUEUE_BYTES = 16 * 1024 * 1024;
+
+/*
+ * ReconnectingConnection is a stream Connection to one destination that
+ * survives the peer going away.
+ *
+ * When a write or read fails, the link is marked down and a worker thread
+ * reconnects, waiting an exponentially growing interval between attempts,
+ * from the minimum up to the maximum backoff, each drawn at random between
+ * half and all of the current step so many clients that lost the same
+ * server do not come back in lock step.  With a Resolver the host is
+ * looked up again on every attempt and its addresses are raced with
+ * Connection::ConnectAny().
+ *
+ * While the link is down WriteMessage() keeps the encoded frames in a
+ * bounded queue and replays them in order, ahead of any new message, once
+ * the link is back.  Messages marked quick death are worth nothing late
+ * and are dropped instead of queued.  A queued message whose ttl (seconds,
+ * 0 for none) runs out before the replay is dropped then.  When the queue
+ * is full, expired messages are purged first and a message that still
+ * does not fit is refused.
+ *
+ * A message being written when the link fails is queued again, so the
+ * peer may see it twice, and messages the kernel accepted before the
+ * failure was noticed are gone with the old socket; reading notices a
+ * closed peer sooner than writing does.  Where that matters, send
+ * once-and-only-once messages to a peer with a DeduplicationWindow: they
+ * are numbered by a RetransmitQueue that keeps one session for the life of
+ * the ReconnectingConnection, so a replayed copy carries the number the
+ * peer has seen, and they are kept until acknowledged.  The worker resends
+ * those whose ack is overdue, which recovers the ones lost with a socket.
+ * Acks arrive on the read side, so ReadMessage() must be called; it takes
+ * them and does not return them.
+ *
+ * Frames are written with MSG_NOSIGNAL, so a peer that vanishes does not
+ * raise SIGPIPE.  A frame that cannot be written within the write timeout
+ * marks the link down like any other failure, so a peer that stops
+ * reading does not hold writers forever.  WriteMessage() may be called
+ * from any number of threads and ReadMessage() from one thread at the
+ * same time; writers wait for each other, not for the reader, the replay
+ * or the state queries.
+ */
+class ReconnectingConnection {
+public:
+	/* called on the worker thread with true when the link comes up, and on
+	 * the failing thread with false when it goes down
+	 */
+	typedef std::function<void(bool up)> StateCallback;
+
+private:
+	struct Pending
+	{
+		std::vector<char> frame;
+		uint64_t expires;		// 0 never
+	};
+
+	sa_family_t family;
+	std::string host;
+	std::string service;
+	kcmsg::Resolver *resolver;
+
+	std::shared_ptr<kcmsg::Connection> conn;	// nullptr while down
+	std::deque<Pending> queue;
+	size_t queued_bytes;
+	size_t max_messages;
+	size_t max_bytes;
+
+	uint32_t backoff_min;
+	uint32_t backoff_max;
+	uint32_t backoff;			// current step
+	uint32_t connect_timeout;
+	uint32_t write_timeout;
+	uint64_t next_attempt;
+	std::mt19937 jitter;
+
+	uint64_t dropped;
+	uint64_t reconnects;
+	StateCallback on_state;
+
+	std::mutex lock;
+	std::mutex writing;		// taken before 'lock', held while a frame is written
+	std::condition_variable wake;
+	std::condition_variable connected;
+	std::thread worker;
+	bool stopping;
+	kcmsg::RetransmitQueue retransmits;	// numbers once-and-only-once messages
+
+	std::shared_ptr<kcmsg::Connection> open(void);
+	bool replay(std::unique_lock<std::mutex> &guard, kcmsg::Connection *c);
+	static bool sendFrame(int fd, const char *frame, size_t length, uint32_t timeout);
+	bool enqueue(kcmsg::Message *msg);
+	void resend(std::unique_lock<std::mutex> &guard);
+	void purgeExpired(uint64_t t);
+	void markDown(const std::shared_ptr<kcmsg::Connection> &failed);
+	void workerMain(void);
+	static uint64_t now(void);
+
+public:
+	/* fam is AF_INET or AF_INET6, or AF_UNSPEC with a Resolver to race
+	 * both.  Connecting starts at once, on the worker thread.
+	 */
+	ReconnectingConnection(sa_family_t fam, const std::string &host, const std::string &service,
+			kcmsg::Resolver *res = nullptr);
+	virtual ~ReconnectingConnection();
+
+	void setBackoff(uint32_t min_ms, uint32_t max_ms);
+	void setConnectTimeout(uint32_t ms);
+	void setWriteTimeout(uint32_t ms);
+	void setQueueLimits(size_t messages, size_t bytes);
+	void setStateCallback(StateCallback cb);
+
+	/* WriteMessage() writes the message, or queues it while the link is
+	 *                down.  Returns the message length, or -1 with errno
+	 *                ENOTCONN for a quick death message that was dropped
+	 *                and ENOBUFS when the queue is full, or when
+	 *                RETRANSMIT_CAPACITY once-and-only-once messages are
+	 *                waiting for their acks.
+	 * ReadMessage() reads the next message as Connection::ReadMessage()
+	 *                does, waiting for the link if it is down.  Returns -1
+	 *                with errno ENOTCONN if the link failed during the read
+	 *                or 'wait' ms passed without one.
+	 */
+	size_t WriteMessage(kcmsg::Message *msg);
+	size_t ReadMessage(kcmsg::Message *msg, size_t nbytes, uint32_t wait = RECONNECT_BACKOFF_MAX);
+
+	/* waitConnected() waits up to 'ms' for the link; returns true if up */
+	bool waitConnected(uint32_t ms);
+	bool isConnected(void);
+
+	size_t queuedCount(void);
+	uint64_t getDroppedCount(void);
+	uint64_t getReconnectCount(void);
+};
+
+} /* namespace kcmsg */
+
+#endif /* RECONNECTINGCONNECTION_H_ */
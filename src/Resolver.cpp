@@ -0,0 +1,255 @@
+/*
+ * Resolver.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE		// EAI_CANCELED
+#endif
+
+#include "Resolver.h"
+
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+#include <iterator>
+#include <netdb.h>
+#include <netinet/in.h>
+
+namespace kcmsg {
+
+Resolver::Resolver(int nthreads)
+{
+	positive_ttl = RESOLVER_POSITIVE_TTL;
+	negative_ttl = RESOLVER_NEGATIVE_TTL;
+	stopping = false;
+	hits = misses = 0;
+
+	if ( nthreads < 1 )
+		nthreads = 1;
+	for ( int i = 0; i < nthreads; i++ )
+		threads.push_back( std::thread( &Resolver::resolverMain, this ) );
+}
+
+Resolver::~Resolver()
+{
+	{
+		std::lock_guard<std::mutex> guard( lock );
+		stopping = true;
+		ready.notify_all();
+	}
+	for ( auto &t : threads )
+		t.join();
+
+	// the threads are gone, so nothing else touches 'waiting'
+	std::vector<kcmsg::addr_storage> none;
+	for ( auto &w : waiting )
+		for ( auto &cb : w.second )
+			cb( EAI_CANCELED, none );
+	waiting.clear();
+	queries.clear();
+}
+
+void Resolver::setPositiveTTL(uint32_t ms)
+{
+	positive_ttl = ms;
+}
+
+void Resolver::setNegativeTTL(uint32_t ms)
+{
+	negative_ttl = ms;
+}
+
+void Resolver::resolve(const std::string &host, const std::string &service, sa_family_t fam, int socktype,
+		ResolveCallback cb)
+{
+	std::string key = makeKey( host, service, fam, socktype );
+	std::vector<kcmsg::addr_storage> addrs;
+	int error;
+
+	{
+		std::lock_guard<std::mutex> guard( lock );
+
+		if ( !fromCache( key, error, addrs ) )
+		{
+			std::vector<ResolveCallback> &w = waiting[key];
+			w.push_back( cb );
+			if ( w.size() == 1 )
+			{
+				Query q = { key, host, service, fam, socktype };
+				queries.push_back( q );
+				ready.notify_one();
+			}
+			return;
+		}
+	}
+
+	cb( error, addrs );
+}
+
+int Resolver::resolveNow(const std::string &host, const std::string &service, sa_family_t fam, int socktype,
+		std::vector<kcmsg::addr_storage> &addrs)
+{
+	std::string key = makeKey( host, service, fam, socktype );
+	int error;
+
+	{
+		std::lock_guard<std::mutex> guard( lock );
+		if ( fromCache( key, error, addrs ) )
+			return ( error );
+	}
+
+	Query q = { key, host, service, fam, socktype };
+	error = lookup( q, addrs );
+
+	std::lock_guard<std::mutex> guard( lock );
+	store( key, error, addrs );
+	return ( error );
+}
+
+void Resolver::flush(void)
+{
+	std::lock_guard<std::mutex> guard( lock );
+	cache.clear();
+}
+
+uint64_t Resolver::getHitCount(void)
+{
+	std::lock_guard<std::mutex> guard( lock );
+	return ( hits );
+}
+
+uint64_t Resolver::getMissCount(void)
+{
+	std::lock_guard<std::mutex> guard( lock );
+	return ( misses );
+}
+
+/* private methods */
+
+std::string Resolver::makeKey(const std::string &host, const std::string &service, sa_family_t fam, int socktype)
+{
+	return ( std::to_string( fam ) + "/" + std::to_string( socktype ) + "/" + host + "/" + service );
+}
+
+int Resolver::lookup(const Query &q, std::vector<kcmsg::addr_storage> &addrs)
+{
+	addrinfo hints, *result;
+	memset( &hints, 0, sizeof(hints) );
+	hints.ai_flags = AI_ADDRCONFIG;
+	hints.ai_family = q.family;
+	hints.ai_socktype = q.socktype;
+
+	addrs.clear();
+	int res = getaddrinfo( q.host.c_str(), q.service.c_str(), &hints, &result );
+	if ( res != 0 )
+		return ( res );
+
+	for ( addrinfo *ai = result; ai != nullptr; ai = ai->ai_next )
+	{
+		if ( ( ai->ai_family != AF_INET ) && ( ai->ai_family != AF_INET6 ) )
+			continue;
+
+		kcmsg::addr_storage a = {0};
+		a.length = std::min( (size_t) ai->ai_addrlen, sizeof(a.addr) );
+		memcpy( a.addr, ai->ai_addr, a.length );
+		a.port = ntohs( ( ai->ai_family == AF_INET6 ) ? ( (sockaddr_in6 *) ai->ai_addr )->sin6_port
+				: ( (sockaddr_in *) ai->ai_addr )->sin_port );
+		addrs.push_back( a );
+	}
+
+	freeaddrinfo( result );
+	return ( addrs.empty() ? EAI_NODATA : 0 );
+}
+
+bool Resolver::fromCache(const std::string &key, int &error, std::vector<kcmsg::addr_storage> &addrs)
+{
+	auto it = cache.find( key );
+	if ( ( it == cache.end() ) || ( it->second.expires <= now() ) )
+	{
+		misses++;
+		return ( false );
+	}
+
+	hits++;
+	error = it->second.error;
+	addrs = it->second.addrs;
+	return ( true );
+}
+
+void Resolver::store(const std::string &key, int error, const std::vector<kcmsg::addr_storage> &addrs)
+{
+	uint32_t ttl;
+
+	switch ( error )
+	{
+	case 0 :
+		ttl = positive_ttl;
+		break;
+	case EAI_NONAME :
+	case EAI_NODATA :
+	case EAI_SERVICE :
+		ttl = negative_ttl;
+		break;
+	default:
+		return;		// temporary or local failure, the next lookup may well succeed
+	}
+
+	if ( ttl == 0 )
+		return;
+
+	uint64_t t = now();
+	if ( ( cache.size() >= RESOLVER_CACHE_MAX ) && ( cache.find( key ) == cache.end() ) )
+	{
+		for ( auto it = cache.begin(); it != cache.end(); )
+			it = ( it->second.expires <= t ) ? cache.erase( it ) : std::next( it );
+		if ( cache.size() >= RESOLVER_CACHE_MAX )
+			cache.clear();
+	}
+
+	Entry &e = cache[key];
+	e.error = error;
+	e.addrs = addrs;
+	e.expires = t + ttl;
+}
+
+void Resolver::resolverMain(void)
+{
+	for (;;)
+	{
+		Query q;
+		{
+			std::unique_lock<std::mutex> guard( lock );
+			ready.wait( guard, [this]() { return ( stopping || !queries.empty() ); } );
+			if ( stopping )
+				return;
+			q = queries.front();
+			queries.pop_front();
+		}
+
+		std::vector<kcmsg::addr_storage> addrs;
+		int error = lookup( q, addrs );
+
+		std::vector<ResolveCallback> callbacks;
+		{
+			std::lock_guard<std::mutex> guard( lock );
+			store( q.key, error, addrs );
+			callbacks.swap( waiting[q.key] );
+			waiting.erase( q.key );
+		}
+
+		for ( auto &cb : callbacks )
+			cb( error, addrs );
+	}
+}
+
+uint64_t Resolver::now(void)
+{
+	timespec ts;
+	clock_gettime( CLOCK_MONOTONIC_COARSE, &ts );
+	return ( (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000 );
+}
+
+} /* namespace kcmsg */
@@ -0,0 +1,119 @@
+/*
+ * Resolver.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#ifndef RESOLVER_H_
+#define RESOLVER_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <sys/socket.h>
+
+#include "Connection.h"
+
+namespace kcmsg {
+
+const int RESOLVER_THREADS = 2;					// concurrent getaddrinfo() calls
+const uint32_t RESOLVER_POSITIVE_TTL = 60000;	// ms a resolved name is served from the cache
+const uint32_t RESOLVER_NEGATIVE_TTL = 5000;	// ms a name that does not exist is cached as missing
+const size_t RESOLVER_CACHE_MAX = 4096;			// cached names
+
+/*
+ * Resolver looks up host names off the calling thread, so a loop or a
+ * request path never blocks in getaddrinfo().
+ *
+ * A small pool of threads runs the lookups.  Concurrent requests for the
+ * same name share one lookup.  Results are cached: every address the name
+ * has, in the order getaddrinfo() preferred them, for the positive TTL, and
+ * answers that the name or service does not exist for the shorter negative
+ * TTL.  Temporary failures such as EAI_AGAIN are never cached.
+ * getaddrinfo() does not report record TTLs, so the lifetimes are the
+ * resolver's own.
+ *
+ * Callbacks run on a resolver thread, or on the calling thread when the
+ * answer is cached.  An EventLoop user posts the result back to the loop.
+ * Every callback runs exactly once: lookups still queued when the Resolver
+ * is destroyed complete with EAI_CANCELED, on the destroying thread.
+ */
+class Resolver {
+public:
+	/* error is 0 or an EAI_ code, see gai_strerror() */
+	typedef std::function<void(int error, const std::vector<kcmsg::addr_storage> &addrs)> ResolveCallback;
+
+private:
+	struct Entry
+	{
+		int error;
+		std::vector<kcmsg::addr_storage> addrs;
+		uint64_t expires;
+	};
+
+	struct Query
+	{
+		std::string key;
+		std::string host;
+		std::string service;
+		sa_family_t family;
+		int socktype;
+	};
+
+	uint32_t positive_ttl;
+	uint32_t negative_ttl;
+
+	std::mutex lock;
+	std::condition_variable ready;
+	std::unordered_map<std::string, Entry> cache;
+	std::unordered_map<std::string, std::vector<ResolveCallback>> waiting;	// lookups in flight
+	std::deque<Query> queries;
+	std::vector<std::thread> threads;
+	bool stopping;
+
+	uint64_t hits;
+	uint64_t misses;
+
+	static std::string makeKey(const std::string &host, const std::string &service, sa_family_t fam, int socktype);
+	static int lookup(const Query &q, std::vector<kcmsg::addr_storage> &addrs);
+	bool fromCache(const std::string &key, int &error, std::vector<kcmsg::addr_storage> &addrs);
+	void store(const std::string &key, int error, const std::vector<kcmsg::addr_storage> &addrs);
+	void resolverMain(void);
+	static uint64_t now(void);
+
+public:
+	Resolver(int nthreads = RESOLVER_THREADS);
+	virtual ~Resolver();
+
+	void setPositiveTTL(uint32_t ms);
+	void setNegativeTTL(uint32_t ms);
+
+	/* resolve() looks up host and service for family 'fam' (AF_UNSPEC for
+	 *           both IPv4 and IPv6) and socket type 'socktype' and passes
+	 *           every address found to 'cb'.
+	 */
+	void resolve(const std::string &host, const std::string &service, sa_family_t fam, int socktype,
+			ResolveCallback cb);
+
+	/* resolveNow() is the blocking form for threads that may wait; it still
+	 *              goes through the cache.  Returns 0 or an EAI_ code.
+	 */
+	int resolveNow(const std::string &host, const std::string &service, sa_family_t fam, int socktype,
+			std::vector<kcmsg::addr_storage> &addrs);
+
+	void flush(void);
+	uint64_t getHitCount(void);
+	uint64_t getMissCount(void);
+};
+
+} /* namespace kcmsg */
+
+#endif /* RESOLVER_H_ */
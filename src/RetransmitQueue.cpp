@@ -0,0 +1,177 @@
+/*
+ * RetransmitQueue.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#include "RetransmitQueue.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <ctime>
+#include <random>
+
+namespace kcmsg {
+
+RetransmitQueue::RetransmitQueue(size_t capacity, uint32_t timeout, uint32_t attempts)
+{
+	size_t p = 1;
+	while ( p < capacity )
+		p <<= 1;
+
+	slots.resize( p );
+	for ( auto &s : slots )
+	{
+		s.sequence = 0;
+		s.in_use = false;
+		s.attempts = 0;
+		s.deadline = 0;
+	}
+
+	slot_mask = p - 1;
+	next_sequence = oldest_sequence = 1;
+	outstanding = 0;
+	this->timeout = timeout;
+	max_attempts = ( attempts == 0 ) ? 1 : attempts;
+	abandoned = 0;
+
+	do
+	{
+		session = std::random_device()();
+	} while ( session == 0 );
+}
+
+RetransmitQueue::~RetransmitQueue() {
+
+}
+
+uint32_t RetransmitQueue::track(kcmsg::Message *msg)
+{
+	if ( isFull() )
+		throw std::domain_error( "retransmit window full" );
+
+	uint32_t seq = next_sequence++;
+	Slot &s = slots[seq & slot_mask];
+
+	msg->setOnceAndOnlyOnce( true );
+	msg->setSequence( seq );
+	msg->setSession( session );
+
+	const char *frame = msg->serialize();
+	s.frame.assign( frame, frame + msg->getMessageLength() );
+	s.sequence = seq;
+	s.in_use = true;
+	s.attempts = 1;
+	s.deadline = now() + timeout;
+	outstanding++;
+
+	return ( seq );
+}
+
+void RetransmitQueue::acknowledge(uint32_t seq)
+{
+	Slot &s = slots[seq & slot_mask];
+
+	if ( !s.in_use || ( s.sequence != seq ) )
+		return;		// duplicate or stale ack
+
+	s.in_use = false;
+	outstanding--;
+	advance();
+}
+
+void RetransmitQueue::acknowledge(kcmsg::Message *ack)
+{
+	if ( !ack->isControl() || ( ack->getTransactionIdentifier() != MSG_CONTROL_ACK ) )
+		return;
+
+	while ( ack->hasMoreData() )
+	{
+		uint32_t s = (uint32_t) ack->getInt();
+		if ( !ack->hasMoreData() )
+			break;
+		uint32_t seq = (uint32_t) ack->getInt();
+		if ( s == session )
+			acknowledge( seq );
+	}
+}
+
+void RetransmitQueue::acknowledge(const char *frame, size_t length)
+{
+	size_t off = 0;
+	uint32_t s, seq;
+
+	while ( Message::ackEntryOf( frame, length, off, s, seq ) )
+	{
+		if ( s == session )
+			acknowledge( seq );
+	}
+}
+
+size_t RetransmitQueue::retransmit(std::function<void(const char *frame, size_t length)> send)
+{
+	uint64_t t = now();
+	size_t resent = 0;
+
+	for ( uint32_t seq = oldest_sequence; seq != next_sequence; seq++ )
+	{
+		Slot &s = slots[seq & slot_mask];
+		if ( !s.in_use || ( s.deadline > t ) )
+			continue;
+
+		if ( s.attempts >= max_attempts )
+		{
+			s.in_use = false;
+			outstanding--;
+			abandoned++;
+			continue;
+		}
+
+		send( s.frame.data(), s.frame.size() );
+		s.attempts++;
+		s.deadline = t + timeout;
+		resent++;
+	}
+
+	advance();
+	return ( resent );
+}
+
+uint32_t RetransmitQueue::getSession(void)
+{
+	return ( session );
+}
+
+bool RetransmitQueue::isFull(void)
+{
+	// the ring slot for the next sequence must not still be waiting on an ack
+	return ( ( next_sequence - oldest_sequence ) > slot_mask );
+}
+
+size_t RetransmitQueue::pending(void)
+{
+	return ( outstanding );
+}
+
+uint64_t RetransmitQueue::getAbandonedCount(void)
+{
+	return ( abandoned );
+}
+
+/* private methods */
+
+uint64_t RetransmitQueue::now(void)
+{
+	timespec ts;
+	clock_gettime( CLOCK_MONOTONIC_COARSE, &ts );
+	return ( (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000 );
+}
+
+void RetransmitQueue::advance(void)
+{
+	while ( ( oldest_sequence != next_sequence ) && !slots[oldest_sequence & slot_mask].in_use )
+		oldest_sequence++;
+}
+
+} /* namespace kcmsg */
@@ -0,0 +1,101 @@
+/*
+ * RetransmitQueue.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#ifndef RETRANSMITQUEUE_H_
+#define RETRANSMITQUEUE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <functional>
+
+#include "Message.h"
+
+namespace kcmsg {
+
+const size_t RETRANSMIT_CAPACITY = 4096;		// unacknowledged messages
+const uint32_t RETRANSMIT_TIMEOUT = 1000;		// ms before resending
+const uint32_t RETRANSMIT_ATTEMPTS = 5;
+
+/*
+ * RetransmitQueue is the send side of MSG_FLAG_ONCE_AND_ONLY_ONCE.  track()
+ * stamps a message with the queue's session and the next sequence number
+ * and keeps a copy of the encoded frame until the receiver's
+ * DeduplicationWindow acknowledges it.  retransmit() resends every frame
+ * whose ack is overdue; a frame that has been sent 'attempts' times without
+ * an ack is given up and counted.
+ *
+ * Sequence numbers start at 1 in every queue, so each queue draws a random
+ * session when it is made.  A sender that restarts numbers its messages in
+ * a new session, which the receiver does not confuse with the old one, and
+ * acks for the old session are ignored.
+ *
+ * The queue is a ring indexed by sequence number, so at most 'capacity'
+ * messages can be outstanding at once.
+ */
+class RetransmitQueue {
+private:
+	struct Slot
+	{
+		uint32_t sequence;
+		bool in_use;
+		uint32_t attempts;
+		uint64_t deadline;
+		std::vector<char> frame;
+	};
+
+	std::vector<Slot> slots;
+	size_t slot_mask;
+	uint32_t next_sequence;
+	uint32_t oldest_sequence;
+	size_t outstanding;
+	uint32_t timeout;		// milliseconds
+	uint32_t max_attempts;
+	uint64_t abandoned;
+	uint32_t session;
+
+	static uint64_t now(void);
+	void advance(void);
+
+public:
+	/*  Parameters
+	 *    capacity: maximum number of unacknowledged messages
+	 *    timeout:  milliseconds to wait for an ack before resending
+	 *    attempts: total sends before a message is abandoned
+	 */
+	RetransmitQueue(size_t capacity, uint32_t timeout, uint32_t attempts);
+	virtual ~RetransmitQueue();
+
+	/* track() marks 'msg' once-and-only-once, assigns its sequence number and
+	 *         keeps a copy of the encoded frame.  Returns the sequence number.
+	 *         Throws std::domain_error when the ring is full.
+	 */
+	uint32_t track(kcmsg::Message *msg);
+
+	/* acknowledge() releases the frames named by a sequence number or by
+	 *               every (session, sequence) pair of this queue's session
+	 *               carried in an MSG_CONTROL_ACK message, or read in
+	 *               place from its encoded frame.
+	 */
+	void acknowledge(uint32_t seq);
+	void acknowledge(kcmsg::Message *ack);
+	void acknowledge(const char *frame, size_t length);
+
+	/* retransmit() calls 'send' with every frame whose ack is overdue.
+	 *              Returns the number of frames resent.
+	 */
+	size_t retransmit(std::function<void(const char *frame, size_t length)> send);
+
+	uint32_t getSession(void);
+	bool isFull(void);
+	size_t pending(void);
+	uint64_t getAbandonedCount(void);
+};
+
+} /* namespace kcmsg */
+
+#endif /* RETRANSMITQUEUE_H_ */
@@ -0,0 +1,316 @@
+/*
+ * RoutingTable.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#include "RoutingTable.h"
+
+#include <stdexcept>
+#include <cstdlib>
+#include <new>
+#include <thread>
+
+namespace kcmsg {
+
+const uint64_t ROUTE_KEY_OCCUPIED = 1ULL << 63;
+const int ROUTE_KEY_MATCH_SHIFT = 48;
+
+/*
+ * Reader threads are numbered so each one owns a ReaderSlot in every
+ * RoutingTable.  Numbers are handed back when a thread exits.
+ */
+namespace {
+
+std::mutex registry_lock;
+std::vector<int> free_ids;
+int next_id = 0;
+
+struct ReaderId
+{
+	int id;
+
+	ReaderId()
+	{
+		std::lock_guard<std::mutex> guard( registry_lock );
+		if ( !free_ids.empty() )
+		{
+			id = free_ids.back();
+			free_ids.pop_back();
+		}
+		else
+		{
+			id = next_id++;
+		}
+	}
+
+	~ReaderId()
+	{
+		std::lock_guard<std::mutex> guard( registry_lock );
+		free_ids.push_back( id );
+	}
+};
+
+} /* namespace */
+
+RoutingTable::RoutingTable()
+{
+	void *mem;
+	if ( posix_memalign( &mem, 64, sizeof(ReaderSlot) * MAX_ROUTING_THREADS ) != 0 )
+		throw std::bad_alloc();
+
+	readers = static_cast<ReaderSlot *>( mem );
+	for ( int i = 0; i < MAX_ROUTING_THREADS; i++ )
+	{
+		new ( &readers[i] ) ReaderSlot();
+		readers[i].epoch.store( 0, std::memory_order_relaxed );
+		for ( int j = 0; j < ROUTE_CACHE_SIZE; j++ )
+			readers[i].cache[j] = CacheEntry{ 0, 0, nullptr };
+	}
+
+	Table *t = new Table();
+	t->slots.assign( 16, Entry{ 0, nullptr } );
+	t->mask = t->slots.size() - 1;
+	t->count = 0;
+	t->version = 1;
+
+	current.store( t );
+	global_epoch.store( 1 );
+}
+
+RoutingTable::~RoutingTable()
+{
+	delete current.load();
+
+	for ( int i = 0; i < MAX_ROUTING_THREADS; i++ )
+		readers[i].~ReaderSlot();
+	free( readers );
+}
+
+void RoutingTable::addRoute(uint16_t org, uint32_t ident, kcmsg::Connection *target, int match)
+{
+	if ( ( match < ROUTE_EXACT ) || ( match > ROUTE_DEFAULT ) )
+		throw std::invalid_argument( "invalid route match" );
+
+	std::lock_guard<std::mutex> guard( writer );
+
+	uint64_t key = makeKey( org, ident, match );
+	Table *t = copyTable( current.load(), current.load()->count + 1 );
+
+	size_t i = hashKey( key ) & t->mask;
+	while ( ( t->slots[i].key != 0 ) && ( t->slots[i].key != key ) )
+		i = ( i + 1 ) & t->mask;
+
+	if ( t->slots[i].key == 0 )
+		t->count++;
+	t->slots[i].key = key;
+	t->slots[i].target = target;
+
+	publish( t );
+}
+
+bool RoutingTable::removeRoute(uint16_t org, uint32_t ident, int match)
+{
+	std::lock_guard<std::mutex> guard( writer );
+
+	uint64_t key = makeKey( org, ident, match );
+	Table *old = current.load();
+
+	bool found = false;
+	for ( auto &e : old->slots )
+		found = found || ( e.key == key );
+	if ( !found )
+		return ( false );
+
+	// rebuild without the route; linear probing has no cheap in place delete
+	Table *t = new Table();
+	size_t cap = 16;
+	while ( cap < ( old->count - 1 ) * 2 )
+		cap <<= 1;
+	t->slots.assign( cap, Entry{ 0, nullptr } );
+	t->mask = cap - 1;
+	t->count = 0;
+	t->version = old->version + 1;
+
+	for ( auto &e : old->slots )
+	{
+		if ( ( e.key == 0 ) || ( e.key == key ) )
+			continue;
+		size_t i = hashKey( e.key ) & t->mask;
+		while ( t->slots[i].key != 0 )
+			i = ( i + 1 ) & t->mask;
+		t->slots[i] = e;
+		t->count++;
+	}
+
+	publish( t );
+	return ( true );
+}
+
+kcmsg::Connection *RoutingTable::route(uint16_t org, uint32_t ident)
+{
+	ReaderSlot &slot = readers[readerIndex()];
+	uint64_t key = makeKey( org, ident, ROUTE_EXACT );
+	kcmsg::Connection *target;
+
+	// announce the epoch before looking at the table so publish() waits for
+	// us.  The epoch is read with acquire at least: having seen publish()'s
+	// increment we must also see the table it swapped in before it, or
+	// publish() takes our epoch as new and frees the table we then load
+	slot.epoch.store( global_epoch.load( std::memory_order_seq_cst ), std::memory_order_seq_cst );
+	const Table *t = current.load( std::memory_order_seq_cst );
+
+	CacheEntry &c = slot.cache[hashKey( key ) & ( ROUTE_CACHE_SIZE - 1 )];
+	if ( ( c.key == key ) && ( c.version == t->version ) )
+	{
+		target = c.target;
+	}
+	else
+	{
+		if ( ( ( target = find( t, key ) ) == nullptr ) &&
+				( ( target = find( t, makeKey( org, ident, ROUTE_ANY_IDENT ) ) ) == nullptr ) &&
+				( ( target = find( t, makeKey( org, ident, ROUTE_ANY_ORGANIZATION ) ) ) == nullptr ) )
+			target = find( t, makeKey( org, ident, ROUTE_DEFAULT ) );
+
+		c.key = key;
+		c.version = t->version;
+		c.target = target;
+	}
+
+	slot.epoch.store( 0, std::memory_order_release );
+	return ( target );
+}
+
+kcmsg::Connection *RoutingTable::route(kcmsg::Message *msg)
+{
+	return route( msg->getTargetOrganization(), msg->getTargetIdentifier() );
+}
+
+kcmsg::Connection *RoutingTable::route(const char *frame, size_t length)
+{
+	uint16_t org;
+	uint32_t ident;
+
+	if ( !kcmsg::Message::targetOf( frame, length, org, ident ) )
+		return ( nullptr );
+	return route( org, ident );
+}
+
+size_t RoutingTable::size(void)
+{
+	std::lock_guard<std::mutex> guard( writer );
+	return ( current.load()->count );
+}
+
+/* private methods */
+
+uint64_t RoutingTable::makeKey(uint16_t org, uint32_t ident, int match)
+{
+	switch ( match )
+	{
+	case ROUTE_ANY_IDENT :
+		ident = 0;
+		break;
+	case ROUTE_ANY_ORGANIZATION :
+		org = 0;
+		break;
+	case ROUTE_DEFAULT :
+		org = 0;
+		ident = 0;
+		break;
+	default:
+		break;
+	}
+
+	return ( ROUTE_KEY_OCCUPIED | ( (uint64_t) match << ROUTE_KEY_MATCH_SHIFT ) |
+			( (uint64_t) org << 32 ) | ident );
+}
+
+size_t RoutingTable::hashKey(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xFF51AFD7ED558CCDULL;
+	key ^= key >> 33;
+	return ( (size_t) key );
+}
+
+int RoutingTable::readerIndex(void)
+{
+	static thread_local ReaderId rid;
+
+	if ( rid.id >= MAX_ROUTING_THREADS )
+		throw std::length_error( "too many routing threads" );
+
+	return ( rid.id );
+}
+
+kcmsg::Connection *RoutingTable::find(const Table *t, uint64_t key)
+{
+	size_t i = hashKey( key ) & t->mask;
+
+	while ( t->slots[i].key != 0 )
+	{
+		if ( t->slots[i].key == key )
+			return ( t->slots[i].target );
+		i = ( i + 1 ) & t->mask;
+	}
+
+	return ( nullptr );
+}
+
+void RoutingTable::publish(Table *t)
+{
+	// caller holds the writer lock
+	Table *old = current.exchange( t, std::memory_order_seq_cst );
+	uint64_t e = global_epoch.fetch_add( 1, std::memory_order_seq_cst ) + 1;
+
+	// grace period: wait out every reader that started before the exchange.
+	// The loads must be seq_cst too; an acquire load may be ordered before
+	// the exchange and miss a reader that is about to load the old table.
+	for ( int i = 0; i < MAX_ROUTING_THREADS; i++ )
+	{
+		for (;;)
+		{
+			uint64_t v = readers[i].epoch.load( std::memory_order_seq_cst );
+			if ( ( v == 0 ) || ( v >= e ) )
+				break;
+			std::this_thread::yield();
+		}
+	}
+
+	delete old;
+}
+
+RoutingTable::Table *RoutingTable::copyTable(const Table *t, size_t capacity)
+{
+	Table *n = new Table();
+	size_t cap = 16;
+	while ( cap < capacity * 2 )
+		cap <<= 1;
+
+	if ( cap == t->slots.size() )
+	{
+		n->slots = t->slots;
+	}
+	else
+	{
+		n->slots.assign( cap, Entry{ 0, nullptr } );
+		for ( auto &e : t->slots )
+		{
+			if ( e.key == 0 )
+				continue;
+			size_t i = hashKey( e.key ) & ( cap - 1 );
+			while ( n->slots[i].key != 0 )
+				i = ( i + 1 ) & ( cap - 1 );
+			n->slots[i] = e;
+		}
+	}
+
+	n->mask = cap - 1;
+	n->count = t->count;
+	n->version = t->version + 1;
+	return ( n );
+}
+
+} /* namespace kcmsg */
@@ -0,0 +1,117 @@
+/*
+ * RoutingTable.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#ifndef ROUTINGTABLE_H_
+#define ROUTINGTABLE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+#include "Message.h"
+
+namespace kcmsg {
+
+class Connection;
+
+/* Route match kinds, most specific first */
+const int ROUTE_EXACT = 0;				// target_organization and target_ident
+const int ROUTE_ANY_IDENT = 1;			// any target_ident within target_organization
+const int ROUTE_ANY_ORGANIZATION = 2;	// target_ident within any target_organization
+const int ROUTE_DEFAULT = 3;			// everything else
+
+const int MAX_ROUTING_THREADS = 1024;	// concurrent reader threads
+const int ROUTE_CACHE_SIZE = 64;		// per thread cached lookups
+
+/*
+ * RoutingTable maps a message's (target_organization, target_ident) to the
+ * Connection that should carry it.  A lookup tries, in order, the exact
+ * route, the identifier wildcard (ROUTE_ANY_IDENT), the organization
+ * wildcard (ROUTE_ANY_ORGANIZATION) and finally the default route.
+ *
+ * Routes are kept in a flat open addressing table that is never modified in
+ * place.  Updates copy the table, publish the copy with one atomic store and
+ * free the old table only after every reader that could still see it has
+ * finished (RCU with per thread epochs).  Readers therefore never lock or
+ * write shared memory; each thread has its own epoch slot and a small
+ * direct mapped cache of recent lookups, invalidated whenever a new table
+ * is published.  Updates are serialized by a mutex and are O(routes).
+ */
+class RoutingTable {
+private:
+	struct Entry
+	{
+		uint64_t key;		// 0 marks an empty slot
+		kcmsg::Connection *target;
+	};
+
+	struct Table
+	{
+		std::vector<Entry> slots;
+		size_t mask;
+		size_t count;
+		uint64_t version;
+	};
+
+	struct CacheEntry
+	{
+		uint64_t key;
+		uint64_t version;
+		kcmsg::Connection *target;
+	};
+
+	struct alignas(64) ReaderSlot
+	{
+		std::atomic<uint64_t> epoch;	// 0 while the thread is outside route()
+		CacheEntry cache[ROUTE_CACHE_SIZE];
+	};
+
+	std::atomic<Table *> current;
+	std::atomic<uint64_t> global_epoch;
+	ReaderSlot *readers;
+	std::mutex writer;
+
+	static uint64_t makeKey(uint16_t org, uint32_t ident, int match);
+	static size_t hashKey(uint64_t key);
+	static int readerIndex(void);
+
+	kcmsg::Connection *find(const Table *t, uint64_t key);
+	void publish(Table *t);
+	Table *copyTable(const Table *t, size_t capacity);
+
+public:
+	RoutingTable();
+	virtual ~RoutingTable();
+
+	/* addRoute() adds or replaces a route.  For ROUTE_ANY_IDENT 'ident' is
+	 *            ignored, for ROUTE_ANY_ORGANIZATION 'org' is ignored and for
+	 *            ROUTE_DEFAULT both are ignored.
+	 * removeRoute() returns false when no such route exists.
+	 */
+	void addRoute(uint16_t org, uint32_t ident, kcmsg::Connection *target, int match = ROUTE_EXACT);
+	bool removeRoute(uint16_t org, uint32_t ident, int match = ROUTE_EXACT);
+
+	/* route() returns the Connection for a destination, or nullptr if there
+	 *         is no route.  Safe to call from any number of threads while
+	 *         routes are being updated.
+	 */
+	kcmsg::Connection *route(uint16_t org, uint32_t ident);
+	kcmsg::Connection *route(kcmsg::Message *msg);
+
+	/* route() of an encoded frame, or of just its header as a relay peeks
+	 *         it; nullptr if 'length' is shorter than a header.
+	 */
+	kcmsg::Connection *route(const char *frame, size_t length);
+
+	size_t size(void);
+};
+
+} /* namespace kcmsg */
+
+#endif /* ROUTINGTABLE_H_ */
@@ -0,0 +1,297 @@
+/*
+ * RpcChannel.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#include "RpcChannel.h"
+
+#include <ios>
+#include <stdexcept>
+#include <system_error>
+#include <chrono>
+#include <ctime>
+#include <errno.h>
+
+namespace kcmsg {
+
+/* the low three bits of a slot word; the rest counts the slot's uses */
+const uint32_t SLOT_FREE = 0;
+const uint32_t SLOT_RESERVED = 1;	// call() is filling it in
+const uint32_t SLOT_PENDING = 2;	// sent, waiting for the reply
+const uint32_t SLOT_DONE = 3;		// its completion is being run
+const uint32_t SLOT_QUARANTINE = 4;	// its call got no reply; held until 'deadline'
+const uint32_t SLOT_STATE_MASK = 7;
+const int SLOT_GENERATION_SHIFT = 3;
+
+RpcChannel::RpcChannel(SendFunction send, int bits, bool timer)
+{
+	if ( ( bits < 1 ) || ( bits > RPC_SLOT_BITS_MAX ) )
+		throw std::invalid_argument( "invalid RPC slot table size" );
+	if ( !send )
+		throw std::invalid_argument( "RPC channel needs a sender" );
+
+	sender = send;
+	slot_bits = bits;
+	slot_mask = ( 1u << bits ) - 1;
+	generation_mask = ( 1u << ( 16 - bits ) ) - 1;
+	slots.reset( new Slot[slot_mask + 1] );
+	for ( uint32_t i = 0; i <= slot_mask; i++ )
+	{
+		slots[i].word.store( SLOT_FREE, std::memory_order_relaxed );
+		slots[i].deadline.store( 0, std::memory_order_relaxed );
+	}
+	cursor = 0;
+	outstanding = 0;
+	completing = 0;
+	closing = false;
+	stopping = false;
+
+	if ( timer )
+		expiry = std::thread( &RpcChannel::expiryMain, this );
+}
+
+RpcChannel::~RpcChannel()
+{
+	// complete() calls under way finish first; later ones answer false
+	closing = true;
+	while ( completing.load() != 0 )
+		std::this_thread::yield();
+
+	{
+		std::lock_guard<std::mutex> guard( expiry_lock );
+		stopping = true;
+	}
+	expiry_wake.notify_all();
+	if ( expiry.joinable() )
+		expiry.join();
+
+	// nobody will answer these now; futures see an error, not a broken promise
+	cancelAll( ECANCELED );
+}
+
+bool RpcChannel::call(kcmsg::Message *msg, Completion cb, uint32_t timeout)
+{
+	int index = reserve();
+	if ( index < 0 )
+	{
+		errno = EBUSY;
+		return ( false );
+	}
+
+	Slot &s = slots[index];
+	uint32_t word = s.word.load( std::memory_order_relaxed );
+	uint16_t id = ( ( ( word >> SLOT_GENERATION_SHIFT ) & generation_mask ) << slot_bits ) | index;
+
+	s.done = std::move( cb );
+	s.deadline.store( now() + timeout, std::memory_order_relaxed );
+	msg->setTransactionIdentifier( id );
+	msg->setReply( false );
+
+	// a reply can come back before sender() returns, so the slot is
+	// published first
+	uint32_t pending = ( word & ~SLOT_STATE_MASK ) | SLOT_PENDING;
+	outstanding++;
+	s.word.store( pending, std::memory_order_release );
+
+	if ( sender( msg ) )
+		return ( true );
+
+	// not sent: take the slot back, unless cancelAll() or expire() already
+	// ran the completion, which then reported the failure
+	int err = errno;
+	if ( !s.word.compare_exchange_strong( pending, ( pending & ~SLOT_STATE_MASK ) | SLOT_DONE,
+			std::memory_order_acquire ) )
+		return ( true );
+
+	s.done = nullptr;
+	outstanding--;
+	s.word.store( ( pending & ~SLOT_STATE_MASK ) + ( 1u << SLOT_GENERATION_SHIFT ), std::memory_order_release );
+	errno = err;
+	return ( false );
+}
+
+std::future<std::shared_ptr<kcmsg::Message>> RpcChannel::call(kcmsg::Message *msg, uint32_t timeout)
+{
+	std::shared_ptr<std::promise<std::shared_ptr<kcmsg::Message>>> result =
+			std::make_shared<std::promise<std::shared_ptr<kcmsg::Message>>>();
+	std::future<std::shared_ptr<kcmsg::Message>> f = result->get_future();
+
+	Completion cb = [result](int error, const char *frame, size_t length)
+	{
+		if ( error != 0 )
+		{
+			result->set_exception( std::make_exception_ptr( std::ios_base::failure( "RPC call failed",
+					std::error_code( error, std::generic_category() ) ) ) );
+			return;
+		}
+
+		try
+		{
+			std::shared_ptr<kcmsg::Message> reply = std::make_shared<kcmsg::Message>();
+			reply->deserialize( frame, length );
+			result->set_value( reply );
+		}
+		catch ( ... )
+		{
+			result->set_exception( std::current_exception() );
+		}
+	};
+
+	if ( !call( msg, cb, timeout ) )
+		result->set_exception( std::make_exception_ptr( std::ios_base::failure( "RPC call failed",
+				std::error_code( errno, std::generic_category() ) ) ) );
+
+	return ( f );
+}
+
+bool RpcChannel::complete(const char *frame, size_t length)
+{
+	// only replies: a request from the peer may carry any transaction_ident
+	if ( !( Message::flagsOf( frame, length ) & MSG_FLAG_REPLY ) || ( Message::controlCode( frame, length ) != 0 ) )
+		return ( false );
+
+	completing++;
+	if ( closing.load() )
+	{
+		completing--;
+		return ( false );
+	}
+
+	uint16_t id = Message::transactionOf( frame, length );
+	uint32_t index = id & slot_mask;
+	uint32_t word = slots[index].word.load( std::memory_order_acquire );
+
+	bool done = ( ( word & SLOT_STATE_MASK ) == SLOT_PENDING ) &&
+			( ( ( word >> SLOT_GENERATION_SHIFT ) & generation_mask ) == (uint32_t) ( id >> slot_bits ) ) &&
+			finish( index, word, 0, frame, length );
+
+	completing--;
+	return ( done );
+}
+
+size_t RpcChannel::expire(void)
+{
+	uint64_t t = now();
+	size_t n = 0;
+
+	for ( uint32_t i = 0; i <= slot_mask; i++ )
+	{
+		uint32_t word = slots[i].word.load( std::memory_order_acquire );
+		uint32_t state = word & SLOT_STATE_MASK;
+		if ( ( state != SLOT_PENDING ) && ( state != SLOT_QUARANTINE ) )
+			continue;
+		// if the slot was reused meanwhile, finish() sees the word change
+		if ( slots[i].deadline.load( std::memory_order_relaxed ) > t )
+			continue;
+
+		if ( state == SLOT_QUARANTINE )
+			slots[i].word.compare_exchange_strong( word, ( word & ~SLOT_STATE_MASK ) | SLOT_FREE,
+					std::memory_order_acq_rel );
+		else if ( finish( i, word, ETIMEDOUT, nullptr, 0 ) )
+			n++;
+	}
+
+	return ( n );
+}
+
+size_t RpcChannel::cancelAll(int error)
+{
+	size_t n = 0;
+
+	for ( uint32_t i = 0; i <= slot_mask; i++ )
+	{
+		uint32_t word = slots[i].word.load( std::memory_order_acquire );
+		if ( ( ( word & SLOT_STATE_MASK ) == SLOT_PENDING ) && finish( i, word, error, nullptr, 0 ) )
+			n++;
+	}
+
+	return ( n );
+}
+
+size_t RpcChannel::getOutstanding(void)
+{
+	return ( outstanding.load() );
+}
+
+size_t RpcChannel::getCapacity(void)
+{
+	return ( slot_mask + 1 );
+}
+
+/* private methods */
+
+int RpcChannel::reserve(void)
+{
+	uint32_t start = cursor.fetch_add( 1, std::memory_order_relaxed );
+
+	for ( uint32_t i = 0; i <= slot_mask; i++ )
+	{
+		uint32_t index = ( start + i ) & slot_mask;
+		uint32_t word = slots[index].word.load( std::memory_order_relaxed );
+		if ( ( word & SLOT_STATE_MASK ) != SLOT_FREE )
+			continue;
+		if ( slots[index].word.compare_exchange_strong( word, word | SLOT_RESERVED, std::memory_order_acquire ) )
+			return ( index );
+	}
+
+	return (-1);
+}
+
+bool RpcChannel::finish(uint32_t index, uint32_t word, int error, const char *frame, size_t length)
+{
+	Slot &s = slots[index];
+
+	// whoever moves the slot out of PENDING owns the completion
+	if ( !s.word.compare_exchange_strong( word, ( word & ~SLOT_STATE_MASK ) | SLOT_DONE,
+			std::memory_order_acq_rel ) )
+		return ( false );
+
+	Completion cb = std::move( s.done );
+	s.done = nullptr;
+	outstanding--;
+
+	// free before running it, so the completion may call() again at once;
+	// the new generation turns away a late reply to this call.  A call that
+	// got no reply may still get one, so its slot sits out the quarantine:
+	// otherwise a busy channel could wrap the generation and hand the late
+	// reply to a newer call in the slot
+	uint32_t next = ( word & ~SLOT_STATE_MASK ) + ( 1u << SLOT_GENERATION_SHIFT );
+	if ( error != 0 )
+	{
+		s.deadline.store( now() + RPC_QUARANTINE, std::memory_order_relaxed );
+		next |= SLOT_QUARANTINE;
+	}
+	s.word.store( next, std::memory_order_release );
+
+	if ( cb )
+		cb( error, frame, length );
+
+	return ( true );
+}
+
+void RpcChannel::expiryMain(void)
+{
+	std::unique_lock<std::mutex> guard( expiry_lock );
+
+	while ( !stopping )
+	{
+		expiry_wake.wait_for( guard, std::chrono::milliseconds( RPC_EXPIRY_INTERVAL ) );
+		if ( stopping )
+			break;
+
+		guard.unlock();
+		expire();
+		guard.lock();
+	}
+}
+
+uint64_t RpcChannel::now(void)
+{
+	timespec ts;
+	clock_gettime( CLOCK_MONOTONIC_COARSE, &ts );
+	return ( (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000 );
+}
+
+} /* namespace kcmsg */
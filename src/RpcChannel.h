@@ -0,0 +1,142 @@
+/*
+ * RpcChannel.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#ifndef RPCCHANNEL_H_
+#define RPCCHANNEL_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <future>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "Message.h"
+
+namespace kcmsg {
+
+const int RPC_SLOT_BITS = 12;				// 4096 calls outstanding per channel
+const int RPC_SLOT_BITS_MAX = 15;			// leaves one generation bit in the 16 bit identifier
+const uint32_t RPC_DEFAULT_TIMEOUT = 5000;	// ms
+const uint32_t RPC_EXPIRY_INTERVAL = 10;	// ms between timeout scans of the expiry thread
+const uint32_t RPC_QUARANTINE = 60000;		// ms a slot whose call got no reply stays unused
+
+/*
+ * RpcChannel matches replies to requests by transaction_ident, so many
+ * calls can be outstanding on one connection at once.
+ *
+ * call() takes a free slot of a table sized when the channel is made,
+ * stamps the request's transaction_ident with the slot number and the
+ * slot's generation, and sends it.  The peer answers with the same
+ * transaction_ident and MSG_FLAG_REPLY set (Message::setReply()).  The
+ * receive path hands every incoming frame to complete(), which takes only
+ * replies, finds the slot by index, checks the generation so a late reply
+ * to an earlier call in the slot is ignored, and runs the call's
+ * completion.  complete() returns false for frames that answer no
+ * outstanding call; those are ordinary messages for the application.
+ *
+ * The generation has only the bits of transaction_ident the slot number
+ * leaves, so it repeats every few reuses of a slot.  A slot whose call
+ * timed out or was cancelled, and so may still be answered, is therefore
+ * kept out of use for RPC_QUARANTINE before it is reused; a reply later
+ * than that is taken for lost.  A channel whose calls keep timing out runs
+ * out of slots and call() fails with EBUSY.
+ *
+ * Slots change hands with compare and swap on one atomic word each, which
+ * holds the slot's state and generation, so call() and complete() take no
+ * lock and any number of threads may call while the receive path
+ * completes.  A call that is not answered in its timeout completes with
+ * ETIMEDOUT, found by expire(), which an expiry thread runs every
+ * RPC_EXPIRY_INTERVAL unless the channel was made without one; expire()
+ * also ends the quarantines.
+ *
+ * Completions run on the thread that calls complete(), expire() or
+ * cancelAll(), after the slot is free again; they must not block the
+ * receive path.  The destructor waits for complete() calls already under
+ * way, and those that start while it runs return false, but the receive
+ * path must be stopped before the channel is freed.
+ */
+class RpcChannel {
+public:
+	/* error is 0 with the reply frame, valid during the call only, or
+	 * ETIMEDOUT or the error given to cancelAll() with no frame
+	 */
+	typedef std::function<void(int error, const char *frame, size_t length)> Completion;
+
+	/* sends one request; returns false if it could not be sent */
+	typedef std::function<bool(kcmsg::Message *msg)> SendFunction;
+
+private:
+	struct Slot
+	{
+		std::atomic<uint32_t> word;		// generation << 3 | state
+		std::atomic<uint64_t> deadline;	// ms, of the call or the quarantine; read by expire() while the slot may be reused
+		Completion done;
+	};
+
+	SendFunction sender;
+	int slot_bits;
+	uint32_t slot_mask;
+	uint32_t generation_mask;
+	std::unique_ptr<Slot[]> slots;
+	std::atomic<uint32_t> cursor;		// where the next free slot search starts
+	std::atomic<size_t> outstanding;
+	std::atomic<uint32_t> completing;	// complete() calls under way
+	std::atomic<bool> closing;
+
+	std::thread expiry;
+	std::mutex expiry_lock;
+	std::condition_variable expiry_wake;
+	bool stopping;
+
+	int reserve(void);
+	bool finish(uint32_t index, uint32_t word, int error, const char *frame, size_t length);
+	void expiryMain(void);
+	static uint64_t now(void);
+
+public:
+	/* 'bits' sizes the table at 2^bits slots, at most RPC_SLOT_BITS_MAX;
+	 * the remaining bits of transaction_ident carry the generation.
+	 * Throws std::invalid_argument for a bad size.
+	 */
+	RpcChannel(SendFunction send, int bits = RPC_SLOT_BITS, bool timer = true);
+	virtual ~RpcChannel();
+
+	/* call() sends 'msg' as a request and runs 'cb' once with the reply or
+	 *        an error.  Returns false, without running 'cb', with errno
+	 *        EBUSY if every slot is in use or the sender's errno if the
+	 *        request could not be sent.
+	 * call() without a completion returns a future for the decoded reply;
+	 *        it holds a std::ios_base::failure with the error instead if
+	 *        the call fails or times out.
+	 */
+	bool call(kcmsg::Message *msg, Completion cb, uint32_t timeout = RPC_DEFAULT_TIMEOUT);
+	std::future<std::shared_ptr<kcmsg::Message>> call(kcmsg::Message *msg, uint32_t timeout = RPC_DEFAULT_TIMEOUT);
+
+	/* complete() finishes the call 'frame' answers.  Returns false if it
+	 *            answers none, e.g. a request from the peer or any other
+	 *            frame without MSG_FLAG_REPLY, a control message or a
+	 *            reply after the timeout.
+	 * expire() fails the calls past their deadline and frees the slots
+	 *            whose quarantine is over.  Returns the number of calls.
+	 * cancelAll() fails every outstanding call with 'error', e.g.
+	 *            ECONNRESET when the connection is lost.
+	 */
+	bool complete(const char *frame, size_t length);
+	size_t expire(void);
+	size_t cancelAll(int error);
+
+	size_t getOutstanding(void);
+	size_t getCapacity(void);
+};
+
+} /* namespace kcmsg */
+
+#endif /* RPCCHANNEL_H_ */
@@ -0,0 +1,461 @@
+/*
+ * SharedRing.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#include "SharedRing.h"
+
+#include <stdexcept>
+#include <ios>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+namespace kcmsg {
+
+const uint32_t SHARED_RING_MAGIC = 0x6b63726e;	// "kcrn"
+const size_t SHARED_RING_HEADER = 4096;			// the header page, the ring follows
+const uint32_t RECORD_PAD = 1;
+
+/* lives at the start of the segment; every field any side writes has its own cache line */
+struct SharedRing::Header
+{
+	std::atomic<uint32_t> magic;
+	uint32_t mode;
+	uint64_t capacity;
+
+	alignas(64) std::atomic<uint64_t> head;			// consumer: next record to read
+	alignas(64) std::atomic<uint64_t> tail;			// producers: SPSC published, MPSC reserved
+	alignas(64) std::atomic<uint32_t> data_seq;		// futex the consumer sleeps on
+	std::atomic<uint32_t> consumer_waiting;
+	alignas(64) std::atomic<uint32_t> space_seq;	// futex producers sleep on
+	std::atomic<uint32_t> producers_waiting;
+};
+
+struct Record
+{
+	std::atomic<uint32_t> length;	// frame bytes, or the whole record for padding; 0 unpublished
+	uint32_t flags;
+};
+
+static_assert( sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex words must be plain 32 bit" );
+static_assert( sizeof(Record) == 8, "records have an 8 byte header" );
+
+static inline size_t recordSize(size_t length)
+{
+	return ( ( sizeof(Record) + length + 7 ) & ~(size_t) 7 );
+}
+
+/* the size of the record at 'r', or 0 if the fields the producer wrote do
+ * not make sense: it must not run past the end of the ring ('room') or the
+ * data published, and padding holds at least its own header
+ */
+static inline size_t checkedSize(const Record *r, uint32_t length, size_t room)
+{
+	size_t size;
+
+	if ( r->flags & RECORD_PAD )
+	{
+		if ( ( length < sizeof(Record) ) || ( length & 7 ) )
+			return ( 0 );
+		size = length;
+	}
+	else
+	{
+		if ( ( length == 0 ) || ( length > MAX_MSG_DATA ) )
+			return ( 0 );
+		size = recordSize( length );
+	}
+
+	return ( ( size <= room ) ? size : 0 );
+}
+
+static inline void relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	asm volatile( "yield" ::: "memory" );
+#endif
+}
+
+static void futexWait(std::atomic<uint32_t> *word, uint32_t expect)
+{
+	timespec ts = { SHARED_RING_WAIT / 1000, ( SHARED_RING_WAIT % 1000 ) * 1000000L };
+	syscall( SYS_futex, (uint32_t *) word, FUTEX_WAIT, expect, &ts, nullptr, 0 );
+}
+
+static void futexWake(std::atomic<uint32_t> *word, int count)
+{
+	syscall( SYS_futex, (uint32_t *) word, FUTEX_WAKE, count, nullptr, nullptr, 0 );
+}
+
+SharedRing::SharedRing(int segfd, bool init, size_t cap, int model)
+{
+	static_assert( sizeof(Header) <= SHARED_RING_HEADER, "ring header outgrew its page" );
+
+	fd = segfd;
+	spin = SHARED_RING_SPIN_MIN;
+
+	if ( init )
+	{
+		if ( ftruncate( fd, SHARED_RING_HEADER + cap ) < 0 )
+		{
+			close( fd );
+			throw std::ios_base::failure( "Unable to size shared ring" );
+		}
+	}
+	else
+	{
+		struct stat st;
+		if ( ( fstat( fd, &st ) < 0 ) || ( (size_t) st.st_size <= SHARED_RING_HEADER ) )
+		{
+			close( fd );
+			throw std::domain_error( "descriptor is not a shared ring" );
+		}
+		cap = st.st_size - SHARED_RING_HEADER;
+	}
+
+	mapped = SHARED_RING_HEADER + cap;
+	void *base = mmap( nullptr, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	if ( base == MAP_FAILED )
+	{
+		close( fd );
+		throw std::ios_base::failure( "Unable to map shared ring" );
+	}
+
+	hdr = (Header *) base;
+	ring = (char *) base + SHARED_RING_HEADER;
+
+	if ( init )
+	{
+		// a fresh segment is zero filled; the magic goes last so a peer never sees half a header
+		hdr->mode = model;
+		hdr->capacity = cap;
+		hdr->magic.store( SHARED_RING_MAGIC, std::memory_order_release );
+	}
+	else if ( ( hdr->magic.load( std::memory_order_acquire ) != SHARED_RING_MAGIC ) || ( hdr->capacity != cap ) )
+	{
+		munmap( base, mapped );
+		close( fd );
+		throw std::domain_error( "descriptor is not a shared ring" );
+	}
+
+	capacity = hdr->capacity;
+	mask = capacity - 1;
+	mode = hdr->mode;
+}
+
+SharedRing::~SharedRing()
+{
+	munmap( hdr, mapped );
+	close( fd );
+}
+
+SharedRing *SharedRing::create(const std::string &name, size_t capacity, int model)
+{
+	size_t cap = SHARED_RING_MIN_CAPACITY;
+	while ( cap < capacity )
+		cap <<= 1;
+
+	int segfd;
+	if ( !name.empty() && ( name[0] == '/' ) )
+		segfd = shm_open( name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600 );
+	else
+		segfd = memfd_create( name.empty() ? "kcmsg-ring" : name.c_str(), MFD_CLOEXEC );
+
+	if ( segfd < 0 )
+		throw std::ios_base::failure( "Unable to create shared ring segment" );
+
+	return ( new SharedRing( segfd, true, cap, model ) );
+}
+
+SharedRing *SharedRing::open(const std::string &name)
+{
+	int segfd = shm_open( name.c_str(), O_RDWR | O_CLOEXEC, 0 );
+	if ( segfd < 0 )
+		throw std::ios_base::failure( "Unable to open shared ring segment" );
+
+	return ( new SharedRing( segfd, false, 0, 0 ) );
+}
+
+SharedRing *SharedRing::attach(int segfd)
+{
+	return ( new SharedRing( segfd, false, 0, 0 ) );
+}
+
+void SharedRing::remove(const std::string &name)
+{
+	shm_unlink( name.c_str() );
+}
+
+size_t SharedRing::WriteMessage(kcmsg::Message *msg, bool block)
+{
+	const char *frame = msg->serialize();
+	size_t length = msg->getMessageLength();
+
+	if ( !push( frame, length, block ) )
+		return (-1);
+
+	return ( length );
+}
+
+size_t SharedRing::ReadMessage(kcmsg::Message *msg, size_t nbytes)
+{
+	size_t got = 0;
+	bool fits = true;
+
+	while ( got == 0 )
+	{
+		uint64_t h = hdr->head.load( std::memory_order_relaxed );
+		if ( !available() )
+		{
+			waitData();
+			continue;
+		}
+
+		Record *r = (Record *) ( ring + ( h & mask ) );
+		uint32_t length = r->length.load( std::memory_order_acquire );
+		uint64_t t = hdr->tail.load( std::memory_order_acquire );
+		size_t size = checkedSize( r, length, std::min( capacity - ( h & mask ), (size_t) ( t - h ) ) );
+		if ( size == 0 )
+		{
+			// the other process wrote garbage; nothing after it can be found
+			errno = EPROTO;
+			return (-1);
+		}
+
+		if ( !( r->flags & RECORD_PAD ) )
+		{
+			if ( length > nbytes )
+				fits = false;
+			else
+				msg->deserialize( (const char *) ( r + 1 ), length );
+			got = length;
+		}
+
+		if ( mode == SHARED_RING_MPSC )
+			memset( (char *) r, 0, size );
+		hdr->head.store( h + size, std::memory_order_release );
+		notifyProducers();
+	}
+
+	if ( !fits )
+	{
+		errno = EMSGSIZE;
+		return (-1);
+	}
+
+	return ( got );
+}
+
+size_t SharedRing::ReadFrames(FrameCallback cb, bool block)
+{
+	if ( block )
+		while ( !available() )
+			waitData();
+
+	uint64_t start = hdr->head.load( std::memory_order_relaxed );
+	uint64_t h = start;
+	uint64_t end = hdr->tail.load( std::memory_order_acquire );
+	size_t frames = 0;
+	bool bad = false;
+
+	// frames are handed out in place; the space is released once, after the batch
+	while ( h != end )
+	{
+		Record *r = (Record *) ( ring + ( h & mask ) );
+		uint32_t length = r->length.load( std::memory_order_acquire );
+		if ( length == 0 )
+			break;		// MPSC: reserved but not yet published
+
+		size_t size = checkedSize( r, length, std::min( capacity - ( h & mask ), (size_t) ( end - h ) ) );
+		if ( size == 0 )
+		{
+			// release what was delivered; the next call fails at once
+			bad = true;
+			break;
+		}
+		if ( !( r->flags & RECORD_PAD ) )
+		{
+			cb( (const char *) ( r + 1 ), length );
+			frames++;
+		}
+		h += size;
+	}
+
+	if ( h == start )
+	{
+		if ( bad )
+		{
+			errno = EPROTO;
+			return (-1);
+		}
+		return ( frames );
+	}
+
+	if ( mode == SHARED_RING_MPSC )
+	{
+		// zero the consumed span, which may wrap, so the next lap reads as unpublished
+		size_t from = start & mask;
+		size_t span = h - start;
+		size_t first = std::min( span, capacity - from );
+		memset( ring + from, 0, first );
+		memset( ring, 0, span - first );
+	}
+
+	hdr->head.store( h, std::memory_order_release );
+	notifyProducers();
+	return ( frames );
+}
+
+int SharedRing::getDescriptor(void)
+{
+	return ( fd );
+}
+
+size_t SharedRing::getCapacity(void)
+{
+	return ( capacity );
+}
+
+size_t SharedRing::pending(void)
+{
+	return ( hdr->tail.load( std::memory_order_acquire ) - hdr->head.load( std::memory_order_acquire ) );
+}
+
+/* private methods */
+
+bool SharedRing::push(const char *frame, size_t length, bool block)
+{
+	size_t need = recordSize( length );
+
+	for (;;)
+	{
+		uint64_t t = hdr->tail.load( std::memory_order_relaxed );
+		size_t off = t & mask;
+		size_t pad = ( off + need > capacity ) ? capacity - off : 0;
+		uint64_t total = pad + need;
+
+		if ( t + total - hdr->head.load( std::memory_order_acquire ) > capacity )
+		{
+			if ( !block )
+			{
+				errno = EAGAIN;
+				return ( false );
+			}
+			waitSpace( total );
+			continue;
+		}
+
+		if ( ( mode == SHARED_RING_MPSC ) &&
+				!hdr->tail.compare_exchange_weak( t, t + total, std::memory_order_relaxed ) )
+			continue;
+
+		if ( pad )
+		{
+			Record *p = (Record *) ( ring + off );
+			p->flags = RECORD_PAD;
+			p->length.store( (uint32_t) pad, std::memory_order_release );
+		}
+
+		Record *r = (Record *) ( ring + ( ( t + pad ) & mask ) );
+		r->flags = 0;
+		memcpy( (char *) ( r + 1 ), frame, length );
+		r->length.store( (uint32_t) length, std::memory_order_release );
+
+		if ( mode == SHARED_RING_SPSC )
+			hdr->tail.store( t + total, std::memory_order_release );
+
+		notifyConsumer();
+		return ( true );
+	}
+}
+
+bool SharedRing::available(void)
+{
+	uint64_t h = hdr->head.load( std::memory_order_relaxed );
+
+	if ( h == hdr->tail.load( std::memory_order_acquire ) )
+		return ( false );
+
+	// an MPSC reservation is only readable once its length is published
+	return ( ( mode == SHARED_RING_SPSC ) ||
+			( ( (Record *) ( ring + ( h & mask ) ) )->length.load( std::memory_order_acquire ) != 0 ) );
+}
+
+void SharedRing::waitData(void)
+{
+	for ( uint32_t i = 0; i < spin; i++ )
+	{
+		if ( available() )
+		{
+			spin = std::min( spin * 2, SHARED_RING_SPIN_MAX );
+			return;
+		}
+		relax();
+	}
+
+	hdr->consumer_waiting.store( 1, std::memory_order_relaxed );
+	std::atomic_thread_fence( std::memory_order_seq_cst );
+	uint32_t seq = hdr->data_seq.load( std::memory_order_relaxed );
+
+	if ( !available() )
+		futexWait( &hdr->data_seq, seq );
+
+	hdr->consumer_waiting.store( 0, std::memory_order_relaxed );
+	spin = std::max( spin / 2, SHARED_RING_SPIN_MIN );
+}
+
+void SharedRing::waitSpace(uint64_t need)
+{
+	for ( uint32_t i = 0; i < spin; i++ )
+	{
+		uint64_t t = hdr->tail.load( std::memory_order_relaxed );
+		if ( t + need - hdr->head.load( std::memory_order_acquire ) <= capacity )
+			return;
+		relax();
+	}
+
+	hdr->producers_waiting.fetch_add( 1, std::memory_order_relaxed );
+	std::atomic_thread_fence( std::memory_order_seq_cst );
+	uint32_t seq = hdr->space_seq.load( std::memory_order_relaxed );
+
+	uint64_t t = hdr->tail.load( std::memory_order_relaxed );
+	if ( t + need - hdr->head.load( std::memory_order_acquire ) > capacity )
+		futexWait( &hdr->space_seq, seq );
+
+	hdr->producers_waiting.fetch_sub( 1, std::memory_order_relaxed );
+}
+
+void SharedRing::notifyConsumer(void)
+{
+	// pairs with the fence in waitData(): either it sees the record or we see it waiting
+	std::atomic_thread_fence( std::memory_order_seq_cst );
+	if ( hdr->consumer_waiting.load( std::memory_order_relaxed ) )
+	{
+		hdr->data_seq.fetch_add( 1, std::memory_order_relaxed );
+		futexWake( &hdr->data_seq, 1 );
+	}
+}
+
+void SharedRing::notifyProducers(void)
+{
+	std::atomic_thread_fence( std::memory_order_seq_cst );
+	if ( hdr->producers_waiting.load( std::memory_order_relaxed ) )
+	{
+		hdr->space_seq.fetch_add( 1, std::memory_order_relaxed );
+		futexWake( &hdr->space_seq, INT32_MAX );
+	}
+}
+
+} /* namespace kcmsg */
@@ -0,0 +1,127 @@
+/*
+ * SharedRing.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#ifndef SHAREDRING_H_
+#define SHAREDRING_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <atomic>
+#include <functional>
+
+#include "Message.h"
+
+namespace kcmsg {
+
+/* Producer models for SharedRing::create() */
+const int SHARED_RING_SPSC = 0;		// one producer process or thread
+const int SHARED_RING_MPSC = 1;		// any number of producers
+
+const size_t SHARED_RING_DEFAULT_CAPACITY = 4 * 1024 * 1024;
+const size_t SHARED_RING_MIN_CAPACITY = 256 * 1024;	// four maximum frames with their headers
+const uint32_t SHARED_RING_SPIN_MIN = 64;			// polls before sleeping, adapted between these
+const uint32_t SHARED_RING_SPIN_MAX = 16384;
+const int SHARED_RING_WAIT = 100;					// ms per futex sleep, so a dead peer cannot hang us
+
+/*
+ * SharedRing carries encoded Message frames between processes on one host
+ * through a shared memory ring, without system calls on the fast path.
+ *
+ * The segment is a memfd, handed to the peer over an AF_LOCAL Connection
+ * with SendDescriptors() and mapped there with attach(), or a named
+ * /dev/shm object opened by name.  It holds a header page and a power of
+ * two byte ring of records, each an 8 byte header and a frame padded to 8
+ * bytes; a record that would straddle the end is preceded by a padding
+ * record so every frame is contiguous and is read in place.
+ *
+ * With SHARED_RING_SPSC the producer publishes records by advancing the
+ * tail.  With SHARED_RING_MPSC producers reserve space with a compare and
+ * swap on the tail and publish each record by storing its length last; the
+ * consumer zeroes what it has read so the next lap starts clean.  A
+ * producer that dies between reserving and publishing stalls an MPSC ring.
+ *
+ * The consumer polls for a while before sleeping on a futex in the shared
+ * header; producers only make the wake up system call when the consumer
+ * sleeps.  The polling budget grows when polling finds data and shrinks
+ * when the consumer had to sleep, so a busy ring never sleeps and an idle
+ * one does not burn a CPU.  A full ring blocks producers the same way.
+ *
+ * There is exactly one consumer.  WriteMessage(), ReadMessage() and
+ * ReadFrames() behave as on Connection.
+ */
+class SharedRing {
+public:
+	typedef std::function<void(const char *frame, size_t length)> FrameCallback;
+
+private:
+	struct Header;
+
+	int fd;
+	Header *hdr;
+	char *ring;
+	size_t capacity;
+	size_t mapped;
+	uint64_t mask;
+	int mode;
+	uint32_t spin;			// this side's current polling budget
+
+	SharedRing(int segfd, bool init, size_t cap, int model);
+
+	bool push(const char *frame, size_t length, bool block);
+	bool available(void);
+	void waitData(void);
+	void waitSpace(uint64_t need);
+	void notifyConsumer(void);
+	void notifyProducers(void);
+
+public:
+	virtual ~SharedRing();
+
+	/* create() makes a new ring.  A name starting with '/' is a /dev/shm
+	 *          object others open(); any other name only labels a memfd.
+	 *          'capacity' is rounded up to a power of two.
+	 * open() maps an existing named ring.
+	 * attach() maps the ring behind a descriptor, e.g. one received with
+	 *          Connection::RecvDescriptors(), and takes ownership of it.
+	 * remove() unlinks a named ring; mapped rings stay usable.
+	 *
+	 * All throw std::ios_base::failure if the segment cannot be made or
+	 * mapped, and std::domain_error if it is not a ring.
+	 */
+	static SharedRing *create(const std::string &name, size_t capacity = SHARED_RING_DEFAULT_CAPACITY,
+			int model = SHARED_RING_SPSC);
+	static SharedRing *open(const std::string &name);
+	static SharedRing *attach(int segfd);
+	static void remove(const std::string &name);
+
+	/* WriteMessage() copies the frame into the ring, waiting for room unless
+	 *                'block' is false.  Returns the frame length, or -1 with
+	 *                errno EAGAIN when full and not blocking.
+	 * ReadMessage() waits for the next frame and decodes it into 'msg'.
+	 *                Returns the frame length, or -1 with errno EMSGSIZE if
+	 *                it is longer than 'nbytes'.
+	 * ReadFrames() passes every frame available now to 'cb' as a view into
+	 *                the ring, valid during the call only, waiting for the
+	 *                first if 'block'.  Returns the number of frames.
+	 *
+	 * Both check the record headers the producer wrote before trusting
+	 * them and fail with errno EPROTO at one that is impossible; the ring
+	 * is unusable from there.
+	 */
+	size_t WriteMessage(kcmsg::Message *msg, bool block = true);
+	size_t ReadMessage(kcmsg::Message *msg, size_t nbytes);
+	size_t ReadFrames(FrameCallback cb, bool block = false);
+
+	int getDescriptor(void);
+	size_t getCapacity(void);
+	size_t pending(void);
+};
+
+} /* namespace kcmsg */
+
+#endif /* SHAREDRING_H_ */
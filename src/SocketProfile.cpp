@@ -0,0 +1,151 @@
+/*
+ * SocketProfile.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#include "SocketProfile.h"
+#include "Configuration.h"
+
+#include <stdexcept>
+#include <cstdlib>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+namespace kcmsg {
+
+/* reads an integer or boolean key, leaving 'value' as is if absent or malformed */
+static void configured(kcmsg::Configuration &conf, const char *key, int &value)
+{
+	if ( !conf.propertyExists( key ) )
+		return;
+
+	std::string v = conf.getProperty( key );
+	if ( ( v == "true" ) || ( v == "on" ) || ( v == "yes" ) )
+	{
+		value = 1;
+		return;
+	}
+	if ( ( v == "false" ) || ( v == "off" ) || ( v == "no" ) )
+	{
+		value = 0;
+		return;
+	}
+
+	char *end;
+	long n = strtol( v.c_str(), &end, 0 );
+	if ( ( end != v.c_str() ) && ( *end == '\0' ) )
+		value = (int) n;
+}
+
+static int setOption(int fd, int level, int name, int value)
+{
+	if ( value == SOCKET_OPTION_UNSET )
+		return ( 0 );
+
+	return ( setsockopt( fd, level, name, &value, sizeof(value) ) < 0 ) ? 1 : 0;
+}
+
+SocketProfile::SocketProfile()
+{
+	nodelay = quickack = SOCKET_OPTION_UNSET;
+	sndbuf = rcvbuf = SOCKET_OPTION_UNSET;
+	busy_poll = notsent_lowat = priority = SOCKET_OPTION_UNSET;
+	keepalive = keepidle = keepintvl = keepcnt = SOCKET_OPTION_UNSET;
+}
+
+SocketProfile SocketProfile::preset(const std::string &name)
+{
+	SocketProfile p;
+
+	if ( ( name == "default" ) || name.empty() )
+		return ( p );
+
+	if ( name == "low-latency" )
+	{
+		p.nodelay = 1;
+		p.quickack = 1;
+		p.busy_poll = 50;
+		p.notsent_lowat = 16 * 1024;
+		p.priority = 6;
+		p.keepalive = 1;
+		p.keepidle = 10;
+		p.keepintvl = 2;
+		p.keepcnt = 3;
+		return ( p );
+	}
+
+	if ( name == "bulk-throughput" )
+	{
+		p.nodelay = 0;
+		p.sndbuf = 4 * 1024 * 1024;
+		p.rcvbuf = 4 * 1024 * 1024;
+		p.notsent_lowat = 1024 * 1024;
+		p.keepalive = 1;
+		p.keepidle = 60;
+		p.keepintvl = 10;
+		p.keepcnt = 5;
+		return ( p );
+	}
+
+	throw std::invalid_argument( "unknown socket profile \"" + name + "\"" );
+}
+
+SocketProfile SocketProfile::fromConfiguration(kcmsg::Configuration &conf)
+{
+	SocketProfile p;
+	if ( conf.propertyExists( CONF_SOCKET_PROFILE ) )
+		p = preset( conf.getProperty( CONF_SOCKET_PROFILE ) );
+
+	configured( conf, CONF_SOCKET_NODELAY, p.nodelay );
+	configured( conf, CONF_SOCKET_QUICKACK, p.quickack );
+	configured( conf, CONF_SOCKET_SNDBUF, p.sndbuf );
+	configured( conf, CONF_SOCKET_RCVBUF, p.rcvbuf );
+	configured( conf, CONF_SOCKET_BUSY_POLL, p.busy_poll );
+	configured( conf, CONF_SOCKET_NOTSENT_LOWAT, p.notsent_lowat );
+	configured( conf, CONF_SOCKET_PRIORITY, p.priority );
+	configured( conf, CONF_SOCKET_KEEPALIVE, p.keepalive );
+	configured( conf, CONF_SOCKET_KEEPIDLE, p.keepidle );
+	configured( conf, CONF_SOCKET_KEEPINTVL, p.keepintvl );
+	configured( conf, CONF_SOCKET_KEEPCNT, p.keepcnt );
+
+	return ( p );
+}
+
+int SocketProfile::apply(int fd, int protocol) const
+{
+	int refused = 0;
+
+	refused += setOption( fd, SOL_SOCKET, SO_SNDBUF, sndbuf );
+	refused += setOption( fd, SOL_SOCKET, SO_RCVBUF, rcvbuf );
+	refused += setOption( fd, SOL_SOCKET, SO_BUSY_POLL, busy_poll );
+	refused += setOption( fd, SOL_SOCKET, SO_PRIORITY, priority );
+	refused += setOption( fd, SOL_SOCKET, SO_KEEPALIVE, keepalive );
+
+	if ( protocol != IPPROTO_TCP )
+		return ( refused );
+
+	refused += setOption( fd, IPPROTO_TCP, TCP_NODELAY, nodelay );
+	refused += setOption( fd, IPPROTO_TCP, TCP_QUICKACK, quickack );
+	refused += setOption( fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, notsent_lowat );
+	if ( keepalive > 0 )
+	{
+		refused += setOption( fd, IPPROTO_TCP, TCP_KEEPIDLE, keepidle );
+		refused += setOption( fd, IPPROTO_TCP, TCP_KEEPINTVL, keepintvl );
+		refused += setOption( fd, IPPROTO_TCP, TCP_KEEPCNT, keepcnt );
+	}
+
+	return ( refused );
+}
+
+bool SocketProfile::isDefault(void) const
+{
+	return ( ( nodelay == SOCKET_OPTION_UNSET ) && ( quickack == SOCKET_OPTION_UNSET ) &&
+			( sndbuf == SOCKET_OPTION_UNSET ) && ( rcvbuf == SOCKET_OPTION_UNSET ) &&
+			( busy_poll == SOCKET_OPTION_UNSET ) && ( notsent_lowat == SOCKET_OPTION_UNSET ) &&
+			( priority == SOCKET_OPTION_UNSET ) && ( keepalive == SOCKET_OPTION_UNSET ) );
+}
+
+} /* namespace kcmsg */
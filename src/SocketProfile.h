@@ -0,0 +1,94 @@
+/*
+ * SocketProfile.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#ifndef SOCKETPROFILE_H_
+#define SOCKETPROFILE_H_
+
+#include <cstdint>
+#include <string>
+
+namespace kcmsg {
+
+class Configuration;
+
+/* Configuration keys read by SocketProfile::fromConfiguration() */
+const char * const CONF_SOCKET_PROFILE = "kcmsg.socket.profile";	// default | low-latency | bulk-throughput
+const char * const CONF_SOCKET_NODELAY = "kcmsg.socket.nodelay";
+const char * const CONF_SOCKET_QUICKACK = "kcmsg.socket.quickack";
+const char * const CONF_SOCKET_SNDBUF = "kcmsg.socket.sndbuf";
+const char * const CONF_SOCKET_RCVBUF = "kcmsg.socket.rcvbuf";
+const char * const CONF_SOCKET_BUSY_POLL = "kcmsg.socket.busypoll";
+const char * const CONF_SOCKET_NOTSENT_LOWAT = "kcmsg.socket.notsentlowat";
+const char * const CONF_SOCKET_PRIORITY = "kcmsg.socket.priority";
+const char * const CONF_SOCKET_KEEPALIVE = "kcmsg.socket.keepalive";
+const char * const CONF_SOCKET_KEEPIDLE = "kcmsg.socket.keepidle";
+const char * const CONF_SOCKET_KEEPINTVL = "kcmsg.socket.keepintvl";
+const char * const CONF_SOCKET_KEEPCNT = "kcmsg.socket.keepcnt";
+
+const int SOCKET_OPTION_UNSET = -1;		// leave the kernel default alone
+
+/*
+ * SocketProfile is a set of socket options applied together.  Connection
+ * applies its profile before Bind() and Connect(), so buffer sizes are in
+ * place before the TCP window scale is negotiated, and to every socket it
+ * or an EventLoop accepts.  Options left SOCKET_OPTION_UNSET are not
+ * touched; TCP options are skipped on other protocols.
+ *
+ *   nodelay        TCP_NODELAY, send small messages without waiting (0/1)
+ *   quickack       TCP_QUICKACK, acknowledge at once instead of delaying (0/1)
+ *   sndbuf rcvbuf  SO_SNDBUF / SO_RCVBUF in bytes, capped by net.core.*mem_max
+ *   busy_poll      SO_BUSY_POLL, microseconds to spin on the device queue
+ *   notsent_lowat  TCP_NOTSENT_LOWAT, unsent bytes before writability is lost
+ *   priority       SO_PRIORITY, queueing discipline band (0..6 unprivileged)
+ *   keepalive      SO_KEEPALIVE (0/1), with TCP_KEEPIDLE and TCP_KEEPINTVL in
+ *                  seconds and TCP_KEEPCNT probes
+ *
+ * The presets are
+ *   "default"          nothing set
+ *   "low-latency"      nodelay, quickack, 50us busy poll, 16K notsent low
+ *                      water mark, priority 6, keepalive after 10s
+ *   "bulk-throughput"  4M socket buffers, Nagle left on, 1M notsent low
+ *                      water mark, keepalive after 60s
+ */
+struct SocketProfile
+{
+	int nodelay;
+	int quickack;
+	int sndbuf;
+	int rcvbuf;
+	int busy_poll;
+	int notsent_lowat;
+	int priority;
+	int keepalive;
+	int keepidle;
+	int keepintvl;
+	int keepcnt;
+
+	SocketProfile();
+
+	/* preset() returns a named profile.  Throws std::invalid_argument for
+	 *          an unknown name.
+	 */
+	static SocketProfile preset(const std::string &name);
+
+	/* fromConfiguration() starts from the CONF_SOCKET_PROFILE preset and
+	 *          overrides it with any of the individual CONF_SOCKET_ keys.
+	 */
+	static SocketProfile fromConfiguration(kcmsg::Configuration &conf);
+
+	/* apply() sets the options on 'fd', a socket of 'protocol'.  Options the
+	 *         kernel refuses, e.g. SO_BUSY_POLL without CAP_NET_ADMIN, are
+	 *         skipped.  Returns the number refused.
+	 */
+	int apply(int fd, int protocol) const;
+
+	bool isDefault(void) const;
+};
+
+} /* namespace kcmsg */
+
+#endif /* SOCKETPROFILE_H_ */
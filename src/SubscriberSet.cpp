@@ -0,0 +1,102 @@
+/*
+ * SubscriberSet.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#include "SubscriberSet.h"
+
+#include <algorithm>
+
+namespace kcmsg {
+
+SubscriberSet::SubscriberSet() {
+
+}
+
+SubscriberSet::~SubscriberSet() {
+
+}
+
+void SubscriberSet::set(uint32_t id)
+{
+	size_t w = id >> 6;
+	if ( w >= words.size() )
+		words.resize( w + 1, 0 );
+	words[w] |= ( 1ULL << ( id & 63 ) );
+}
+
+void SubscriberSet::clear(uint32_t id)
+{
+	size_t w = id >> 6;
+	if ( w < words.size() )
+		words[w] &= ~( 1ULL << ( id & 63 ) );
+}
+
+bool SubscriberSet::test(uint32_t id) const
+{
+	size_t w = id >> 6;
+	return ( ( w < words.size() ) && ( words[w] & ( 1ULL << ( id & 63 ) ) ) );
+}
+
+void SubscriberSet::reset(void)
+{
+	words.clear();
+}
+
+bool SubscriberSet::empty(void) const
+{
+	for ( auto w : words )
+		if ( w )
+			return ( false );
+	return ( true );
+}
+
+size_t SubscriberSet::count(void) const
+{
+	size_t n = 0;
+	for ( auto w : words )
+		n += __builtin_popcountll( w );
+	return ( n );
+}
+
+int64_t SubscriberSet::next(uint32_t from) const
+{
+	size_t w = from >> 6;
+	if ( w >= words.size() )
+		return ( -1 );
+
+	uint64_t bits = words[w] & ( ~0ULL << ( from & 63 ) );
+	for (;;)
+	{
+		if ( bits )
+			return ( (int64_t) ( w << 6 ) + __builtin_ctzll( bits ) );
+		if ( ++w >= words.size() )
+			return ( -1 );
+		bits = words[w];
+	}
+}
+
+void SubscriberSet::unionWith(const SubscriberSet &other)
+{
+	if ( other.words.size() > words.size() )
+		words.resize( other.words.size(), 0 );
+	for ( size_t i = 0; i < other.words.size(); i++ )
+		words[i] |= other.words[i];
+}
+
+void SubscriberSet::intersectWith(const SubscriberSet &other)
+{
+	size_t n = std::min( words.size(), other.words.size() );
+	for ( size_t i = 0; i < n; i++ )
+		words[i] &= other.words[i];
+	words.resize( n );
+}
+
+const std::vector<uint64_t> &SubscriberSet::getWords(void) const
+{
+	return ( words );
+}
+
+} /* namespace kcmsg */
@@ -0,0 +1,50 @@
+/*
+ * SubscriberSet.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#ifndef SUBSCRIBERSET_H_
+#define SUBSCRIBERSET_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace kcmsg {
+
+/*
+ * SubscriberSet is a compact bitmap of small integer identifiers, one bit
+ * per subscriber.  It grows on demand; bits past the end read as clear.
+ */
+class SubscriberSet {
+private:
+	std::vector<uint64_t> words;
+
+public:
+	SubscriberSet();
+	virtual ~SubscriberSet();
+
+	void set(uint32_t id);
+	void clear(uint32_t id);
+	bool test(uint32_t id) const;
+	void reset(void);
+
+	bool empty(void) const;
+	size_t count(void) const;
+
+	/* next() returns the first member at or after 'from', or -1 if none.
+	 *        Iterate with: for ( int id = s.next(0); id >= 0; id = s.next(id + 1) )
+	 */
+	int64_t next(uint32_t from) const;
+
+	void unionWith(const SubscriberSet &other);
+	void intersectWith(const SubscriberSet &other);
+
+	const std::vector<uint64_t> &getWords(void) const;
+};
+
+} /* namespace kcmsg */
+
+#endif /* SUBSCRIBERSET_H_ */
@@ -0,0 +1,186 @@
+/*
+ * SubscriptionIndex.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#include "SubscriptionIndex.h"
+
+#include <stdexcept>
+
+namespace kcmsg {
+
+static uint16_t prefixOf(uint16_t value, int bits)
+{
+	return ( bits == SUBSCRIBE_ANY ) ? 0 : (uint16_t) ( value >> ( SUBSCRIBE_EXACT - bits ) );
+}
+
+SubscriptionIndex::SubscriptionIndex(size_t cachesize)
+{
+	for ( int f = 0; f < 3; f++ )
+		for ( int b = 0; b <= SUBSCRIBE_EXACT; b++ )
+			fields[f].in_use[b] = 0;
+
+	memo_limit = ( cachesize == 0 ) ? 1 : cachesize;
+}
+
+SubscriptionIndex::~SubscriptionIndex() {
+
+}
+
+uint32_t SubscriptionIndex::subscribe(uint32_t subscriber,
+		uint16_t org, int orgbits,
+		uint16_t app, int appbits,
+		uint16_t ident, int identbits)
+{
+	Subscription s;
+	s.subscriber = subscriber;
+	s.values[0] = org;
+	s.values[1] = app;
+	s.values[2] = ident;
+	s.bits[0] = orgbits;
+	s.bits[1] = appbits;
+	s.bits[2] = identbits;
+	s.active = true;
+
+	for ( int f = 0; f < 3; f++ )
+		if ( ( s.bits[f] < SUBSCRIBE_ANY ) || ( s.bits[f] > SUBSCRIBE_EXACT ) )
+			throw std::invalid_argument( "invalid subscription prefix length" );
+
+	uint32_t id;
+	if ( !free_ids.empty() )
+	{
+		id = free_ids.back();
+		free_ids.pop_back();
+		subscriptions[id] = s;
+	}
+	else
+	{
+		id = (uint32_t) subscriptions.size();
+		subscriptions.push_back( s );
+	}
+
+	for ( int f = 0; f < 3; f++ )
+	{
+		fields[f].prefixes[s.bits[f]][prefixOf( s.values[f], s.bits[f] )].set( id );
+		fields[f].in_use[s.bits[f]]++;
+	}
+
+	memo.clear();
+	return ( id );
+}
+
+void SubscriptionIndex::unsubscribe(uint32_t id)
+{
+	if ( ( id >= subscriptions.size() ) || !subscriptions[id].active )
+		return;
+
+	Subscription &s = subscriptions[id];
+	for ( int f = 0; f < 3; f++ )
+	{
+		auto &prefixes = fields[f].prefixes[s.bits[f]];
+		auto it = prefixes.find( prefixOf( s.values[f], s.bits[f] ) );
+		if ( it != prefixes.end() )
+		{
+			it->second.clear( id );
+			if ( it->second.empty() )
+				prefixes.erase( it );
+		}
+		fields[f].in_use[s.bits[f]]--;
+	}
+
+	s.active = false;
+	free_ids.push_back( id );
+	memo.clear();
+}
+
+void SubscriptionIndex::unsubscribeAll(uint32_t subscriber)
+{
+	for ( uint32_t id = 0; id < subscriptions.size(); id++ )
+		if ( subscriptions[id].active && ( subscriptions[id].subscriber == subscriber ) )
+			unsubscribe( id );
+}
+
+const SubscriberSet &SubscriptionIndex::match(uint16_t org, uint16_t app, uint16_t ident)
+{
+	uint32_t key = ( (uint32_t) org << 16 ) | app;
+
+	MemoEntry *e;
+
+	auto it = memo.find( key );
+	if ( it != memo.end() )
+	{
+		e = &it->second;
+	}
+	else
+	{
+		// the memo is bounded; start over rather than track recency
+		if ( memo.size() >= memo_limit )
+			memo.clear();
+
+		e = &memo[key];
+		fieldMatches( 0, org, e->candidates );
+		if ( !e->candidates.empty() )
+		{
+			fieldMatches( 1, app, matched );
+			e->candidates.intersectWith( matched );
+		}
+
+		e->ident_free = true;
+		for ( int64_t id = e->candidates.next( 0 ); id >= 0; id = e->candidates.next( id + 1 ) )
+		{
+			if ( subscriptions[id].bits[2] != SUBSCRIBE_ANY )
+			{
+				e->ident_free = false;
+				break;
+			}
+		}
+		if ( e->ident_free )
+			for ( int64_t id = e->candidates.next( 0 ); id >= 0; id = e->candidates.next( id + 1 ) )
+				e->subscribers.set( subscriptions[id].subscriber );
+	}
+
+	if ( e->ident_free )
+		return ( e->subscribers );
+
+	fieldMatches( 2, ident, matched );
+	matched.intersectWith( e->candidates );
+
+	result.reset();
+	for ( int64_t id = matched.next( 0 ); id >= 0; id = matched.next( id + 1 ) )
+		result.set( subscriptions[id].subscriber );
+
+	return ( result );
+}
+
+const SubscriberSet &SubscriptionIndex::match(kcmsg::Message *msg)
+{
+	return match( msg->getTransactionOrganization(), msg->getTransactionApplication(),
+			msg->getTransactionIdentifier() );
+}
+
+size_t SubscriptionIndex::size(void)
+{
+	return ( subscriptions.size() - free_ids.size() );
+}
+
+/* private methods */
+
+void SubscriptionIndex::fieldMatches(int field, uint16_t value, SubscriberSet &out)
+{
+	FieldIndex &fi = fields[field];
+	out.reset();
+
+	for ( int b = SUBSCRIBE_ANY; b <= SUBSCRIBE_EXACT; b++ )
+	{
+		if ( fi.in_use[b] == 0 )
+			continue;
+
+		auto it = fi.prefixes[b].find( prefixOf( value, b ) );
+		if ( it != fi.prefixes[b].end() )
+			out.unionWith( it->second );
+	}
+}
+
+} /* namespace kcmsg */
@@ -0,0 +1,111 @@
+/*
+ * SubscriptionIndex.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#ifndef SUBSCRIPTIONINDEX_H_
+#define SUBSCRIPTIONINDEX_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+
+#include "Message.h"
+#include "SubscriberSet.h"
+
+namespace kcmsg {
+
+/* Field match widths, in leading bits of the 16 bit header field */
+const int SUBSCRIBE_ANY = 0;		// wildcard, matches every value
+const int SUBSCRIBE_EXACT = 16;		// matches one value
+
+const size_t DEFAULT_SUBSCRIPTION_CACHE = 4096;	// memoized publish results
+
+/*
+ * SubscriptionIndex matches a message's (transaction_organization,
+ * transaction_application, transaction_ident) against subscriptions and
+ * returns the matching subscribers as a SubscriberSet.
+ *
+ * Each subscription gives, per field, a value and the number of leading
+ * bits that must match: SUBSCRIBE_EXACT, SUBSCRIBE_ANY, or any prefix length
+ * in between (e.g. 8 matches 0x12xx).  A subscriber may hold several
+ * subscriptions and is returned once if any of them matches.
+ *
+ * Every field keeps, for each prefix length in use, a hash map from prefix
+ * to the bitmap of subscriptions requiring it.  A publish ORs the bitmaps
+ * for each field, ANDs the three results and maps the surviving
+ * subscriptions to subscribers.
+ *
+ * The organization and application fields are routing keys that repeat from
+ * message to message; transaction_ident does not (it carries e.g. the RPC
+ * id), so only the first two are memoized.  The memo holds, per (org, app),
+ * the subscriptions matching both.  When none of them filters on the ident
+ * the memo holds the subscribers as well and a publish costs one hash
+ * lookup; otherwise a publish ANDs the ident bitmaps with the memoized
+ * subscriptions, O(subscriptions / 64).  Any subscription change clears the
+ * memo.
+ *
+ * The index is not thread safe; give each IO thread its own or lock around it.
+ */
+class SubscriptionIndex {
+private:
+	struct Subscription
+	{
+		uint32_t subscriber;
+		uint16_t values[3];
+		int bits[3];
+		bool active;
+	};
+
+	struct FieldIndex
+	{
+		std::unordered_map<uint16_t, SubscriberSet> prefixes[SUBSCRIBE_EXACT + 1];
+		uint32_t in_use[SUBSCRIBE_EXACT + 1];	// subscriptions per prefix length
+	};
+
+	struct MemoEntry
+	{
+		SubscriberSet candidates;	// subscriptions matching org and app
+		SubscriberSet subscribers;	// the result, when ident_free
+		bool ident_free;			// no candidate filters on transaction_ident
+	};
+
+	std::vector<Subscription> subscriptions;
+	std::vector<uint32_t> free_ids;
+	FieldIndex fields[3];
+	std::unordered_map<uint32_t, MemoEntry> memo;
+	size_t memo_limit;
+	SubscriberSet matched;			// scratch
+	SubscriberSet result;			// returned when the ident decides
+
+	void fieldMatches(int field, uint16_t value, SubscriberSet &out);
+
+public:
+	SubscriptionIndex(size_t cachesize = DEFAULT_SUBSCRIPTION_CACHE);
+	virtual ~SubscriptionIndex();
+
+	/* subscribe() returns a subscription id for unsubscribe().  The *bits
+	 *             arguments are SUBSCRIBE_ANY, SUBSCRIBE_EXACT or a prefix length.
+	 */
+	uint32_t subscribe(uint32_t subscriber,
+			uint16_t org, int orgbits,
+			uint16_t app, int appbits,
+			uint16_t ident, int identbits);
+	void unsubscribe(uint32_t id);
+	void unsubscribeAll(uint32_t subscriber);
+
+	/* match() returns the subscribers for a message.  The reference is valid
+	 *         until the next call to match(), subscribe() or unsubscribe().
+	 */
+	const SubscriberSet &match(uint16_t org, uint16_t app, uint16_t ident);
+	const SubscriberSet &match(kcmsg::Message *msg);
+
+	size_t size(void);
+};
+
+} /* namespace kcmsg */
+
+#endif /* SUBSCRIPTIONINDEX_H_ */
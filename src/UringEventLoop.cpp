@@ -0,0 +1,542 @@
+/*
+ * UringEventLoop.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#include "UringEventLoop.h"
+
+#include <stdexcept>
+#include <ios>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace kcmsg {
+
+/* completions carry the Client pointer with the operation in the low bits */
+const uint64_t OPERATION_MASK = 7;
+
+static uint64_t tag(void *c, int op)
+{
+	return ( (uint64_t) (uintptr_t) c | (uint64_t) op );
+}
+
+UringEventLoop::UringEventLoop() : EventLoop( EVENT_BACKEND_URING )
+{
+	ring_fd = -1;
+	sq_ptr = cq_ptr = MAP_FAILED;
+	sqes = (io_uring_sqe *) MAP_FAILED;
+	buf_ring = (io_uring_buf_ring *) MAP_FAILED;
+	buffers = nullptr;
+	to_submit = 0;
+	buf_tail = 0;
+
+	try
+	{
+		setupRing();
+		setupBuffers();
+	}
+	catch ( std::exception &e )
+	{
+		teardown();
+		throw;
+	}
+
+	armWake();
+}
+
+UringEventLoop::~UringEventLoop()
+{
+	teardown();
+}
+
+void UringEventLoop::addListener(kcmsg::Connection *listener)
+{
+	int fd = listener->getDescriptor();
+
+	Client &c = slot( fd );
+	c.kind = KIND_LISTENER;
+	c.fd = fd;
+	c.listener = listener;
+	armAccept( c );
+}
+
+void UringEventLoop::closeClient(int fd)
+{
+	if ( ( fd < 0 ) || ( (size_t) fd >= slab.size() ) || !slab[fd] || ( slab[fd]->kind != KIND_CLIENT ) )
+		return;
+
+	std::unique_ptr<Client> c( std::move( slab[fd] ) );
+	c->kind = KIND_NONE;
+
+	unqueueSend( *c );
+
+	if ( c->recv_armed )
+		cancelRecv( *c );
+
+	// fail an in flight send fast; the operations keep the socket alive until they finish
+	shutdown( fd, SHUT_RDWR );
+	client_count--;
+
+	slot( fd );		// an empty slot tells deliverFrames() the client is gone
+	if ( c->pending )
+		draining.push_back( std::move( c ) );
+
+	// before the number can be reused, see EventLoop::closeClient()
+	if ( on_close )
+		on_close( fd );
+	close( fd );
+}
+
+void UringEventLoop::pauseReading(int fd)
+{
+	if ( ( fd < 0 ) || ( (size_t) fd >= slab.size() ) || !slab[fd] || ( slab[fd]->kind != KIND_CLIENT ) ||
+			slab[fd]->paused )
+		return;
+
+	// what the recv still completes before the cancel lands is kept in 'partial'
+	Client &c = *slab[fd];
+	c.paused = true;
+	if ( c.recv_armed )
+		cancelRecv( c );
+}
+
+void UringEventLoop::resumeReading(int fd)
+{
+	if ( ( fd < 0 ) || ( (size_t) fd >= slab.size() ) || !slab[fd] || ( slab[fd]->kind != KIND_CLIENT ) ||
+			!slab[fd]->paused )
+		return;
+
+	Client &c = *slab[fd];
+	c.paused = false;
+
+	// a cancel still in flight re-arms the recv when it completes
+	if ( deliverPartial( c ) && !c.paused && !c.recv_armed )
+		armRecv( c );
+}
+
+int UringEventLoop::runOnce(int timeout)
+{
+	flushSends();
+
+	unsigned ready = __atomic_load_n( cq_tail, __ATOMIC_ACQUIRE ) - *cq_head;
+	unsigned wait = ( ready || ( timeout == 0 ) ) ? 0 : 1;
+
+	if ( to_submit || wait )
+		enter( to_submit, wait, timeout );
+
+	int n = 0;
+	unsigned head = *cq_head;
+	for (;;)
+	{
+		unsigned tail = __atomic_load_n( cq_tail, __ATOMIC_ACQUIRE );
+		if ( head == tail )
+			break;
+
+		// copy out and release the slot first; handlers may submit more work
+		io_uring_cqe cqe = cqes[head & *cq_mask];
+		head++;
+		__atomic_store_n( cq_head, head, __ATOMIC_RELEASE );
+
+		handleCompletion( &cqe );
+		n++;
+	}
+
+	return ( n );
+}
+
+/* protected methods */
+
+bool UringEventLoop::registerClient(int fd)
+{
+	Client &c = slot( fd );
+	c.kind = KIND_CLIENT;
+	c.fd = fd;
+	c.partial.clear();
+	c.outbound.clear();
+	client_count++;
+	clientReady( c );
+
+	armRecv( c );
+	return ( true );
+}
+
+void UringEventLoop::flushSends(void)
+{
+	for ( Client *c : send_ready )
+	{
+		c->send_queued = false;
+		if ( !c->send_armed )
+			armSend( *c );
+	}
+	send_ready.clear();
+}
+
+/* private methods */
+
+void UringEventLoop::setupRing(void)
+{
+	io_uring_params p;
+	memset( &p, 0, sizeof(p) );
+
+	if ( ( ring_fd = (int) syscall( __NR_io_uring_setup, URING_QUEUE_DEPTH, &p ) ) < 0 )
+		throw std::ios_base::failure( "Unable to create io_uring instance" );
+
+	if ( !( p.features & IORING_FEAT_EXT_ARG ) || !( p.features & IORING_FEAT_NODROP ) )
+		throw std::ios_base::failure( "io_uring is too old" );
+
+	sq_entries = p.sq_entries;
+	cq_entries = p.cq_entries;
+	sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+
+	if ( p.features & IORING_FEAT_SINGLE_MMAP )
+		sq_size = cq_size = std::max( sq_size, cq_size );
+
+	sq_ptr = mmap( nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			ring_fd, IORING_OFF_SQ_RING );
+	if ( sq_ptr == MAP_FAILED )
+		throw std::ios_base::failure( "Unable to map submission queue" );
+
+	if ( p.features & IORING_FEAT_SINGLE_MMAP )
+		cq_ptr = sq_ptr;
+	else
+	{
+		cq_ptr = mmap( nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				ring_fd, IORING_OFF_CQ_RING );
+		if ( cq_ptr == MAP_FAILED )
+			throw std::ios_base::failure( "Unable to map completion queue" );
+	}
+
+	sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+	sqes = (io_uring_sqe *) mmap( nullptr, sqes_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES );
+	if ( sqes == MAP_FAILED )
+		throw std::ios_base::failure( "Unable to map submission entries" );
+
+	char *sq = (char *) sq_ptr;
+	sq_head = (unsigned *) ( sq + p.sq_off.head );
+	sq_tail = (unsigned *) ( sq + p.sq_off.tail );
+	sq_mask = (unsigned *) ( sq + p.sq_off.ring_mask );
+	sq_array = (unsigned *) ( sq + p.sq_off.array );
+
+	char *cq = (char *) cq_ptr;
+	cq_head = (unsigned *) ( cq + p.cq_off.head );
+	cq_tail = (unsigned *) ( cq + p.cq_off.tail );
+	cq_mask = (unsigned *) ( cq + p.cq_off.ring_mask );
+	cqes = (io_uring_cqe *) ( cq + p.cq_off.cqes );
+}
+
+void UringEventLoop::setupBuffers(void)
+{
+	buf_ring_size = URING_BUFFER_COUNT * sizeof(io_uring_buf);
+	buf_ring = (io_uring_buf_ring *) mmap( nullptr, buf_ring_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	if ( buf_ring == MAP_FAILED )
+		throw std::ios_base::failure( "Unable to allocate buffer ring" );
+
+	io_uring_buf_reg reg;
+	memset( &reg, 0, sizeof(reg) );
+	reg.ring_addr = (uint64_t) (uintptr_t) buf_ring;
+	reg.ring_entries = URING_BUFFER_COUNT;
+	reg.bgid = URING_BUFFER_GROUP;
+
+	if ( syscall( __NR_io_uring_register, ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1 ) < 0 )
+		throw std::ios_base::failure( "io_uring lacks provided buffer rings" );
+
+	buffers = new char[URING_BUFFER_COUNT * URING_BUFFER_SIZE];
+	for ( unsigned i = 0; i < URING_BUFFER_COUNT; i++ )
+		recycleBuffer( (uint16_t) i );
+}
+
+void UringEventLoop::teardown(void)
+{
+	// closing the ring cancels everything still in flight
+	if ( ring_fd >= 0 )
+		close( ring_fd );
+	ring_fd = -1;
+
+	if ( sqes != MAP_FAILED )
+		munmap( sqes, sqes_size );
+	if ( ( cq_ptr != MAP_FAILED ) && ( cq_ptr != sq_ptr ) )
+		munmap( cq_ptr, cq_size );
+	if ( sq_ptr != MAP_FAILED )
+		munmap( sq_ptr, sq_size );
+	if ( buf_ring != MAP_FAILED )
+		munmap( buf_ring, buf_ring_size );
+	sqes = (io_uring_sqe *) MAP_FAILED;
+	sq_ptr = cq_ptr = MAP_FAILED;
+	buf_ring = (io_uring_buf_ring *) MAP_FAILED;
+
+	delete [] buffers;
+	buffers = nullptr;
+}
+
+io_uring_sqe *UringEventLoop::getSqe(void)
+{
+	unsigned tail = *sq_tail;
+
+	if ( tail - __atomic_load_n( sq_head, __ATOMIC_ACQUIRE ) >= sq_entries )
+	{
+		enter( to_submit, 0, 0 );
+		if ( tail - __atomic_load_n( sq_head, __ATOMIC_ACQUIRE ) >= sq_entries )
+			throw std::ios_base::failure( "io_uring submission queue full" );
+	}
+
+	unsigned idx = tail & *sq_mask;
+	io_uring_sqe *sqe = &sqes[idx];
+	memset( sqe, 0, sizeof(*sqe) );
+	sq_array[idx] = idx;
+
+	// the kernel only looks at the ring during io_uring_enter()
+	__atomic_store_n( sq_tail, tail + 1, __ATOMIC_RELEASE );
+	to_submit++;
+	return ( sqe );
+}
+
+int UringEventLoop::enter(unsigned submit, unsigned wait, int timeout)
+{
+	io_uring_getevents_arg arg;
+	__kernel_timespec ts;
+	unsigned flags = IORING_ENTER_EXT_ARG;
+
+	memset( &arg, 0, sizeof(arg) );
+	if ( wait )
+	{
+		flags |= IORING_ENTER_GETEVENTS;
+		if ( timeout >= 0 )
+		{
+			ts.tv_sec = timeout / 1000;
+			ts.tv_nsec = ( timeout % 1000 ) * 1000000L;
+			arg.ts = (uint64_t) (uintptr_t) &ts;
+		}
+	}
+
+	syscalls++;
+	int ret = (int) syscall( __NR_io_uring_enter, ring_fd, submit, wait, flags, &arg, sizeof(arg) );
+	if ( ret < 0 )
+	{
+		if ( errno == EINTR || errno == ETIME || errno == EBUSY || errno == EAGAIN )
+			return ( 0 );
+		throw std::ios_base::failure( "io_uring_enter() failed" );
+	}
+
+	to_submit -= std::min( (unsigned) ret, to_submit );
+	return ( ret );
+}
+
+void UringEventLoop::armAccept(Client &c)
+{
+	io_uring_sqe *sqe = getSqe();
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = c.fd;
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;	// as accept4() in the epoll loop
+	sqe->user_data = tag( &c, OP_ACCEPT );
+	c.pending++;
+}
+
+void UringEventLoop::armRecv(Client &c)
+{
+	io_uring_sqe *sqe = getSqe();
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = c.fd;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = URING_BUFFER_GROUP;
+	sqe->user_data = tag( &c, OP_RECV );
+	c.pending++;
+	c.recv_armed = true;
+}
+
+void UringEventLoop::cancelRecv(Client &c)
+{
+	io_uring_sqe *sqe = getSqe();
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = tag( &c, OP_RECV );
+	sqe->user_data = tag( nullptr, OP_CANCEL );
+}
+
+void UringEventLoop::armSend(Client &c)
+{
+	c.send_iov.resize( URING_SEND_IOV );
+	int cnt = c.outbound.gather( c.send_iov.data(), URING_SEND_IOV );
+	if ( cnt == 0 )
+		return;
+
+	// the frames stay put in the queue until consume(), so the kernel can read them in place
+	memset( &c.send_hdr, 0, sizeof(c.send_hdr) );
+	c.send_hdr.msg_iov = c.send_iov.data();
+	c.send_hdr.msg_iovlen = cnt;
+
+	io_uring_sqe *sqe = getSqe();
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = c.fd;
+	sqe->addr = (uint64_t) (uintptr_t) &c.send_hdr;
+	sqe->len = 1;
+	sqe->msg_flags = MSG_NOSIGNAL;
+	sqe->user_data = tag( &c, OP_SEND );
+	c.pending++;
+	c.send_armed = true;
+}
+
+void UringEventLoop::armWake(void)
+{
+	Client &c = slot( wakefd );
+
+	io_uring_sqe *sqe = getSqe();
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = wakefd;
+	sqe->addr = (uint64_t) (uintptr_t) &wakebuf;
+	sqe->len = sizeof(wakebuf);
+	sqe->user_data = tag( &c, OP_WAKE );
+	c.pending++;
+}
+
+void UringEventLoop::recycleBuffer(uint16_t bid)
+{
+	// index the ring as a plain array: in C++ the header's flex array member
+	// lands at offset 8 instead of 0.  The tail overlays bufs[0].resv.
+	io_uring_buf *bufs = (io_uring_buf *) buf_ring;
+
+	io_uring_buf &b = bufs[buf_tail & ( URING_BUFFER_COUNT - 1 )];
+	b.addr = (uint64_t) (uintptr_t) ( buffers + bid * URING_BUFFER_SIZE );
+	b.len = URING_BUFFER_SIZE;
+	b.bid = bid;
+
+	buf_tail++;
+	__atomic_store_n( &bufs[0].resv, buf_tail, __ATOMIC_RELEASE );
+}
+
+void UringEventLoop::release(Client *c)
+{
+	if ( ( c->kind != KIND_NONE ) || c->pending )
+		return;
+
+	for ( auto it = draining.begin(); it != draining.end(); ++it )
+	{
+		if ( it->get() == c )
+		{
+			draining.erase( it );
+			return;
+		}
+	}
+}
+
+void UringEventLoop::handleCompletion(io_uring_cqe *cqe)
+{
+	int op = (int) ( cqe->user_data & OPERATION_MASK );
+	Client *c = (Client *) (uintptr_t) ( cqe->user_data & ~OPERATION_MASK );
+
+	// a multishot request has ended once IORING_CQE_F_MORE is clear; the
+	// count drops last so a client closed by a callback is not freed under us
+	bool done = !( cqe->flags & IORING_CQE_F_MORE );
+	int res = cqe->res;
+
+	switch ( op )
+	{
+	case OP_ACCEPT :
+		if ( ( res >= 0 ) && c->listener )
+			c->listener->applyProfile( res );
+		if ( ( res >= 0 ) && !( on_handoff && on_handoff( c->fd, res ) ) )
+		{
+			registerClient( res );
+			if ( on_accept )
+				on_accept( res );
+		}
+		if ( done )
+		{
+			c->pending--;
+			if ( c->kind == KIND_LISTENER )
+				armAccept( *c );
+		}
+		break;
+
+	case OP_RECV :
+	{
+		if ( done )
+			c->recv_armed = false;
+
+		bool hasbuf = ( cqe->flags & IORING_CQE_F_BUFFER ) != 0;
+		uint16_t bid = (uint16_t) ( cqe->flags >> IORING_CQE_BUFFER_SHIFT );
+
+		if ( ( res > 0 ) && hasbuf && ( c->kind == KIND_CLIENT ) )
+			handleData( *c, buffers + bid * URING_BUFFER_SIZE, res );
+		if ( hasbuf )
+			recycleBuffer( bid );
+
+		if ( c->kind == KIND_CLIENT )
+		{
+			// a paused client still holds frames; the recv armed on resume sees the end again
+			if ( ( ( res == 0 ) && !c->paused ) || ( ( res < 0 ) && ( res != -ENOBUFS ) && ( res != -EAGAIN ) &&
+					( res != -EINTR ) && ( res != -ECANCELED ) ) )
+				closeClient( c->fd );	// orderly shutdown or error
+			else if ( !c->recv_armed && !c->paused )
+				armRecv( *c );			// ran out of buffers, the kernel ended it or reads resumed
+		}
+
+		if ( done )
+			c->pending--;
+		release( c );
+		break;
+	}
+
+	case OP_SEND :
+		c->send_armed = false;
+		if ( c->kind == KIND_CLIENT )
+		{
+			if ( res > 0 )
+			{
+				c->outbound.consume( res );
+				armSend( *c );
+				checkWritable( *c );
+			}
+			else if ( ( res == -EAGAIN ) || ( res == -EINTR ) )
+				armSend( *c );
+			else
+				closeClient( c->fd );
+		}
+		c->pending--;
+		release( c );
+		break;
+
+	case OP_WAKE :
+		c->pending--;
+		armWake();
+		if ( res > 0 )
+			handleWakeup();
+		break;
+
+	default:
+		break;	// cancellations
+	}
+}
+
+void UringEventLoop::handleData(Client &c, const char *data, size_t length)
+{
+	int fd = c.fd;
+	size_t used;
+
+	if ( c.partial.empty() )
+	{
+		// common case: deliver straight out of the provided buffer
+		if ( ( ( used = deliverFrames( fd, data, length ) ) == (size_t) -1 ) || ( c.kind != KIND_CLIENT ) )
+			return;
+		c.partial.assign( data + used, data + length );
+		return;
+	}
+
+	c.partial.insert( c.partial.end(), data, data + length );
+	if ( ( ( used = deliverFrames( fd, c.partial.data(), c.partial.size() ) ) == (size_t) -1 ) || ( c.kind != KIND_CLIENT ) )
+		return;
+	c.partial.erase( c.partial.begin(), c.partial.begin() + used );
+}
+
+} /* namespace kcmsg */
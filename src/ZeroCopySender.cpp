@@ -0,0 +1,312 @@
+/*
+ * ZeroCopySender.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#include "ZeroCopySender.h"
+
+#include <cstring>
+#include <ctime>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+
+namespace kcmsg {
+
+static uint64_t now(void)
+{
+	timespec ts;
+	clock_gettime( CLOCK_MONOTONIC_COARSE, &ts );
+	return ( (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000 );
+}
+
+ZeroCopySender::ZeroCopySender(int sockfd, size_t min_length)
+{
+	fd = sockfd;
+	threshold = min_length;
+	next_id = 0;
+	copied_run = 0;
+	zerocopy_sends = 0;
+	copied = 0;
+
+	int on = 1;
+	enabled = ( setsockopt( fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on) ) == 0 );
+}
+
+ZeroCopySender::~ZeroCopySender()
+{
+}
+
+std::vector<char> ZeroCopySender::getBuffer(size_t length)
+{
+	std::vector<char> buffer;
+
+	reap( 0 );
+	if ( !free_list.empty() )
+	{
+		buffer = std::move( free_list.back() );
+		free_list.pop_back();
+	}
+	buffer.resize( length );
+	return ( buffer );
+}
+
+size_t ZeroCopySender::send(std::vector<char> &&frame)
+{
+	size_t length = frame.size();
+
+	if ( !enabled || ( length < threshold ) )
+	{
+		size_t n = sendCopy( frame.data(), length );
+		recycle( std::move( frame ) );
+		return ( n );
+	}
+
+	reap( 0 );
+	if ( ( in_flight.size() >= ZEROCOPY_MAX_IN_FLIGHT ) && !drain( ZEROCOPY_DRAIN_WAIT, ZEROCOPY_MAX_IN_FLIGHT - 1 ) )
+	{
+		recycle( std::move( frame ) );
+		errno = ENOBUFS;	// the peer is not acknowledging
+		return (-1);
+	}
+
+	InFlight f;
+	f.buffer = std::move( frame );
+	f.first = next_id;
+	f.count = 0;
+
+	size_t sent = 0;
+	while ( sent < length )
+	{
+		ssize_t n = ::send( fd, f.buffer.data() + sent, length - sent, MSG_ZEROCOPY | MSG_NOSIGNAL );
+		if ( n >= 0 )
+		{
+			sent += n;
+			f.count++;
+			next_id++;
+			zerocopy_sends++;
+			continue;
+		}
+
+		if ( errno == EINTR )
+			continue;
+		if ( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) )
+		{
+			waitWritable();
+			continue;
+		}
+		if ( ( errno == ENOBUFS ) && ( reap( ZEROCOPY_DRAIN_WAIT ) > 0 ) )
+			continue;	// out of notification memory until completions are read
+
+		if ( errno == ENOBUFS )
+		{
+			// nothing left to reap: finish this frame the ordinary way
+			if ( sendCopy( f.buffer.data() + sent, length - sent ) == (size_t) -1 )
+				break;
+			sent = length;
+			continue;
+		}
+		break;
+	}
+
+	int err = errno;
+	f.remaining = f.count;
+	if ( f.count > 0 )
+		in_flight.push_back( std::move( f ) );
+	else
+		recycle( std::move( f.buffer ) );
+
+	if ( sent < length )
+	{
+		errno = err;
+		return (-1);
+	}
+	return ( length );
+}
+
+size_t ZeroCopySender::send(const char *frame, size_t length)
+{
+	return sendCopy( frame, length );
+}
+
+size_t ZeroCopySender::reap(int timeout)
+{
+	if ( in_flight.empty() )
+		return ( 0 );
+
+	if ( ( timeout != 0 ) && !waitFor( 0, timeout ) )
+		return ( 0 );
+
+	for (;;)
+	{
+		char control[CMSG_SPACE( sizeof(sock_extended_err) + sizeof(sockaddr_in6) )];
+		msghdr hdr = {0};
+		hdr.msg_control = control;
+		hdr.msg_controllen = sizeof(control);
+
+		if ( recvmsg( fd, &hdr, MSG_ERRQUEUE | MSG_DONTWAIT ) < 0 )
+		{
+			if ( errno == EINTR )
+				continue;
+			break;
+		}
+
+		for ( cmsghdr *cm = CMSG_FIRSTHDR( &hdr ); cm != nullptr; cm = CMSG_NXTHDR( &hdr, cm ) )
+		{
+			if ( !( ( cm->cmsg_level == SOL_IP ) && ( cm->cmsg_type == IP_RECVERR ) ) &&
+					!( ( cm->cmsg_level == SOL_IPV6 ) && ( cm->cmsg_type == IPV6_RECVERR ) ) )
+				continue;
+
+			sock_extended_err serr;
+			std::memcpy( &serr, CMSG_DATA( cm ), sizeof(serr) );
+			if ( ( serr.ee_errno != 0 ) || ( serr.ee_origin != SO_EE_ORIGIN_ZEROCOPY ) )
+				continue;
+
+			// the kernel reports the inclusive range [ee_info, ee_data]
+			if ( serr.ee_code & SO_EE_CODE_ZEROCOPY_COPIED )
+			{
+				copied += (uint32_t) ( serr.ee_data - serr.ee_info ) + 1;
+				if ( ++copied_run >= ZEROCOPY_COPY_LIMIT )
+					enabled = false;
+			}
+			else
+				copied_run = 0;
+
+			complete( serr.ee_info, serr.ee_data );
+		}
+	}
+
+	size_t released = 0;
+	for ( auto it = in_flight.begin(); it != in_flight.end(); )
+	{
+		if ( it->remaining > 0 )
+		{
+			++it;
+			continue;
+		}
+		recycle( std::move( it->buffer ) );
+		it = in_flight.erase( it );
+		released++;
+	}
+
+	return ( released );
+}
+
+bool ZeroCopySender::drain(int timeout, size_t left)
+{
+	uint64_t deadline = now() + timeout;
+
+	while ( in_flight.size() > left )
+	{
+		uint64_t t = now();
+		if ( t >= deadline )
+			break;
+		if ( !waitFor( 0, (int) ( deadline - t ) ) )
+			break;
+		reap( 0 );
+	}
+
+	return ( in_flight.size() <= left );
+}
+
+void ZeroCopySender::setThreshold(size_t min_length)
+{
+	threshold = min_length;
+}
+
+bool ZeroCopySender::isZeroCopy(void)
+{
+	return ( enabled );
+}
+
+size_t ZeroCopySender::inFlight(void)
+{
+	return ( in_flight.size() );
+}
+
+uint64_t ZeroCopySender::getZeroCopyCount(void)
+{
+	return ( zerocopy_sends );
+}
+
+uint64_t ZeroCopySender::getCopiedCount(void)
+{
+	return ( copied );
+}
+
+/* private methods */
+
+void ZeroCopySender::complete(uint32_t lo, uint32_t hi)
+{
+	uint32_t span = hi - lo;	// the numbers wrap at 2^32
+
+	for ( auto &f : in_flight )
+	{
+		for ( uint32_t i = 0; ( i < f.count ) && ( f.remaining > 0 ); i++ )
+		{
+			if ( (uint32_t) ( f.first + i - lo ) <= span )
+				f.remaining--;
+		}
+	}
+}
+
+bool ZeroCopySender::waitFor(short events, int timeout)
+{
+	// with no events requested poll() still reports POLLERR, which is how a
+	// non-empty error queue shows
+	pollfd p = { fd, events, 0 };
+
+	int n;
+	do
+	{
+		n = poll( &p, 1, timeout );
+	} while ( ( n < 0 ) && ( errno == EINTR ) );
+
+	return ( ( n > 0 ) && !( p.revents & POLLNVAL ) );
+}
+
+size_t ZeroCopySender::sendCopy(const char *frame, size_t length)
+{
+	size_t sent = 0;
+
+	while ( sent < length )
+	{
+		ssize_t n = ::send( fd, frame + sent, length - sent, MSG_NOSIGNAL );
+		if ( n >= 0 )
+		{
+			sent += n;
+			continue;
+		}
+		if ( errno == EINTR )
+			continue;
+		if ( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) )
+		{
+			waitWritable();
+			continue;
+		}
+		return (-1);
+	}
+
+	return ( length );
+}
+
+void ZeroCopySender::recycle(std::vector<char> &&buffer)
+{
+	// callers may hand in buffers of their own; keep no more than can be in flight
+	if ( free_list.size() < ZEROCOPY_MAX_IN_FLIGHT )
+		free_list.push_back( std::move( buffer ) );
+}
+
+void ZeroCopySender::waitWritable(void)
+{
+	// completions waiting on the error queue raise POLLERR, which would end
+	// the wait at once and spin; read them first
+	reap( 0 );
+	waitFor( POLLOUT, -1 );
+}
+
+} /* namespace kcmsg */
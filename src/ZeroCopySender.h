@@ -0,0 +1,112 @@
+/*
+ * ZeroCopySender.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ */
+
+#ifndef ZEROCOPYSENDER_H_
+#define ZEROCOPYSENDER_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <deque>
+
+namespace kcmsg {
+
+const size_t ZEROCOPY_THRESHOLD = 16 * 1024;	// smaller frames are cheaper to copy
+const size_t ZEROCOPY_MAX_IN_FLIGHT = 64;		// buffers the kernel may hold at once
+const uint32_t ZEROCOPY_COPY_LIMIT = 32;		// copied completions in a row before giving up
+const int ZEROCOPY_DRAIN_WAIT = 1000;			// ms to wait for completions at close
+
+/*
+ * ZeroCopySender sends large frames on a TCP socket with MSG_ZEROCOPY, so
+ * the kernel transmits straight from user memory instead of copying the
+ * frame into the socket buffer.
+ *
+ * The kernel keeps reading a buffer after send() returns, until it reports
+ * on the socket's error queue that the data is acknowledged.  The caller
+ * therefore builds the frame in a buffer it got from getBuffer() and hands
+ * it over with send(); the buffer returns to the free list only when every
+ * send() that used it has completed.  The kernel numbers zero copy sends
+ * per socket and reports ranges of those numbers, which reap() matches
+ * against the buffers in flight.
+ *
+ * A frame in the caller's own memory, which the caller may reuse as soon as
+ * send() returns, would have to be copied first, and that copy costs what
+ * the kernel's does; it goes out with an ordinary copying send().  So do
+ * frames below the threshold, and everything when the socket refuses
+ * SO_ZEROCOPY, or once the kernel
+ * has reported ZEROCOPY_COPY_LIMIT completions in a row that it had to
+ * copy anyway (loopback, or a device without scatter gather), where
+ * MSG_ZEROCOPY only adds the cost of the notifications.
+ */
+class ZeroCopySender {
+private:
+	struct InFlight
+	{
+		std::vector<char> buffer;
+		uint32_t first;			// kernel number of the first send() from it
+		uint32_t count;			// send() calls made from it
+		uint32_t remaining;		// of those, not yet reported complete
+	};
+
+	int fd;
+	size_t threshold;
+	bool enabled;
+	uint32_t next_id;			// number the kernel gives the next zero copy send()
+	uint32_t copied_run;
+	uint64_t zerocopy_sends;
+	uint64_t copied;
+	std::deque<InFlight> in_flight;
+	std::vector<std::vector<char>> free_list;
+
+	void complete(uint32_t lo, uint32_t hi);
+	bool waitFor(short events, int timeout);
+	size_t sendCopy(const char *frame, size_t length);
+	void waitWritable(void);
+	void recycle(std::vector<char> &&buffer);
+
+public:
+	ZeroCopySender(int sockfd, size_t min_length = ZEROCOPY_THRESHOLD);
+	virtual ~ZeroCopySender();
+
+	/* getBuffer() returns a buffer of 'length' bytes from the free list for
+	 *        the caller to build a frame in.
+	 * send() sends the whole frame in 'frame', zero copy if it is long
+	 *        enough, and keeps the buffer until the kernel is done with
+	 *        it, blocking while the socket is full or
+	 *        ZEROCOPY_MAX_IN_FLIGHT buffers are out.  Returns the frame
+	 *        length or -1 with errno set; ENOBUFS if no buffer came back
+	 *        within ZEROCOPY_DRAIN_WAIT.
+	 * send(frame, length) sends a frame from the caller's memory with a
+	 *        copying send().
+	 */
+	std::vector<char> getBuffer(size_t length);
+	size_t send(std::vector<char> &&frame);
+	size_t send(const char *frame, size_t length);
+
+	/* reap() reads the completions waiting on the error queue and returns
+	 *        the buffers they release to the free list, waiting at most
+	 *        'timeout' ms for the first one.  Returns the number released.
+	 * drain() reaps until at most 'left' buffers are in flight or 'timeout'
+	 *        ms passed.  Returns true if they are.  Call it before closing the
+	 *        socket, since a buffer freed early may be reused while the
+	 *        kernel still reads it.
+	 */
+	size_t reap(int timeout = 0);
+	bool drain(int timeout = ZEROCOPY_DRAIN_WAIT, size_t left = 0);
+
+	void setThreshold(size_t min_length);
+	bool isZeroCopy(void);
+	size_t inFlight(void);
+
+	/* zero copy sends made, and of those the ones the kernel copied anyway */
+	uint64_t getZeroCopyCount(void);
+	uint64_t getCopiedCount(void);
+};
+
+} /* namespace kcmsg */
+
+#endif /* ZEROCOPYSENDER_H_ */
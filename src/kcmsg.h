@@ -11,8 +11,28 @@
 #include <kcmsg/NetworkInterface.h>
 #include <kcmsg/Configuration.h>
 #include <kcmsg/Connection.h>
+#include <kcmsg/ConnectionPool.h>
+#include <kcmsg/ReconnectingConnection.h>
+#include <kcmsg/Resolver.h>
+#include <kcmsg/SocketProfile.h>
+#include <kcmsg/SharedRing.h>
 #include <kcmsg/Message.h>
+#include <kcmsg/RpcChannel.h>
 #include <kcmsg/Property.h>
+#include <kcmsg/DeduplicationWindow.h>
+#include <kcmsg/RetransmitQueue.h>
+#include <kcmsg/OutboundQueue.h>
+#include <kcmsg/ReceiveBuffer.h>
+#include <kcmsg/DatagramBatch.h>
+#include <kcmsg/ZeroCopySender.h>
+#include <kcmsg/Journal.h>
+#include <kcmsg/RoutingTable.h>
+#include <kcmsg/FrameRelay.h>
+#include <kcmsg/SubscriberSet.h>
+#include <kcmsg/SubscriptionIndex.h>
+#include <kcmsg/EventLoop.h>
+#include <kcmsg/UringEventLoop.h>
+#include <kcmsg/EventLoopGroup.h>
 
 
 
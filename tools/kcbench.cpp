@@ -0,0 +1,299 @@
+/*
+ * kcbench.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ *
+ *  Compares the EventLoop backends on the loopback interface.  A server loop
+ *  on the main thread receives messages from client threads and optionally
+ *  echoes each one back; the report gives throughput and the number of
+ *  system calls the loop issued per message.
+ *
+ *  usage: kcbench [options]
+ *    -b, --backend NAME    epoll | uring | both (default both)
+ *    -c, --clients N       client connections, one thread each (default 8)
+ *    -n, --messages N      messages per client (default 100000)
+ *    -s, --size BYTES      encoded message size (default 64)
+ *    -e, --echo            echo every message back to its sender
+ *    -o, --once            send once-and-only-once messages through the
+ *                          loop's DeduplicationWindow, which acks them
+ *
+ *  Clients write in batches of BENCH_BATCH frames so the client side is not
+ *  the bottleneck; the server sees many frames per read, as a busy broker
+ *  would.
+ */
+
+#include <kcmsg/Connection.h>
+#include <kcmsg/EventLoop.h>
+#include <kcmsg/Message.h>
+#include <kcmsg/DeduplicationWindow.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <memory>
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <ios>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <boost/endian/buffers.hpp>
+
+namespace {
+
+const int BENCH_BATCH = 64;
+
+struct Options
+{
+	int clients;
+	uint64_t messages;
+	size_t size;
+	bool echo;
+	bool once;
+};
+
+uint64_t monotonic(void)
+{
+	timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ( (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec );
+}
+
+std::vector<char> makeFrame(size_t size, bool once)
+{
+	kcmsg::Message msg;
+	msg.setTransactionOrganization( 1 );
+	msg.setTransactionApplication( 1 );
+	msg.setOnceAndOnlyOnce( once );
+
+	// putByte() adds two bytes and putShort() three; an odd remainder
+	// takes one short so the frame comes out at exactly 'size' (a byte
+	// short when only one byte is left over)
+	if ( ( size > msg.getMessageLength() + 2 ) && ( ( size - msg.getMessageLength() ) & 1 ) )
+		msg.putShort( 0 );
+	while ( msg.getMessageLength() + 2 <= size )
+		msg.putByte( 0 );
+
+	const char *frame = msg.serialize();
+	return ( std::vector<char>( frame, frame + msg.getMessageLength() ) );
+}
+
+void client(std::string service, const Options *opts, const std::vector<char> *frame)
+{
+	try
+	{
+		kcmsg::Connection conn( AF_INET, SOCK_STREAM, IPPROTO_TCP, 1, "kcbench" );
+		conn.resolveHost( "127.0.0.1", service );
+		conn.Connect();
+		int fd = conn.getDescriptor();
+
+		std::vector<char> batch;
+		for ( int i = 0; i < BENCH_BATCH; i++ )
+			batch.insert( batch.end(), frame->begin(), frame->end() );
+
+		// once-and-only-once frames each need their own sequence number
+		boost::endian::little_uint32_buf_t session, seq;
+		session = std::random_device()();
+		uint32_t next = 1;
+		if ( opts->once )
+		{
+			for ( int i = 0; i < BENCH_BATCH; i++ )
+				memcpy( &batch[i * frame->size() + kcmsg::MESSAGE_SESSION_OFFSET], &session, sizeof(session) );
+		}
+
+		// drain echoes and acks concurrently so neither side stalls on a
+		// full socket; acks are counted by their end of file
+		std::thread reader;
+		if ( opts->echo || opts->once )
+		{
+			uint64_t expect = opts->echo ? opts->messages * frame->size() : UINT64_MAX;
+			reader = std::thread( [fd, expect]()
+				{
+					char buf[65536];
+					uint64_t got = 0;
+					while ( got < expect )
+					{
+						ssize_t n = read( fd, buf, sizeof(buf) );
+						if ( n <= 0 )
+							break;
+						got += n;
+					}
+				} );
+		}
+
+		for ( uint64_t sent = 0; sent < opts->messages; )
+		{
+			uint64_t count = std::min( (uint64_t) BENCH_BATCH, opts->messages - sent );
+			for ( uint64_t i = 0; opts->once && ( i < count ); i++ )
+			{
+				seq = next++;
+				memcpy( &batch[i * frame->size() + kcmsg::MESSAGE_SEQUENCE_OFFSET], &seq, sizeof(seq) );
+			}
+			if ( conn.Writen( batch.data(), count * frame->size() ) == (size_t) -1 )
+				break;
+			sent += count;
+		}
+
+		if ( !opts->echo )
+			conn.Shutdown( fd, SHUT_WR );	// the server closes, which ends the ack reader
+		if ( reader.joinable() )
+			reader.join();
+		if ( opts->echo )
+			conn.Shutdown( fd, SHUT_WR );
+		conn.Close( fd );
+	}
+	catch ( std::exception &e )
+	{
+		fprintf( stderr, "client: %s\n", e.what() );
+	}
+}
+
+bool bench(int backend, const Options &opts)
+{
+	kcmsg::Connection listener( AF_INET, SOCK_STREAM, IPPROTO_TCP, opts.clients, "kcbench" );
+	listener.Bind();
+	listener.Listen();
+
+	sockaddr_in local;
+	socklen_t len = sizeof(local);
+	getsockname( listener.getDescriptor(), (sockaddr *) &local, &len );
+	std::string service = std::to_string( ntohs( local.sin_port ) );
+
+	std::unique_ptr<kcmsg::EventLoop> loop;
+	try
+	{
+		loop.reset( kcmsg::EventLoop::create( backend ) );
+	}
+	catch ( std::exception &e )
+	{
+		fprintf( stderr, "%-6s unavailable: %s\n", backend == kcmsg::EVENT_BACKEND_URING ? "uring" : "epoll", e.what() );
+		return ( false );
+	}
+
+	uint64_t expected = opts.messages * opts.clients;
+	uint64_t received = 0;
+	size_t closed = 0;
+	kcmsg::Message echo;
+
+	loop->setMessageCallback( [&]( int fd, const char *frame, size_t length )
+		{
+			received++;
+			if ( opts.echo )
+			{
+				echo.deserialize( frame, length );
+				loop->send( fd, &echo );
+			}
+		} );
+	loop->setCloseCallback( [&]( int fd ) { closed++; } );
+	loop->addListener( &listener );
+	if ( opts.once )
+		loop->setDeduplication( kcmsg::DEFAULT_DEDUP_CAPACITY );
+
+	std::vector<char> frame = makeFrame( opts.size, opts.once );
+	std::vector<std::thread> threads;
+	uint64_t start = monotonic();
+
+	for ( int i = 0; i < opts.clients; i++ )
+		threads.push_back( std::thread( client, service, &opts, &frame ) );
+
+	while ( closed < (size_t) opts.clients )
+		loop->runOnce( 100 );
+
+	double elapsed = ( monotonic() - start ) / 1e9;
+	for ( auto &t : threads )
+		t.join();
+
+	uint64_t syscalls = loop->getSyscallCount();
+	printf( "%-6s%s %llu/%llu messages of %zu bytes in %.3f s: %.0f msgs/s, %.4f syscalls/msg\n",
+			loop->getBackend() == kcmsg::EVENT_BACKEND_URING ? "uring" : "epoll", opts.once ? " once" : "",
+			(unsigned long long) received, (unsigned long long) expected, frame.size(), elapsed,
+			received / elapsed, received ? (double) syscalls / received : 0.0 );
+
+	listener.Close( listener.getDescriptor() );
+	return ( received == expected );
+}
+
+void usage(const char *prog)
+{
+	fprintf( stderr, "usage: %s [-b epoll|uring|both] [-c clients] [-n messages] [-s size] [-e] [-o]\n", prog );
+	exit( 2 );
+}
+
+} /* namespace */
+
+int main(int argc, char *argv[])
+{
+	static option longopts[] = {
+		{ "backend", required_argument, nullptr, 'b' },
+		{ "clients", required_argument, nullptr, 'c' },
+		{ "messages", required_argument, nullptr, 'n' },
+		{ "size", required_argument, nullptr, 's' },
+		{ "echo", no_argument, nullptr, 'e' },
+		{ "once", no_argument, nullptr, 'o' },
+		{ nullptr, 0, nullptr, 0 }
+	};
+
+	Options opts = { 8, 100000, 64, false, false };
+	std::vector<int> backends = { kcmsg::EVENT_BACKEND_EPOLL, kcmsg::EVENT_BACKEND_URING };
+	int opt;
+
+	while ( ( opt = getopt_long( argc, argv, "b:c:n:s:eo", longopts, nullptr ) ) != -1 )
+	{
+		switch ( opt )
+		{
+		case 'b' :
+			if ( strcmp( optarg, "epoll" ) == 0 )
+				backends = { kcmsg::EVENT_BACKEND_EPOLL };
+			else if ( strcmp( optarg, "uring" ) == 0 )
+				backends = { kcmsg::EVENT_BACKEND_URING };
+			else if ( strcmp( optarg, "both" ) != 0 )
+				usage( argv[0] );
+			break;
+		case 'c' :
+			opts.clients = atoi( optarg );
+			break;
+		case 'n' :
+			opts.messages = strtoull( optarg, nullptr, 10 );
+			break;
+		case 's' :
+			opts.size = strtoul( optarg, nullptr, 10 );
+			break;
+		case 'e' :
+			opts.echo = true;
+			break;
+		case 'o' :
+			opts.once = true;
+			break;
+		default:
+			usage( argv[0] );
+		}
+	}
+
+	if ( ( optind != argc ) || ( opts.clients < 1 ) || ( opts.messages == 0 ) ||
+			( opts.size > kcmsg::MAX_MSG_DATA ) )
+		usage( argv[0] );
+
+	bool ok = true;
+	for ( int backend : backends )
+	{
+		try
+		{
+			ok = bench( backend, opts ) && ok;
+		}
+		catch ( std::exception &e )
+		{
+			fprintf( stderr, "%s: %s\n", argv[0], e.what() );
+			ok = false;
+		}
+	}
+
+	return ( ok ? 0 : 1 );
+}
@@ -0,0 +1,338 @@
+/*
+ * kcreplay.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: kurt
+ *
+ *  Replays a recorded message journal or capture file against a Connection
+ *  endpoint and reports throughput and send latency percentiles.
+ *
+ *  usage: kcreplay [options] host service
+ *    -j, --journal DIR     replay a Journal directory
+ *    -c, --capture FILE    replay a capture file of back to back frames
+ *    -m, --mode MODE       original | accelerated | max (default original)
+ *    -s, --speed FACTOR    speed up factor for accelerated mode (default 10)
+ *    -t, --threads N       sender threads, each with its own Connection (default 1)
+ *    -l, --loop N          replay the recording N times (default 1)
+ *    -6, --ipv6            connect over IPv6
+ *
+ *  Records are dealt round robin to the sender threads.  In original and
+ *  accelerated mode every record is scheduled at its recorded offset from
+ *  the first record (divided by the speed factor); the reported latency is
+ *  the time from that schedule point until the frame was written, so it
+ *  includes any time the sender fell behind.  In max mode the schedule point
+ *  is the moment the thread picked the record up.  Capture files carry no
+ *  timestamps and are always replayed at max rate.
+ */
+
+#include <kcmsg/Connection.h>
+#include <kcmsg/Journal.h>
+#include <kcmsg/Message.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include <ios>
+#include <getopt.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <boost/endian/buffers.hpp>
+
+namespace {
+
+enum ReplayMode { MODE_ORIGINAL, MODE_ACCELERATED, MODE_MAX };
+
+struct Record
+{
+	uint64_t timestamp;		// nanoseconds, 0 when unknown
+	size_t offset;			// into the frame store
+	size_t length;
+};
+
+struct SenderResult
+{
+	uint64_t messages;
+	uint64_t bytes;
+	uint64_t errors;
+	std::vector<uint64_t> latencies;	// nanoseconds
+};
+
+std::vector<char> frames;
+std::vector<Record> records;
+
+uint64_t monotonic(void)
+{
+	timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ( (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec );
+}
+
+void sleepUntil(uint64_t deadline)
+{
+	timespec ts;
+	ts.tv_sec = deadline / 1000000000ULL;
+	ts.tv_nsec = deadline % 1000000000ULL;
+	// anything but an interrupted sleep is a bad deadline, so send at once
+	while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr ) == EINTR )
+		;
+}
+
+/* sendAll() writes the whole frame; a vanished peer is an error, not SIGPIPE */
+bool sendAll(int fd, const char *buf, size_t length)
+{
+	while ( length > 0 )
+	{
+		ssize_t n = send( fd, buf, length, MSG_NOSIGNAL );
+		if ( n < 0 )
+		{
+			if ( errno == EINTR )
+				continue;
+			return ( false );
+		}
+		buf += n;
+		length -= n;
+	}
+	return ( true );
+}
+
+void loadJournal(const std::string &dir)
+{
+	// read only: the recording keeps its own segment size and is never touched
+	kcmsg::Journal journal( dir );
+
+	journal.replay( journal.getFirstSequence(),
+			[]( uint64_t seq, uint64_t ts, const char *frame, size_t length )
+			{
+				Record r = { ts, frames.size(), length };
+				frames.insert( frames.end(), frame, frame + length );
+				records.push_back( r );
+			} );
+}
+
+void loadCapture(const std::string &file)
+{
+	FILE *fd;
+	if ( ( fd = fopen( file.c_str(), "rb" ) ) == nullptr )
+		throw std::ios_base::failure( "Unable to open capture file" );
+
+	char hdr[kcmsg::MESSAGE_HEADER_LENGTH];
+	while ( fread( hdr, sizeof(hdr), 1, fd ) == 1 )
+	{
+		boost::endian::little_uint16_buf_t len;
+		memcpy( &len, &hdr[kcmsg::MESSAGE_LENGTH_OFFSET], sizeof(len) );
+		if ( len.value() < kcmsg::MESSAGE_HEADER_LENGTH )
+			break;	// not a frame boundary, stop at the damage
+
+		Record r = { 0, frames.size(), len.value() };
+		frames.insert( frames.end(), hdr, hdr + sizeof(hdr) );
+		frames.resize( r.offset + r.length );
+		if ( ( r.length > sizeof(hdr) ) &&
+				( fread( &frames[r.offset + sizeof(hdr)], r.length - sizeof(hdr), 1, fd ) != 1 ) )
+		{
+			frames.resize( r.offset );
+			break;
+		}
+		records.push_back( r );
+	}
+
+	fclose( fd );
+}
+
+void sender(int id, int nthreads, int loops, ReplayMode mode, double speed, sa_family_t family,
+		std::string host, std::string service, uint64_t start, SenderResult *result)
+{
+	result->messages = result->bytes = result->errors = 0;
+
+	try
+	{
+		kcmsg::Connection conn( family, SOCK_STREAM, IPPROTO_TCP, 1, "kcreplay" );
+		conn.resolveHost( host, service );
+		conn.Connect();
+
+		uint64_t first = records.front().timestamp;
+		uint64_t span = records.back().timestamp - first;
+		result->latencies.reserve( records.size() / nthreads * loops + 1 );
+
+		for ( int loop = 0; loop < loops; loop++ )
+		{
+			for ( size_t i = id; i < records.size(); i += nthreads )
+			{
+				Record &r = records[i];
+				uint64_t scheduled;
+
+				if ( mode == MODE_MAX || r.timestamp == 0 )
+				{
+					scheduled = monotonic();
+				}
+				else
+				{
+					// each pass of the recording starts where the previous one ended
+					uint64_t rel = ( r.timestamp - first ) + loop * span;
+					scheduled = start + (uint64_t) ( rel / speed );
+					if ( scheduled > monotonic() )
+						sleepUntil( scheduled );
+				}
+
+				if ( !sendAll( conn.getDescriptor(), &frames[r.offset], r.length ) )
+				{
+					result->errors++;
+					return;
+				}
+
+				result->latencies.push_back( monotonic() - scheduled );
+				result->messages++;
+				result->bytes += r.length;
+			}
+		}
+
+		conn.Shutdown( conn.getDescriptor(), SHUT_WR );
+		conn.Close( conn.getDescriptor() );
+	}
+	catch ( std::exception &e )
+	{
+		fprintf( stderr, "sender %d: %s\n", id, e.what() );
+		result->errors++;
+	}
+}
+
+double percentile(const std::vector<uint64_t> &sorted, double p)
+{
+	if ( sorted.empty() )
+		return ( 0.0 );
+	size_t idx = (size_t) ( p / 100.0 * ( sorted.size() - 1 ) );
+	return ( sorted[idx] / 1000.0 );
+}
+
+void usage(const char *prog)
+{
+	fprintf( stderr, "usage: %s [-j dir | -c file] [-m original|accelerated|max] [-s factor]"
+			" [-t threads] [-l loops] [-6] host service\n", prog );
+	exit( 2 );
+}
+
+} /* namespace */
+
+int main(int argc, char *argv[])
+{
+	static option longopts[] = {
+		{ "journal", required_argument, nullptr, 'j' },
+		{ "capture", required_argument, nullptr, 'c' },
+		{ "mode", required_argument, nullptr, 'm' },
+		{ "speed", required_argument, nullptr, 's' },
+		{ "threads", required_argument, nullptr, 't' },
+		{ "loop", required_argument, nullptr, 'l' },
+		{ "ipv6", no_argument, nullptr, '6' },
+		{ nullptr, 0, nullptr, 0 }
+	};
+
+	std::string journal, capture;
+	ReplayMode mode = MODE_ORIGINAL;
+	double speed = 10.0;
+	int nthreads = 1, loops = 1, opt;
+	sa_family_t family = AF_INET;
+
+	while ( ( opt = getopt_long( argc, argv, "j:c:m:s:t:l:6", longopts, nullptr ) ) != -1 )
+	{
+		switch ( opt )
+		{
+		case 'j' :
+			journal = optarg;
+			break;
+		case 'c' :
+			capture = optarg;
+			break;
+		case 'm' :
+			if ( strcmp( optarg, "original" ) == 0 )
+				mode = MODE_ORIGINAL;
+			else if ( strcmp( optarg, "accelerated" ) == 0 )
+				mode = MODE_ACCELERATED;
+			else if ( strcmp( optarg, "max" ) == 0 )
+				mode = MODE_MAX;
+			else
+				usage( argv[0] );
+			break;
+		case 's' :
+			speed = atof( optarg );
+			break;
+		case 't' :
+			nthreads = atoi( optarg );
+			break;
+		case 'l' :
+			loops = atoi( optarg );
+			break;
+		case '6' :
+			family = AF_INET6;
+			break;
+		default:
+			usage( argv[0] );
+		}
+	}
+
+	if ( ( argc - optind != 2 ) || ( journal.empty() == capture.empty() ) ||
+			( nthreads < 1 ) || ( loops < 1 ) || ( speed <= 0.0 ) )
+		usage( argv[0] );
+
+	if ( mode == MODE_ORIGINAL )
+		speed = 1.0;
+
+	try
+	{
+		if ( !journal.empty() )
+			loadJournal( journal );
+		else
+			loadCapture( capture );
+	}
+	catch ( std::exception &e )
+	{
+		fprintf( stderr, "%s: %s\n", argv[0], e.what() );
+		return ( 1 );
+	}
+
+	if ( records.empty() )
+	{
+		fprintf( stderr, "%s: nothing to replay\n", argv[0] );
+		return ( 1 );
+	}
+
+	printf( "replaying %zu records (%zu bytes) with %d thread(s)\n", records.size(), frames.size(), nthreads );
+
+	std::vector<SenderResult> results( nthreads );
+	std::vector<std::thread> threads;
+	uint64_t start = monotonic();
+
+	for ( int i = 0; i < nthreads; i++ )
+		threads.push_back( std::thread( sender, i, nthreads, loops, mode, speed, family,
+				std::string( argv[optind] ), std::string( argv[optind + 1] ), start, &results[i] ) );
+	for ( auto &t : threads )
+		t.join();
+
+	double elapsed = ( monotonic() - start ) / 1e9;
+	uint64_t messages = 0, bytes = 0, errors = 0;
+	std::vector<uint64_t> latencies;
+
+	for ( auto &r : results )
+	{
+		messages += r.messages;
+		bytes += r.bytes;
+		errors += r.errors;
+		latencies.insert( latencies.end(), r.latencies.begin(), r.latencies.end() );
+	}
+	std::sort( latencies.begin(), latencies.end() );
+
+	printf( "sent       %llu messages, %llu bytes, %llu errors in %.3f s\n",
+			(unsigned long long) messages, (unsigned long long) bytes, (unsigned long long) errors, elapsed );
+	printf( "throughput %.0f msgs/s, %.2f MB/s\n", messages / elapsed, bytes / elapsed / 1e6 );
+	printf( "latency us p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+			percentile( latencies, 50 ), percentile( latencies, 90 ), percentile( latencies, 99 ),
+			percentile( latencies, 99.9 ), percentile( latencies, 100 ) );
+
+	return ( errors ? 1 : 0 );
+}